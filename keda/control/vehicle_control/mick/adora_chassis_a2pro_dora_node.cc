@@ -37,6 +37,7 @@ extern "C"
 #include "serial/serial.h"
 
 #include "Controller.h"
+#include "WheelOdom.h"
 
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
@@ -55,6 +56,7 @@ int udp_local_port;
 int udp_target_port;
 
 int communication_mode = 0; // 0 for serial, 1 for UDP
+int debug_print = 0; // 1 prints the received chassis frames (runs at the tick rate)
 
 serial::Serial ros_ser;
 
@@ -296,22 +298,13 @@ void adora_a2pro_control2(s16 Lv, s16 Rv)
 
 void read_uart_buffer(void *dora_context)
 {
-	std::cout<<"  read_uart_buffer"<<std::endl;
 	if (communication_mode == 0) 
 	{ 
 		
 		len = ser.available();
-		std::cout<<"  serial:  len:"<<len<<std::endl;
 		if(len >= sizeof(AdoraA2Pro_RxData_ChassisState.data))
 		{
 			ser.read(buffer, len);
-	 
-			printf("buffer: ");
-			for (u8 i = 0; i < len; i++)
-			{
-				printf("  %02X ",buffer[i] );
-			}
-			printf("\n");
 		}   
 		else
 		{
@@ -370,13 +363,15 @@ void read_uart_buffer(void *dora_context)
 		}
 		return ;
 	}   
-			printf("buffer: ");
-			for (u8 i = 0; i < len; i++)
-			{
-				printf("  %02X ",buffer[i] );
-			}
-			printf("\n");
-
+	if (debug_print)
+	{
+		printf("buffer: ");
+		for (u8 i = 0; i < len; i++)
+		{
+			printf("  %02X ",buffer[i] );
+		}
+		printf("\n");
+	}
 
 	memset(AdoraA2Pro_RxData_ChassisState.data, 0, sizeof(AdoraA2Pro_RxData_ChassisState.data));
 	for (u8 i = 0; i < sizeof(AdoraA2Pro_RxData_ChassisState.data); i++)
@@ -424,14 +419,17 @@ void read_uart_buffer(void *dora_context)
 
 
 
-		std::cout<<"  control_mode:  "<<dadoraa2pro_msg.control_mode
-					<<"  percentage:  "<<dadoraa2pro_msg.control_mode
-					<<"  voltage:  "<<dadoraa2pro_msg.voltage
-					<<"  flage:  "<<dadoraa2pro_msg.flage
-					<<"  error_flage:  "<<dadoraa2pro_msg.error_flage
-					<<"   vx: " <<dadoraa2pro_msg.vx
-					<<"   wz: " <<dadoraa2pro_msg.wz
-					<<std::endl; 
+		if (debug_print)
+		{
+			std::cout<<"  control_mode:  "<<dadoraa2pro_msg.control_mode
+						<<"  percentage:  "<<dadoraa2pro_msg.control_mode
+						<<"  voltage:  "<<dadoraa2pro_msg.voltage
+						<<"  flage:  "<<dadoraa2pro_msg.flage
+						<<"  error_flage:  "<<dadoraa2pro_msg.error_flage
+						<<"   vx: " <<dadoraa2pro_msg.vx
+						<<"   wz: " <<dadoraa2pro_msg.wz
+						<<std::endl; 
+		}
 		
 
 		// 消息赋值
@@ -439,7 +437,10 @@ void read_uart_buffer(void *dora_context)
 		{
 			
 			//std::cout<<"  position_x:  "<<position_x<<"  position_y:  "<<position_y<<"   position_w: " <<position_w<<std::endl; 
-			std::cout<<"  linear_x:  "<<dadoraa2pro_msg.vx<<"  position_y:  "<<0<<"   linear_w: " <<dadoraa2pro_msg.wz<<std::endl; 
+			if (debug_print)
+			{
+				std::cout<<"  linear_x:  "<<dadoraa2pro_msg.vx<<"  position_y:  "<<0<<"   linear_w: " <<dadoraa2pro_msg.wz<<std::endl; 
+			}
 			struct timeval tv;
 			gettimeofday(&tv, NULL); 
 			json j_odom_pub;
@@ -473,6 +474,21 @@ void read_uart_buffer(void *dora_context)
 			std::string out_id = "Odometry";
 			// std::cout<<json_string;
 			int result = dora_send_output(dora_context, &out_id[0], out_id.length(), c_json_string, std::strlen(c_json_string));
+			delete[] c_json_string;
+			if (result != 0)
+			{
+				std::cerr << "failed to send output" << std::endl;
+			}
+
+			// binary odometry for localization (mm/s -> m/s, 0.001rad/s -> rad/s)
+			WheelOdom_h wheel_odom;
+			wheel_odom.stamp = tv.tv_sec + tv.tv_usec * 1e-6;
+			wheel_odom.seq = counter_odom_pub;
+			wheel_odom.vx = dadoraa2pro_msg.vx * 1e-3f;
+			wheel_odom.vy = 0.0f;
+			wheel_odom.wz = dadoraa2pro_msg.wz * 1e-3f;
+			std::string wheel_odom_id = "WheelOdom";
+			result = dora_send_output(dora_context, &wheel_odom_id[0], wheel_odom_id.length(), reinterpret_cast<char *>(&wheel_odom), sizeof(WheelOdom_h));
 			if (result != 0)
 			{
 				std::cerr << "failed to send output" << std::endl;
@@ -504,6 +520,7 @@ int main()
  
 	// Get communication mode from environment variable
 	communication_mode = std::getenv("COMMUNICATION_MODE") ? std::stoi(std::getenv("COMMUNICATION_MODE")) : 0; // Default to serial
+	debug_print = std::getenv("DEBUG_PRINT") ? std::stoi(std::getenv("DEBUG_PRINT")) : 0;
 
 	cout << "Communication Mode: " << (communication_mode == 0 ? "Serial" : "UDP") << endl;
 
@@ -648,7 +665,12 @@ int run(void *dora_context)
 			// 	enable_states_upload(1); 
 
 			// }
-			if (strncmp("SteeringCmd", id, 11) == 0)
+			if (strncmp("tick", id, 4) == 0)
+			{
+				// read chassis state and publish odometry
+				read_uart_buffer(dora_context);
+			}
+			else if (strncmp("SteeringCmd", id, 11) == 0)
 			{
 				steer_cmd_callback(data);
 			}
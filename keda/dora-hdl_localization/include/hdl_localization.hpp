@@ -6,14 +6,18 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include <vector>
+#include <sstream>
 #include <pclomp/ndt_omp.h>
 
 
 #include "pose_estimator.hpp"
 #include "delta_estimater.hpp"
 #include "imu_msg.hpp"
+#include "wheel_odom_msg.hpp"
 #include "getYaw.hpp"
 #include "slam_pose.hpp"
+#include "multi_resolution_registration.hpp"
+#include "scan_preprocessor.hpp"
 
 
 using namespace std;
@@ -24,7 +28,8 @@ public:
     bool init_param(double point_downsample_resolution);
     pcl::Registration<pcl::PointXYZI, pcl::PointXYZI>::Ptr create_registration();
     canslam::slampose compute_odometry(const Eigen::Matrix4f& pose);
-    pcl::PointCloud<pcl::PointXYZI>::Ptr downsample(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud);
+    void registration_stats(float& fitness, int& iterations) const;
+    void predict_wheel_odom(const canslam::wheel_odom_h& odom);
 
 
 
@@ -33,23 +38,17 @@ public:
     std::unique_ptr<hdl_localization::DeltaEstimater> delta_estimater;
     std::unique_ptr<hdl_localization::PoseEstimator> pose_estimator;
     pcl::Registration<pcl::PointXYZI, pcl::PointXYZI>::Ptr registration;
-    pcl::Filter<pcl::PointXYZI>::Ptr downsample_filter;
+    std::unique_ptr<hdl_localization::ScanPreprocessor> preprocessor;
     pcl::PointCloud<pcl::PointXYZI>::ConstPtr last_scan;
     std::vector<canslam::imu_msg_h> imu_data;
+    double last_odom_stamp;
 };
 
 
-pcl::Registration<pcl::PointXYZI, pcl::PointXYZI>::Ptr Hdl_Localization::create_registration()
+static pclomp::NormalDistributionsTransform<pcl::PointXYZI, pcl::PointXYZI>::Ptr create_ndt(double ndt_resolution, double transformation_epsilon, const std::string& ndt_neighbor_search_method)
 {
-  std::string reg_method = "NDT_OMP";
-  std::string ndt_neighbor_search_method = "DIRECT7";
-  double ndt_neighbor_search_radius = 2.0;
-  double ndt_resolution = 1.0;
-
-  if(reg_method == "NDT_OMP") 
-  {
     pclomp::NormalDistributionsTransform<pcl::PointXYZI, pcl::PointXYZI>::Ptr ndt(new pclomp::NormalDistributionsTransform<pcl::PointXYZI, pcl::PointXYZI>());
-    ndt->setTransformationEpsilon(0.01);
+    ndt->setTransformationEpsilon(transformation_epsilon);
     ndt->setResolution(ndt_resolution);
     if (ndt_neighbor_search_method == "DIRECT1") 
     {
@@ -61,20 +60,78 @@ pcl::Registration<pcl::PointXYZI, pcl::PointXYZI>::Ptr Hdl_Localization::create_
       ndt->setNeighborhoodSearchMethod(pclomp::DIRECT7);
     } 
     return ndt;
+}
+
+pcl::Registration<pcl::PointXYZI, pcl::PointXYZI>::Ptr Hdl_Localization::create_registration()
+{
+  // NDT_OMP : single resolution NDT
+  // NDT_OMP_MULTI : coarse NDT on a downsampled scan/map, then fine NDT from its result
+  std::string reg_method = std::getenv("reg_method") ? std::getenv("reg_method") : "NDT_OMP";
+  std::string ndt_neighbor_search_method = "DIRECT7";
+  double ndt_neighbor_search_radius = 2.0;
+  double ndt_resolution = 1.0;
+
+  if(reg_method == "NDT_OMP") 
+  {
+    return create_ndt(ndt_resolution, 0.01, ndt_neighbor_search_method);
   } 
+  else if(reg_method == "NDT_OMP_MULTI")
+  {
+    double coarse_resolution = std::getenv("coarse_ndt_resolution") ? std::stod(std::getenv("coarse_ndt_resolution")) : 3.0;
+    double coarse_scan_leaf = std::getenv("coarse_scan_resolution") ? std::stod(std::getenv("coarse_scan_resolution")) : 0.5;
+    double coarse_map_leaf = std::getenv("coarse_map_resolution") ? std::stod(std::getenv("coarse_map_resolution")) : 0.5;
+    double coarse_min_probability = std::getenv("coarse_min_probability") ? std::stod(std::getenv("coarse_min_probability")) : 1.0;
+    std::cout << "coarse_ndt_resolution : " << coarse_resolution << " coarse_scan_resolution : " << coarse_scan_leaf << " coarse_map_resolution : " << coarse_map_leaf << " coarse_min_probability : " << coarse_min_probability << std::endl;
+
+    // the coarse level only needs to bring the guess into the basin of the fine grid
+    auto coarse = create_ndt(coarse_resolution, 0.05, "DIRECT1");
+    coarse->setMaximumIterations(10);
+    auto fine = create_ndt(ndt_resolution, 0.01, ndt_neighbor_search_method);
+
+    hdl_localization::MultiResolutionRegistration<pcl::PointXYZI, pcl::PointXYZI>::Ptr multi(
+      new hdl_localization::MultiResolutionRegistration<pcl::PointXYZI, pcl::PointXYZI>(coarse, fine, coarse_scan_leaf, coarse_map_leaf));
+
+    // a coarse result with a low transformation probability (mean per-point NDT score) is not trusted,
+    // the fine level then starts from the original guess
+    multi->setCoarseAcceptance([coarse_min_probability](const pcl::Registration<pcl::PointXYZI, pcl::PointXYZI>& reg) {
+      return static_cast<const pclomp::NormalDistributionsTransform<pcl::PointXYZI, pcl::PointXYZI>&>(reg).getTransformationProbability() >= coarse_min_probability;
+    });
+    return multi;
+  }
+  std::cerr << "unknown reg_method : " << reg_method << std::endl;
   return nullptr;
 }
 
 bool Hdl_Localization::init_param(double point_downsample_resolution)
 {
-    double downsample_resolution = point_downsample_resolution;
-    boost::shared_ptr<pcl::VoxelGrid<pcl::PointXYZI>> voxelgrid(new pcl::VoxelGrid<pcl::PointXYZI>());
-    voxelgrid->setLeafSize(downsample_resolution, downsample_resolution, downsample_resolution);
-    downsample_filter = voxelgrid;
+    // lidar_extrinsic : "x y z roll pitch yaw" [m, deg], rslidar -> base_link (default: 90° yaw)
+    std::vector<float> extrinsic_values = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 90.0f};
+    if (std::getenv("lidar_extrinsic"))
+    {
+        std::istringstream iss(std::getenv("lidar_extrinsic"));
+        for (auto& value : extrinsic_values)
+        {
+            iss >> value;
+        }
+    }
+    Eigen::Matrix4f extrinsic = Eigen::Matrix4f::Identity();
+    extrinsic.block<3, 3>(0, 0) = (Eigen::AngleAxisf(extrinsic_values[5] * M_PI / 180.0, Eigen::Vector3f::UnitZ()) *
+                                   Eigen::AngleAxisf(extrinsic_values[4] * M_PI / 180.0, Eigen::Vector3f::UnitY()) *
+                                   Eigen::AngleAxisf(extrinsic_values[3] * M_PI / 180.0, Eigen::Vector3f::UnitX())).toRotationMatrix();
+    extrinsic.block<3, 1>(0, 3) = Eigen::Vector3f(extrinsic_values[0], extrinsic_values[1], extrinsic_values[2]);
+
+    double min_range = std::getenv("min_range") ? std::stod(std::getenv("min_range")) : 0.0;
+    double max_range = std::getenv("max_range") ? std::stod(std::getenv("max_range")) : 1000.0;
+    preprocessor.reset(new hdl_localization::ScanPreprocessor(point_downsample_resolution, min_range, max_range, extrinsic));
 
     registration = create_registration();
+    if (!registration)
+    {
+        return false;
+    }
 
     relocalizing = false;
+    last_odom_stamp = 0.0;
     delta_estimater.reset(new hdl_localization::DeltaEstimater(create_registration()));
 
     pose_estimator.reset(
@@ -88,16 +145,62 @@ bool Hdl_Localization::init_param(double point_downsample_resolution)
     return true;
 }
 
-pcl::PointCloud<pcl::PointXYZI>::Ptr Hdl_Localization::downsample(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud) {
-  if (!downsample_filter) {
-    return cloud;
+void Hdl_Localization::registration_stats(float& fitness, int& iterations) const
+{
+  using NDT = pclomp::NormalDistributionsTransform<pcl::PointXYZI, pcl::PointXYZI>;
+  using MultiResolution = hdl_localization::MultiResolutionRegistration<pcl::PointXYZI, pcl::PointXYZI>;
+
+  fitness = 0.0f;
+  iterations = -1;
+
+  // transformation probability is already computed by align(), getFitnessScore() would need another kd-tree pass
+  auto ndt = boost::dynamic_pointer_cast<NDT>(registration);
+  if (ndt)
+  {
+    fitness = ndt->getTransformationProbability();
+    iterations = ndt->getFinalNumIteration();
+    return;
   }
-  pcl::PointCloud<pcl::PointXYZI>::Ptr filtered(new pcl::PointCloud<pcl::PointXYZI>());
-  downsample_filter->setInputCloud(cloud);
-  downsample_filter->filter(*filtered);
-  // filtered->header = cloud->header;
 
-  return filtered;
+  // multi resolution: fitness of the fine level, iterations of both levels
+  auto multi = boost::dynamic_pointer_cast<MultiResolution>(registration);
+  if (multi)
+  {
+    auto coarse = boost::dynamic_pointer_cast<NDT>(multi->coarse_registration());
+    auto fine = boost::dynamic_pointer_cast<NDT>(multi->fine_registration());
+    if (coarse && fine)
+    {
+      fitness = fine->getTransformationProbability();
+      iterations = coarse->getFinalNumIteration() + fine->getFinalNumIteration();
+    }
+  }
+}
+
+void Hdl_Localization::predict_wheel_odom(const canslam::wheel_odom_h& odom)
+{
+    if (last_odom_stamp <= 0.0 || odom.stamp <= last_odom_stamp)
+    {
+        last_odom_stamp = odom.stamp;
+        return;
+    }
+
+    double dt = odom.stamp - last_odom_stamp;
+    last_odom_stamp = odom.stamp;
+    if (dt > 0.200)  // chassis stream was interrupted, do not integrate over the gap
+    {
+        return;
+    }
+
+    // constant velocity arc over dt, expressed in the previous base_link frame
+    float dtheta = odom.wz * dt;
+    float c = std::cos(dtheta / 2.0f);
+    float s = std::sin(dtheta / 2.0f);
+    Eigen::Matrix4f delta = Eigen::Matrix4f::Identity();
+    delta.block<3, 3>(0, 0) = Eigen::AngleAxisf(dtheta, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+    delta(0, 3) = (odom.vx * c - odom.vy * s) * dt;
+    delta(1, 3) = (odom.vx * s + odom.vy * c) * dt;
+
+    pose_estimator->predict_odom(delta, dt);
 }
 
 canslam::slampose Hdl_Localization::compute_odometry(const Eigen::Matrix4f& pose)
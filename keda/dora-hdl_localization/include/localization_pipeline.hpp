@@ -0,0 +1,117 @@
+#ifndef HDL_LOCALIZATION_PIPELINE_HPP
+#define HDL_LOCALIZATION_PIPELINE_HPP
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/io/pcd_io.h>
+#include <pcl/filters/voxel_grid.h>
+
+#include "hdl_localization.hpp"
+
+#define imu_dt 0.05
+
+// per-stage processing time of one scan [ms]
+struct StageTiming
+{
+    float preprocess;   // NaN/range rejection, base_link transform and downsampling (ScanPreprocessor)
+    float predict;
+    float correct;
+};
+
+static float elapsed_ms(const std::chrono::steady_clock::time_point& begin, const std::chrono::steady_clock::time_point& end)
+{
+    return std::chrono::duration<float, std::milli>(end - begin).count();
+}
+
+pcl::PointCloud<pcl::PointXYZI>::Ptr init_map(double map_downsample_resolution, std::string map_pcd_path)
+{
+    pcl::PointCloud<pcl::PointXYZI>::Ptr globalmap;
+    globalmap.reset(new pcl::PointCloud<pcl::PointXYZI>());
+    if (pcl::io::loadPCDFile(map_pcd_path, *globalmap) == -1)
+    {
+        cerr << "[ERROR] Could not read file: " << map_pcd_path << endl;
+        return nullptr;
+    }
+    double downsample_resolution = map_downsample_resolution;
+    boost::shared_ptr<pcl::VoxelGrid<pcl::PointXYZI>> voxelgrid(new pcl::VoxelGrid<pcl::PointXYZI>());
+    voxelgrid->setLeafSize(downsample_resolution, downsample_resolution, downsample_resolution);
+    voxelgrid->setInputCloud(globalmap);
+
+    pcl::PointCloud<pcl::PointXYZI>::Ptr filtered(new pcl::PointCloud<pcl::PointXYZI>());
+    voxelgrid->filter(*filtered);
+
+    return filtered;
+}
+
+/**
+ * @brief run the prediction with the queued imu data and correct the pose estimation with a preprocessed scan
+ *        shared by the dora node and the offline replay
+ * @param trans_clouds  downsampled scan in base_link (ScanPreprocessor::process)
+ * @param stamp         scan stamp [s]
+ * @return false if imu is required but not available yet
+ */
+bool localize_scan(Hdl_Localization& hdl_loc, const pcl::PointCloud<pcl::PointXYZI>::Ptr& trans_clouds, double stamp, bool use_imu, bool get_imu, StageTiming& timing)
+{
+    hdl_loc.last_scan = trans_clouds;
+    auto t_begin = std::chrono::steady_clock::now();
+
+    if(use_imu)
+    {
+        if(!get_imu)
+        {
+            std::cerr << "imu data is not ready" << std::endl;
+            return false;
+        }
+        else
+        {
+            auto imu_iter = hdl_loc.imu_data.begin();
+            for (imu_iter; imu_iter != hdl_loc.imu_data.end(); imu_iter++)
+            {
+                // TODO: check stamp
+                if (imu_iter->stamp > stamp)
+                {
+                    break;
+                }
+                if(imu_iter->stamp + imu_dt < stamp)//获取最近距离雷达点云最近一帧的imu数据
+                {
+                    continue;
+                }
+                const auto& acc = imu_iter->linear_acceleration;
+                const auto& gyro = imu_iter->angular_velocity;
+
+                if (std::isnan(acc.x) || std::isnan(acc.y) || std::isnan(acc.z) ||
+                    std::isnan(gyro.x) || std::isnan(gyro.y) || std::isnan(gyro.z))
+                {
+                    continue;
+                }
+                double acc_sign = 1.0;
+                double gyro_sign = 1.0;
+
+                hdl_loc.pose_estimator->predict(
+                    imu_iter->stamp,
+                    acc_sign * Eigen::Vector3f(acc.x, acc.y, acc.z),
+                    gyro_sign * Eigen::Vector3f(gyro.x, gyro.y, gyro.z)
+                );
+            }
+            hdl_loc.imu_data.erase(hdl_loc.imu_data.begin(),imu_iter);
+        }
+    }
+    else
+    {
+        hdl_loc.pose_estimator->predict(stamp); //不使用imu
+    }
+    auto t_predict = std::chrono::steady_clock::now();
+
+    auto aligned = hdl_loc.pose_estimator->correct(stamp, trans_clouds);
+    auto t_correct = std::chrono::steady_clock::now();
+
+    timing.predict = elapsed_ms(t_begin, t_predict);
+    timing.correct = elapsed_ms(t_predict, t_correct);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef HDL_LOCALIZATION_MULTI_RESOLUTION_REGISTRATION_HPP
+#define HDL_LOCALIZATION_MULTI_RESOLUTION_REGISTRATION_HPP
+
+#include <functional>
+#include <pcl/point_cloud.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/registration/registration.h>
+
+namespace hdl_localization {
+
+/**
+ * @brief coarse-to-fine registration
+ *        a coarse registration aligns a heavily downsampled scan against a downsampled target,
+ *        and its result is used as the initial guess of the fine registration.
+ *        The target pyramid is built once in setInputTarget().
+ */
+template<typename PointSource, typename PointTarget>
+class MultiResolutionRegistration : public pcl::Registration<PointSource, PointTarget, float> {
+public:
+  using Base = pcl::Registration<PointSource, PointTarget, float>;
+  using Ptr = boost::shared_ptr<MultiResolutionRegistration<PointSource, PointTarget>>;
+  using ConstPtr = boost::shared_ptr<const MultiResolutionRegistration<PointSource, PointTarget>>;
+
+  using typename Base::Matrix4;
+  using typename Base::PointCloudSource;
+  using typename Base::PointCloudSourceConstPtr;
+  using typename Base::PointCloudTargetConstPtr;
+
+  /**
+   * @brief constructor
+   * @param coarse              registration used on the coarse level
+   * @param fine                registration used on the fine level
+   * @param source_leaf_size    voxel size of the scan on the coarse level
+   * @param target_leaf_size    voxel size of the map on the coarse level
+   */
+  MultiResolutionRegistration(const typename Base::Ptr& coarse, const typename Base::Ptr& fine, double source_leaf_size, double target_leaf_size)
+      : coarse(coarse), fine(fine), source_leaf_size(source_leaf_size), target_leaf_size(target_leaf_size) {
+    Base::reg_name_ = "MultiResolutionRegistration";
+  }
+  virtual ~MultiResolutionRegistration() {}
+
+  void setInputSource(const PointCloudSourceConstPtr& cloud) override {
+    // the fine level reuses the given scan as is, only the coarse level gets a new cloud
+    Base::setInputSource(cloud);
+    fine->setInputSource(cloud);
+    coarse->setInputSource(voxelize<PointSource>(cloud, source_leaf_size));
+  }
+
+  void setInputTarget(const PointCloudTargetConstPtr& cloud) override {
+    // set target_ directly, Base::setInputTarget would build a kd-tree over the map that is never used
+    Base::target_ = cloud;
+    Base::target_cloud_updated_ = false;
+    fine->setInputTarget(cloud);
+    coarse->setInputTarget(voxelize<PointTarget>(cloud, target_leaf_size));
+  }
+
+  /**
+   * @brief additional test of the coarse result before it is used as the fine initial guess
+   *        (NDT reports convergence also when it stops at the iteration limit, so a score threshold is more reliable)
+   * @param accept  returns true if the aligned coarse registration can be used
+   */
+  void setCoarseAcceptance(const std::function<bool(const Base& coarse)>& accept) { coarse_accept = accept; }
+
+  const typename Base::Ptr& coarse_registration() const { return coarse; }
+  const typename Base::Ptr& fine_registration() const { return fine; }
+
+protected:
+  void computeTransformation(PointCloudSource& output, const Matrix4& guess) override {
+    PointCloudSource coarse_aligned;
+    coarse->align(coarse_aligned, guess);
+
+    // fall back to the given guess if the coarse level diverged
+    const bool accepted = coarse->hasConverged() && (!coarse_accept || coarse_accept(*coarse));
+    Matrix4 fine_guess = accepted ? coarse->getFinalTransformation() : guess;
+    fine->align(output, fine_guess);
+
+    Base::final_transformation_ = fine->getFinalTransformation();
+    Base::converged_ = fine->hasConverged();
+  }
+
+private:
+  template<typename PointT>
+  static boost::shared_ptr<pcl::PointCloud<PointT>> voxelize(const boost::shared_ptr<const pcl::PointCloud<PointT>>& cloud, double leaf_size) {
+    boost::shared_ptr<pcl::PointCloud<PointT>> filtered(new pcl::PointCloud<PointT>());
+    pcl::VoxelGrid<PointT> voxelgrid;
+    voxelgrid.setLeafSize(leaf_size, leaf_size, leaf_size);
+    voxelgrid.setInputCloud(cloud);
+    voxelgrid.filter(*filtered);
+    return filtered;
+  }
+
+private:
+  typename Base::Ptr coarse;
+  typename Base::Ptr fine;
+  double source_leaf_size;
+  double target_leaf_size;
+  std::function<bool(const Base&)> coarse_accept;
+};
+
+}  // namespace hdl_localization
+
+#endif
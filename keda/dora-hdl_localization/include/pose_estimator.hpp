@@ -57,8 +57,10 @@ public:
 
   /**
    * @brief update the state of the odomety-based pose estimation
+   * @param odom_delta  relative motion since the previous call
+   * @param dt          time span of odom_delta [sec]
    */
-  void predict_odom(const Eigen::Matrix4f& odom_delta);
+  void predict_odom(const Eigen::Matrix4f& odom_delta, double dt);
 
   /**
    * @brief correct
@@ -75,6 +77,7 @@ public:
   Eigen::Vector3f vel() const;
   Eigen::Quaternionf quat() const;
   Eigen::Matrix4f matrix() const;
+  Eigen::MatrixXf pose_cov() const;   // 7x7 covariance of [pos, quat]
 
   Eigen::Vector3f odom_pos() const;
   Eigen::Quaternionf odom_quat() const;
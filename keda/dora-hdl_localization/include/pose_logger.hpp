@@ -0,0 +1,256 @@
+#ifndef HDL_LOCALIZATION_POSE_LOGGER_HPP
+#define HDL_LOCALIZATION_POSE_LOGGER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hdl_localization {
+
+/**
+ * @brief fixed-size binary record of one localization update
+ */
+struct PoseRecord {
+  double stamp;             // scan stamp [s]
+  uint32_t seq;             // scan sequence number
+  uint32_t num_points;      // points fed to the registration
+  float pos[3];             // x, y, z
+  float quat[4];            // w, x, y, z
+  float cov[28];            // upper triangle of the 7x7 [pos, quat] covariance, row major
+  float fitness;            // registration score (NDT: transformation probability)
+  int32_t iterations;       // registration iterations, -1 if unknown
+  float t_preprocess;       // [ms]
+  float t_predict;          // [ms]
+  float t_correct;          // [ms]
+  float t_total;            // [ms]
+  uint32_t flags;           // see PoseRecord::Flags
+
+  enum Flags : uint32_t { USE_IMU = 1u << 0, USE_ODOM = 1u << 1 };
+};
+static_assert(sizeof(PoseRecord) == 184, "PoseRecord layout is part of the log file format");
+
+/**
+ * @brief header written at the beginning of every log file
+ */
+struct PoseLogHeader {
+  char magic[4];            // "HPLG"
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t reserved;
+
+  static PoseLogHeader make() {
+    PoseLogHeader header;
+    std::memcpy(header.magic, "HPLG", 4);
+    header.version = 1;
+    header.record_size = sizeof(PoseRecord);
+    header.reserved = 0;
+    return header;
+  }
+
+  bool valid() const {
+    return std::memcmp(magic, "HPLG", 4) == 0 && version == 1 && record_size == sizeof(PoseRecord);
+  }
+};
+
+/**
+ * @brief asynchronous pose logger
+ *        push() copies a record into a preallocated single-producer/single-consumer ring and never blocks.
+ *        A writer thread drains the ring into a rotating binary file (path, path.1, ..., path.N-1)
+ *        and optionally appends "x y" lines to a plain text trajectory file.
+ */
+class PoseLogger {
+public:
+  /**
+   * @brief constructor
+   * @param path             binary log file path
+   * @param trajectory_path  text trajectory file ("x y" per line), empty to disable
+   * @param capacity         number of records in the ring (rounded up to a power of two)
+   * @param max_file_bytes   rotate the binary log when it exceeds this size
+   * @param max_files        number of rotated binary files to keep
+   */
+  PoseLogger(const std::string& path, const std::string& trajectory_path = "", size_t capacity = 4096, size_t max_file_bytes = 64 << 20, int max_files = 4)
+      : path(path), trajectory_path(trajectory_path), max_file_bytes(max_file_bytes), max_files(max_files < 1 ? 1 : max_files),
+        head(0), tail(0), dropped_count(0), running(false), file(nullptr), trajectory_file(nullptr), file_bytes(0) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    ring.resize(size);
+    mask = size - 1;
+  }
+
+  ~PoseLogger() { stop(); }
+
+  PoseLogger(const PoseLogger&) = delete;
+  PoseLogger& operator=(const PoseLogger&) = delete;
+
+  /**
+   * @brief open the output files and start the writer thread
+   */
+  bool start() {
+    if (running) {
+      return true;
+    }
+    if (!path.empty() && !open_file()) {
+      std::cerr << "[PoseLogger] failed to open " << path << std::endl;
+      return false;
+    }
+    if (!trajectory_path.empty()) {
+      trajectory_file = std::fopen(trajectory_path.c_str(), "w");
+      if (!trajectory_file) {
+        std::cerr << "[PoseLogger] failed to open " << trajectory_path << std::endl;
+        return false;
+      }
+    }
+
+    running = true;
+    writer = std::thread(&PoseLogger::writer_loop, this);
+    return true;
+  }
+
+  /**
+   * @brief stop the writer thread after draining the remaining records
+   */
+  void stop() {
+    if (running.exchange(false)) {
+      cond.notify_one();
+      writer.join();
+    }
+    if (file) {
+      std::fclose(file);
+      file = nullptr;
+    }
+    if (trajectory_file) {
+      std::fclose(trajectory_file);
+      trajectory_file = nullptr;
+    }
+  }
+
+  /**
+   * @brief enqueue a record (hot path, never blocks)
+   * @return false if the ring is full and the record was dropped
+   */
+  bool push(const PoseRecord& record) {
+    const uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) > mask) {
+      dropped_count.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    ring[h & mask] = record;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint64_t dropped() const { return dropped_count.load(std::memory_order_relaxed); }
+
+private:
+  void writer_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+      cond.wait_for(lock, std::chrono::milliseconds(100));
+      drain();
+    }
+    drain();
+  }
+
+  void drain() {
+    const uint64_t t = tail.load(std::memory_order_relaxed);
+    const uint64_t h = head.load(std::memory_order_acquire);
+    if (t == h) {
+      return;
+    }
+
+    // the ring is contiguous, so the pending records are written in at most two chunks
+    const size_t begin = t & mask;
+    const size_t count = h - t;
+    const size_t first = std::min(count, ring.size() - begin);
+    write_records(&ring[begin], first);
+    write_records(&ring[0], count - first);
+
+    if (file) {
+      std::fflush(file);
+    }
+    if (trajectory_file) {
+      std::fflush(trajectory_file);
+    }
+    tail.store(h, std::memory_order_release);
+  }
+
+  void write_records(const PoseRecord* records, size_t count) {
+    if (count == 0) {
+      return;
+    }
+    if (file) {
+      std::fwrite(records, sizeof(PoseRecord), count, file);
+      file_bytes += sizeof(PoseRecord) * count;
+      if (file_bytes >= max_file_bytes) {
+        rotate();
+      }
+    }
+    if (trajectory_file) {
+      for (size_t i = 0; i < count; i++) {
+        std::fprintf(trajectory_file, "%g %g\n", records[i].pos[0], records[i].pos[1]);
+      }
+    }
+  }
+
+  bool open_file() {
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+      return false;
+    }
+    const PoseLogHeader header = PoseLogHeader::make();
+    std::fwrite(&header, sizeof(header), 1, file);
+    file_bytes = sizeof(header);
+    return true;
+  }
+
+  void rotate() {
+    std::fclose(file);
+    file = nullptr;
+
+    for (int i = max_files - 1; i > 0; i--) {
+      const std::string src = i == 1 ? path : path + "." + std::to_string(i - 1);
+      const std::string dst = path + "." + std::to_string(i);
+      std::rename(src.c_str(), dst.c_str());
+    }
+
+    if (!open_file()) {
+      std::cerr << "[PoseLogger] failed to reopen " << path << std::endl;
+    }
+  }
+
+private:
+  const std::string path;
+  const std::string trajectory_path;
+  const size_t max_file_bytes;
+  const int max_files;
+
+  std::vector<PoseRecord> ring;
+  size_t mask;
+  std::atomic<uint64_t> head;  // written by the producer
+  std::atomic<uint64_t> tail;  // written by the writer thread
+  std::atomic<uint64_t> dropped_count;
+
+  std::atomic_bool running;
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable cond;
+
+  std::FILE* file;
+  std::FILE* trajectory_file;
+  size_t file_bytes;
+};
+
+}  // namespace hdl_localization
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef HDL_LOCALIZATION_SCAN_PREPROCESSOR_HPP
+#define HDL_LOCALIZATION_SCAN_PREPROCESSOR_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace hdl_localization {
+
+/**
+ * @brief single pass scan preprocessing
+ *        rejects non-finite and out-of-range points, transforms them into base_link
+ *        and averages them in a hashed voxel grid (same output as VoxelGrid, but in one pass).
+ *        The voxel table is kept between frames, so a frame allocates only the output cloud.
+ */
+class ScanPreprocessor {
+public:
+  using PointT = pcl::PointXYZI;
+
+  /**
+   * @brief constructor
+   * @param leaf_size   voxel size, <= 0 disables downsampling
+   * @param min_range   points closer than this (in the sensor frame) are rejected
+   * @param max_range   points farther than this (in the sensor frame) are rejected
+   * @param extrinsic   sensor to base_link transformation
+   */
+  ScanPreprocessor(double leaf_size, double min_range, double max_range, const Eigen::Matrix4f& extrinsic)
+      : inv_leaf_size(leaf_size > 0.0 ? 1.0f / leaf_size : 0.0f), min_range_sq(min_range * min_range), max_range_sq(max_range * max_range),
+        rotation(extrinsic.block<3, 3>(0, 0)), translation(extrinsic.block<3, 1>(0, 3)), generation(0) {
+    resize_table(1 << 14);
+  }
+
+  /**
+   * @brief wire format: seq (4 bytes) + padding (4 bytes) + stamp in us (8 bytes), then x y z intensity floats per point
+   */
+  static uint32_t wire_seq(const char* bytes) {
+    uint32_t seq;
+    std::memcpy(&seq, bytes, sizeof(seq));
+    return seq;
+  }
+
+  static uint64_t wire_stamp(const char* bytes) {
+    uint64_t stamp;
+    std::memcpy(&stamp, bytes + 8, sizeof(stamp));
+    return stamp;
+  }
+
+  /**
+   * @brief preprocess a scan given in the wire format
+   * @param size  number of points
+   */
+  pcl::PointCloud<PointT>::Ptr process(const char* bytes, int32_t size) {
+    begin_frame(size);
+    const char* points = bytes + 16;
+    for (int32_t i = 0; i < size; i++) {
+      float p[4];
+      std::memcpy(p, points + 16 * i, sizeof(p));
+      add_point(p[0], p[1], p[2], p[3]);
+    }
+
+    auto cloud = end_frame();
+    cloud->header.seq = wire_seq(bytes);
+    cloud->header.stamp = wire_stamp(bytes);
+    return cloud;
+  }
+
+  /**
+   * @brief preprocess a scan given as a point cloud
+   */
+  pcl::PointCloud<PointT>::Ptr process(const pcl::PointCloud<PointT>& scan) {
+    begin_frame(scan.size());
+    for (const auto& pt : scan.points) {
+      add_point(pt.x, pt.y, pt.z, pt.intensity);
+    }
+
+    auto cloud = end_frame();
+    cloud->header.seq = scan.header.seq;
+    cloud->header.stamp = scan.header.stamp;
+    return cloud;
+  }
+
+private:
+  struct Voxel {
+    Eigen::Vector4f sum;  // x, y, z, intensity
+    uint32_t num_points;
+  };
+
+  void begin_frame(size_t num_points) {
+    voxels.clear();
+    if (inv_leaf_size > 0.0f) {
+      // keep the load factor below 0.5 even if every point falls into its own voxel
+      size_t required = table_keys.size();
+      while (required < num_points * 2) {
+        required <<= 1;
+      }
+      if (required != table_keys.size()) {
+        resize_table(required);
+      }
+      if (++generation == 0) {
+        std::fill(table_generations.begin(), table_generations.end(), 0);
+        generation = 1;
+      }
+    }
+  }
+
+  void add_point(float x, float y, float z, float intensity) {
+    if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z)) {
+      return;
+    }
+    const float range_sq = x * x + y * y + z * z;
+    if (range_sq < min_range_sq || range_sq > max_range_sq) {
+      return;
+    }
+
+    const Eigen::Vector3f p = rotation * Eigen::Vector3f(x, y, z) + translation;
+    if (inv_leaf_size <= 0.0f) {
+      voxels.push_back(Voxel{Eigen::Vector4f(p.x(), p.y(), p.z(), intensity), 1});
+      return;
+    }
+
+    Voxel& voxel = voxels[find_or_insert(voxel_key(p))];
+    voxel.sum += Eigen::Vector4f(p.x(), p.y(), p.z(), intensity);
+    voxel.num_points++;
+  }
+
+  pcl::PointCloud<PointT>::Ptr end_frame() {
+    pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>());
+    cloud->header.frame_id = "base_link";
+    cloud->resize(voxels.size());
+    for (size_t i = 0; i < voxels.size(); i++) {
+      const Eigen::Vector4f mean = voxels[i].sum / voxels[i].num_points;
+      auto& pt = cloud->at(i);
+      pt.x = mean[0];
+      pt.y = mean[1];
+      pt.z = mean[2];
+      pt.intensity = mean[3];
+    }
+    cloud->width = cloud->size();
+    cloud->height = 1;
+    cloud->is_dense = true;
+    return cloud;
+  }
+
+  uint64_t voxel_key(const Eigen::Vector3f& p) const {
+    // 21 bits per axis, +-2^20 voxels around the origin
+    const uint64_t ix = static_cast<uint64_t>(static_cast<int64_t>(std::floor(p.x() * inv_leaf_size)) + (1 << 20)) & 0x1FFFFF;
+    const uint64_t iy = static_cast<uint64_t>(static_cast<int64_t>(std::floor(p.y() * inv_leaf_size)) + (1 << 20)) & 0x1FFFFF;
+    const uint64_t iz = static_cast<uint64_t>(static_cast<int64_t>(std::floor(p.z() * inv_leaf_size)) + (1 << 20)) & 0x1FFFFF;
+    return (ix << 42) | (iy << 21) | iz;
+  }
+
+  size_t find_or_insert(uint64_t key) {
+    const size_t mask = table_keys.size() - 1;
+    size_t slot = ((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    while (table_generations[slot] == generation) {
+      if (table_keys[slot] == key) {
+        return table_values[slot];
+      }
+      slot = (slot + 1) & mask;
+    }
+
+    table_generations[slot] = generation;
+    table_keys[slot] = key;
+    table_values[slot] = voxels.size();
+    voxels.push_back(Voxel{Eigen::Vector4f::Zero(), 0});
+    return table_values[slot];
+  }
+
+  void resize_table(size_t size) {
+    table_keys.assign(size, 0);
+    table_values.assign(size, 0);
+    table_generations.assign(size, 0);
+    generation = 0;
+  }
+
+private:
+  const float inv_leaf_size;
+  const float min_range_sq;
+  const float max_range_sq;
+  const Eigen::Matrix3f rotation;
+  const Eigen::Vector3f translation;
+
+  // open addressing table: voxel key -> index in voxels, a slot is used if its generation matches the current frame
+  std::vector<uint64_t> table_keys;
+  std::vector<uint32_t> table_values;
+  std::vector<uint32_t> table_generations;
+  uint32_t generation;
+
+  std::vector<Voxel, Eigen::aligned_allocator<Voxel>> voxels;
+};
+
+}  // namespace hdl_localization
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef WHEEL_ODOM_MSG_H
+#define WHEEL_ODOM_MSG_H
+
+#include <cstdint>
+
+namespace canslam
+{
+    // same layout as WheelOdom_h in keda/include/WheelOdom.h
+    struct wheel_odom_h
+    {
+        double stamp;
+        uint32_t seq;
+        float vx;
+        float vy;
+        float wz;
+    };
+}
+
+#endif
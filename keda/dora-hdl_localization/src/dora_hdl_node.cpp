@@ -13,38 +13,15 @@ extern "C"
 #include <pcl/point_types.h>
 #include <pcl/io/pcd_io.h>
 #include <boost/smart_ptr.hpp>
-#include <pcl/filters/approximate_voxel_grid.h>
-#include <pcl/filters/passthrough.h>
-#include <pcl/filters/filter.h>
 #include <thread>  
 #include <chrono>  
 
 #include "hdl_localization.hpp"
+#include "localization_pipeline.hpp"
+#include "pose_logger.hpp"
 
-#define imu_dt 0.05
 
 
-
-pcl::PointCloud<pcl::PointXYZI>::Ptr init_map(double map_downsample_resolution, std::string map_pcd_path)
-{
-    pcl::PointCloud<pcl::PointXYZI>::Ptr globalmap;
-    globalmap.reset(new pcl::PointCloud<pcl::PointXYZI>());
-    if (pcl::io::loadPCDFile(map_pcd_path, *globalmap) == -1) 
-    { 
-        cerr << "[ERROR] Could not read file: " << map_pcd_path << endl;
-        return nullptr;
-    }
-    double downsample_resolution = map_downsample_resolution;
-    boost::shared_ptr<pcl::VoxelGrid<pcl::PointXYZI>> voxelgrid(new pcl::VoxelGrid<pcl::PointXYZI>());
-    voxelgrid->setLeafSize(downsample_resolution, downsample_resolution, downsample_resolution);
-    voxelgrid->setInputCloud(globalmap);
-
-    pcl::PointCloud<pcl::PointXYZI>::Ptr filtered(new pcl::PointCloud<pcl::PointXYZI>());
-    voxelgrid->filter(*filtered);
-
-    return filtered;
-}
-
 //*********************************test downsample*********************************************************
 
 // pcl::PointCloud<pcl::PointXYZI>::Ptr downsample(pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud) 
@@ -67,135 +44,27 @@ pcl::PointCloud<pcl::PointXYZI>::Ptr init_map(double map_downsample_resolution,
 //************************************************************************************************************
 
 
-pcl::PointCloud<pcl::PointXYZI>::Ptr bytes2cloud(const char *bytes, int32_t size)
+bool run_once(Hdl_Localization& hdl_loc, const char *data, int32_t point_len, void* dora_context, hdl_localization::PoseLogger& pose_logger, bool use_imu, bool get_imu)
 {
-    if (size <= 0)
+    auto t_begin = std::chrono::steady_clock::now();
+    if (point_len <= 0)
     {
         std::cerr << "Error: Point cloud size <= 0!" << std::endl;
-        return nullptr;
-    }
-
-    pcl::PointCloud<pcl::PointXYZI>::Ptr row_cloud(new pcl::PointCloud<pcl::PointXYZI>());
-    row_cloud->header.seq = *(std::uint32_t *)bytes;
-    row_cloud->header.stamp = *(std::uint64_t *)(bytes + 8);
-    // std::cout << "row_cloud->header.stamp: " << row_cloud->header.stamp << std::endl;
-    row_cloud->header.frame_id = "rslidar";
-    row_cloud->width = size;
-    row_cloud->height = 1;
-    row_cloud->is_dense = false;
-    for (size_t i = 0; i < size; i++) 
-    {
-        pcl::PointXYZI tem_point;
-        tem_point.x = *(float *)(bytes + 16 + 16 * i);
-        tem_point.y = *(float *)(bytes + 16 + 4 + 16 * i);
-        tem_point.z = *(float *)(bytes + 16 + 8 + 16 * i);
-        tem_point.intensity = *(float *)(bytes + 16 + 12 + 16 * i);
-        row_cloud->points.push_back(tem_point);
-    }
-
-    return row_cloud;
-}
-
-pcl::PointCloud<pcl::PointXYZI>::Ptr rslidar2baselink(const pcl::PointCloud<pcl::PointXYZI>::Ptr points)
-{
-    Eigen::Matrix4f transform = Eigen::Matrix4f::Identity();
-    //TODO 90°
-    transform(0, 1) = -1; 
-    transform(1, 0) = 1; 
-    transform(0, 0) = 0; 
-    transform(1, 1) = 0; 
-
-    pcl::PointCloud<pcl::PointXYZI>::Ptr trans_cloud(new pcl::PointCloud<pcl::PointXYZI>());
-    pcl::transformPointCloud(*points, *trans_cloud, transform);
-
-    return trans_cloud;
-}
-
-
-bool run_once(Hdl_Localization& hdl_loc, const char *data, int32_t point_len, void* dora_context, std::ofstream& points_xy, bool use_imu, bool get_imu)
-{
-    auto clouds = bytes2cloud(data, point_len);
-    if (clouds == nullptr)
-    {
-        std::cerr << "Error: Failed to rec point cloud!" << std::endl;
+        return true;
     }
 
-    // pcl::io::savePCDFileASCII("clouds.pcd", *clouds);
-    //***************************过滤天花板********************************
-
-    // pcl::PassThrough<pcl::PointXYZI> pass;
-    // pass.setInputCloud(clouds);
-    // pass.setFilterFieldName("z");
-    // pass.setFilterLimits(-1.0, 2.5);  
-    // pcl::PointCloud<pcl::PointXYZI>::Ptr cloud_filtered(new pcl::PointCloud<pcl::PointXYZI>);
-    // pass.filter(*cloud_filtered);
-
-    //********************************************************************
-
-    double stamp = (double)clouds->header.stamp*1.0*1e-6;
-
-    pcl::PointCloud<pcl::PointXYZI>::Ptr cloud_no_nan(new pcl::PointCloud<pcl::PointXYZI>);
-    std::vector<int> indices;
-    pcl::removeNaNFromPointCloud(*clouds, *cloud_no_nan, indices);
-
-
-
-    auto filtered = hdl_loc.downsample(cloud_no_nan);
-    // pcl::io::savePCDFileASCII("output.pcd", *filtered);
-    auto trans_clouds = rslidar2baselink(filtered);
-    // pcl::io::savePCDFileASCII("trans_clouds.pcd", *trans_clouds);
-
-    hdl_loc.last_scan = trans_clouds;
-
-    if(use_imu)
-    {
-        if(!get_imu)
-        {
-            std::cerr << "imu data is not ready" << std::endl;
-            return false;
-        }
-        else 
-        {
-            auto imu_iter = hdl_loc.imu_data.begin();
-            for (imu_iter; imu_iter != hdl_loc.imu_data.end(); imu_iter++) 
-            {
-                // TODO: check stamp
-                if (imu_iter->stamp > stamp)
-                {
-                    break;
-                }
-                if(imu_iter->stamp + imu_dt < stamp)//获取最近距离雷达点云最近一帧的imu数据
-                {
-                    continue;
-                }
-                const auto& acc = imu_iter->linear_acceleration;
-                const auto& gyro = imu_iter->angular_velocity;
+    // NaN/range rejection, rslidar -> base_link and downsampling in one pass over the wire buffer
+    auto trans_clouds = hdl_loc.preprocessor->process(data, point_len);
+    double stamp = (double)trans_clouds->header.stamp*1.0*1e-6;
+    auto t_preprocess = std::chrono::steady_clock::now();
 
-                if (std::isnan(acc.x) || std::isnan(acc.y) || std::isnan(acc.z) ||
-                    std::isnan(gyro.x) || std::isnan(gyro.y) || std::isnan(gyro.z)) 
-                {
-                    continue;
-                }
-                double acc_sign = 1.0;
-                double gyro_sign = 1.0;
-
-                hdl_loc.pose_estimator->predict(
-                    imu_iter->stamp,
-                    acc_sign * Eigen::Vector3f(acc.x, acc.y, acc.z),
-                    gyro_sign * Eigen::Vector3f(gyro.x, gyro.y, gyro.z)
-                );
-            }
-            hdl_loc.imu_data.erase(hdl_loc.imu_data.begin(),imu_iter);
-        }
-    }
-    else
+    StageTiming timing;
+    timing.preprocess = elapsed_ms(t_begin, t_preprocess);
+    if (!localize_scan(hdl_loc, trans_clouds, stamp, use_imu, get_imu, timing))
     {
-        hdl_loc.pose_estimator->predict(stamp); //不使用imu
+        return false;
     }
-
-    auto aligned = hdl_loc.pose_estimator->correct(stamp, trans_clouds);
     auto cur_pose = hdl_loc.compute_odometry(hdl_loc.pose_estimator->matrix());
-    points_xy << cur_pose.x << " " << cur_pose.y << std::endl;
 
     std::string out_id = "cur_pose";
     canslam::slampose *cur_pose_ptr = &cur_pose;
@@ -206,10 +75,44 @@ bool run_once(Hdl_Localization& hdl_loc, const char *data, int32_t point_len, vo
     {
         std::cerr << "failed to send output" << std::endl;
     }
+
+    hdl_localization::PoseRecord record;
+    record.stamp = stamp;
+    record.seq = trans_clouds->header.seq;
+    record.num_points = trans_clouds->size();
+    Eigen::Vector3f pos = hdl_loc.pose_estimator->pos();
+    Eigen::Quaternionf quat = hdl_loc.pose_estimator->quat();
+    Eigen::MatrixXf cov = hdl_loc.pose_estimator->pose_cov();
+    std::copy(pos.data(), pos.data() + 3, record.pos);
+    record.quat[0] = quat.w();
+    record.quat[1] = quat.x();
+    record.quat[2] = quat.y();
+    record.quat[3] = quat.z();
+    for (int i = 0, k = 0; i < 7; i++)
+    {
+        for (int j = i; j < 7; j++)
+        {
+            record.cov[k++] = cov(i, j);
+        }
+    }
+    int iterations;
+    hdl_loc.registration_stats(record.fitness, iterations);
+    record.iterations = iterations;
+    record.t_preprocess = timing.preprocess;
+    record.t_predict = timing.predict;
+    record.t_correct = timing.correct;
+    record.t_total = elapsed_ms(t_begin, std::chrono::steady_clock::now());
+    record.flags = use_imu ? hdl_localization::PoseRecord::USE_IMU : 0;
+    if (hdl_loc.last_odom_stamp > 0.0)
+    {
+        record.flags |= hdl_localization::PoseRecord::USE_ODOM;
+    }
+    pose_logger.push(record);
+
     return true;
 }
 
-int run(void *dora_context, Hdl_Localization& hdl_loc, std::ofstream& points_xy, bool use_imu)
+int run(void *dora_context, Hdl_Localization& hdl_loc, hdl_localization::PoseLogger& pose_logger, bool use_imu, bool use_odom)
 {
     bool get_imu = false;
     while (true)
@@ -247,7 +150,7 @@ int run(void *dora_context, Hdl_Localization& hdl_loc, std::ofstream& points_xy,
 
                 //--------------------------------------------------------------------------------------------------------------
 
-                bool once_slam = run_once(hdl_loc, data, point_len, dora_context, points_xy, use_imu, get_imu);
+                bool once_slam = run_once(hdl_loc, data, point_len, dora_context, pose_logger, use_imu, get_imu);
                 if(!once_slam)
                 {
                     std::cerr << "failed to run slam once" << std::endl;
@@ -262,6 +165,12 @@ int run(void *dora_context, Hdl_Localization& hdl_loc, std::ofstream& points_xy,
                 hdl_loc.imu_data.push_back(*imu_msg);
                 get_imu = true;
             }
+            if (use_odom && strncmp("wheel_odom", data_id, 10) == 0 && data_len >= sizeof(canslam::wheel_odom_h))
+            {
+                // drive the odometry prediction at wheel-encoder rate, correct() fuses it into the NDT guess
+                const canslam::wheel_odom_h *wheel_odom = reinterpret_cast<const canslam::wheel_odom_h *>(data);
+                hdl_loc.predict_wheel_odom(*wheel_odom);
+            }
 
         }
 
@@ -297,6 +206,13 @@ int main()
     }
     else std::cout << "do not use imu!!!" << std::endl;
 
+    const char* use_odom_env = std::getenv("use_odom");
+    bool use_odom = (use_odom_env && std::string(use_odom_env) == "1");
+    if(use_odom)
+    {
+        std::cout << "use wheel odom!!!" << std::endl;
+    }
+
     
     const char *env_pcd_path = getenv("MAP_PCD");
     std::string map_pcd_path;
@@ -323,8 +239,15 @@ int main()
         std::cout << "way_points path is : " << map_pcd_path << std::endl;
     }
 
-    std::ofstream points_xy(way_points_path, std::ios::trunc);
-    if (!points_xy) 
+    // binary pose log, rotated as pose_log.bin, pose_log.bin.1, ... ; convert with pose_log_to_csv
+    const char *env_pose_log = getenv("pose_log");
+    std::string pose_log_path = env_pose_log ? env_pose_log : "./data/path/pose_log.bin";
+    size_t pose_log_max_mb = std::getenv("pose_log_max_mb") ? std::stoul(std::getenv("pose_log_max_mb")) : 64;
+    int pose_log_files = std::getenv("pose_log_files") ? std::stoi(std::getenv("pose_log_files")) : 4;
+    std::cout << "pose_log path is : " << pose_log_path << std::endl;
+
+    hdl_localization::PoseLogger pose_logger(pose_log_path, way_points_path, 4096, pose_log_max_mb << 20, pose_log_files);
+    if (!pose_logger.start())
     {
         std::cerr << "Fail to open the file!!" << std::endl;
         return -1;
@@ -344,9 +267,13 @@ int main()
     hdl_loc.registration->setInputTarget(pcd_map);
 
     // std::this_thread::sleep_for(std::chrono::seconds(5));   
-    int ret = run(dora_context, hdl_loc, points_xy, use_imu);
+    int ret = run(dora_context, hdl_loc, pose_logger, use_imu, use_odom);
     
-    points_xy.close();
+    pose_logger.stop();
+    if (pose_logger.dropped() > 0)
+    {
+        std::cerr << "pose_logger dropped " << pose_logger.dropped() << " records" << std::endl;
+    }
     free_dora_context(dora_context);
     std::cout << "END hdl_slam_localization" << std::endl;
 
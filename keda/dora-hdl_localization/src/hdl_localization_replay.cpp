@@ -0,0 +1,272 @@
+// offline replay of a recorded sequence through the hdl_localization pipeline, without dora
+//
+// usage: hdl_localization_replay map.pcd sequence_dir [ground_truth.txt]
+//
+// sequence_dir
+//   *.bin            lidar frames in the dora wire format (see ScanPreprocessor::process)
+//   *.pcd            lidar frames, the file name is the stamp in seconds (e.g. 1700000000.100000.pcd)
+//   imu.txt          optional, "stamp ax ay az gx gy gz" per line
+//   wheel_odom.txt   optional, "stamp vx vy wz" per line
+// ground_truth.txt   optional, TUM format "stamp x y z qx qy qz qw", matched to the nearest scan stamp
+//
+// the same envs as the dora node are used (map_downsample_resolution, point_downsample_resolution, use_imu, use_odom, reg_method),
+// estimated poses are written in TUM format to $replay_output (default ./replay_poses.txt)
+
+#include <dirent.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "hdl_localization.hpp"
+#include "localization_pipeline.hpp"
+
+struct Frame
+{
+    std::string path;
+    double stamp;
+};
+
+static bool ends_with(const std::string& str, const std::string& suffix)
+{
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static std::vector<Frame> list_frames(const std::string& dir)
+{
+    std::vector<Frame> frames;
+    DIR* dp = opendir(dir.c_str());
+    if (dp == nullptr)
+    {
+        return frames;
+    }
+    for (struct dirent* entry = readdir(dp); entry != nullptr; entry = readdir(dp))
+    {
+        std::string name = entry->d_name;
+        if (!ends_with(name, ".bin") && !ends_with(name, ".pcd"))
+        {
+            continue;
+        }
+        Frame frame;
+        frame.path = dir + "/" + name;
+        frame.stamp = ends_with(name, ".pcd") ? std::atof(name.substr(0, name.size() - 4).c_str()) : 0.0;
+        frames.push_back(frame);
+    }
+    closedir(dp);
+
+    std::sort(frames.begin(), frames.end(), [](const Frame& a, const Frame& b) { return a.path < b.path; });
+    return frames;
+}
+
+// raw frame as received by the node, either the wire buffer or a loaded pcd
+struct RawFrame
+{
+    std::vector<char> bytes;
+    pcl::PointCloud<pcl::PointXYZI> cloud;
+};
+
+static bool load_frame(const Frame& frame, RawFrame& raw)
+{
+    if (ends_with(frame.path, ".pcd"))
+    {
+        return pcl::io::loadPCDFile(frame.path, raw.cloud) != -1;
+    }
+
+    std::ifstream ifs(frame.path, std::ios::binary);
+    raw.bytes.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    return raw.bytes.size() > 16;
+}
+
+static pcl::PointCloud<pcl::PointXYZI>::Ptr preprocess_frame(Hdl_Localization& hdl_loc, Frame& frame, const RawFrame& raw)
+{
+    if (raw.bytes.empty())
+    {
+        return hdl_loc.preprocessor->process(raw.cloud);
+    }
+
+    auto cloud = hdl_loc.preprocessor->process(raw.bytes.data(), (raw.bytes.size() - 16) / 16);
+    frame.stamp = (double)cloud->header.stamp * 1e-6;
+    return cloud;
+}
+
+static std::vector<std::vector<double>> load_table(const std::string& path, size_t columns)
+{
+    std::vector<std::vector<double>> rows;
+    std::ifstream ifs(path);
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream iss(line);
+        std::vector<double> row(columns);
+        size_t i = 0;
+        for (; i < columns && (iss >> row[i]); i++);
+        if (i == columns)
+        {
+            rows.push_back(row);
+        }
+    }
+    return rows;
+}
+
+static void print_stats(const std::string& name, std::vector<float> values)
+{
+    if (values.empty())
+    {
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (float v : values)
+    {
+        sum += v;
+    }
+    std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(3)
+              << " mean " << std::setw(9) << sum / values.size()
+              << " p50 " << std::setw(9) << values[values.size() / 2]
+              << " p95 " << std::setw(9) << values[std::min(values.size() - 1, values.size() * 95 / 100)]
+              << " max " << std::setw(9) << values.back() << " [ms]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: " << argv[0] << " map.pcd sequence_dir [ground_truth.txt]" << std::endl;
+        return 1;
+    }
+    const std::string map_pcd_path = argv[1];
+    const std::string sequence_dir = argv[2];
+
+    double map_downsample_resolution = std::getenv("map_downsample_resolution") ? std::stod(std::getenv("map_downsample_resolution")) : 0.1;
+    double point_downsample_resolution = std::getenv("point_downsample_resolution") ? std::stod(std::getenv("point_downsample_resolution")) : 0.1;
+    bool use_imu = std::getenv("use_imu") && std::string(std::getenv("use_imu")) == "1";
+    bool use_odom = std::getenv("use_odom") && std::string(std::getenv("use_odom")) == "1";
+    std::string output_path = std::getenv("replay_output") ? std::getenv("replay_output") : "./replay_poses.txt";
+
+    std::vector<Frame> frames = list_frames(sequence_dir);
+    if (frames.empty())
+    {
+        std::cerr << "[ERROR] No frames in: " << sequence_dir << std::endl;
+        return 1;
+    }
+    auto imu_rows = use_imu ? load_table(sequence_dir + "/imu.txt", 7) : std::vector<std::vector<double>>();
+    auto odom_rows = use_odom ? load_table(sequence_dir + "/wheel_odom.txt", 4) : std::vector<std::vector<double>>();
+    auto gt_rows = argc > 3 ? load_table(argv[3], 4) : std::vector<std::vector<double>>();
+    std::cout << frames.size() << " frames, " << imu_rows.size() << " imu, " << odom_rows.size() << " wheel odom, " << gt_rows.size() << " ground truth" << std::endl;
+
+    Hdl_Localization hdl_loc;
+    pcl::PointCloud<pcl::PointXYZI>::Ptr pcd_map = init_map(map_downsample_resolution, map_pcd_path);
+    if (pcd_map == nullptr || !hdl_loc.init_param(point_downsample_resolution))
+    {
+        std::cerr << "Fail to init hdl_loc!!! " << std::endl;
+        return 1;
+    }
+    auto t_map = std::chrono::steady_clock::now();
+    hdl_loc.registration->setInputTarget(pcd_map);
+    std::cout << "setInputTarget: " << elapsed_ms(t_map, std::chrono::steady_clock::now()) << " [ms]" << std::endl;
+
+    std::ofstream ofs(output_path);
+    ofs << std::fixed << std::setprecision(6);
+
+    std::vector<float> t_load, t_preprocess, t_predict, t_correct, t_total;
+    std::vector<double> errors;
+    size_t imu_index = 0;
+    size_t odom_index = 0;
+    size_t gt_index = 0;
+
+    for (auto& frame : frames)
+    {
+        auto t_begin = std::chrono::steady_clock::now();
+        RawFrame raw;
+        if (!load_frame(frame, raw))
+        {
+            std::cerr << "[ERROR] Could not read file: " << frame.path << std::endl;
+            continue;
+        }
+        auto t_loaded = std::chrono::steady_clock::now();
+
+        StageTiming timing;
+        auto cloud = preprocess_frame(hdl_loc, frame, raw);
+        timing.preprocess = elapsed_ms(t_loaded, std::chrono::steady_clock::now());
+
+        // deliver the sensor samples that would have arrived before this scan
+        for (; imu_index < imu_rows.size() && imu_rows[imu_index][0] <= frame.stamp; imu_index++)
+        {
+            const auto& row = imu_rows[imu_index];
+            canslam::imu_msg_h imu;
+            imu.stamp = row[0];
+            imu.linear_acceleration = {(float)row[1], (float)row[2], (float)row[3]};
+            imu.angular_velocity = {(float)row[4], (float)row[5], (float)row[6]};
+            hdl_loc.imu_data.push_back(imu);
+        }
+        for (; odom_index < odom_rows.size() && odom_rows[odom_index][0] <= frame.stamp; odom_index++)
+        {
+            const auto& row = odom_rows[odom_index];
+            canslam::wheel_odom_h odom;
+            odom.stamp = row[0];
+            odom.seq = odom_index;
+            odom.vx = row[1];
+            odom.vy = row[2];
+            odom.wz = row[3];
+            hdl_loc.predict_wheel_odom(odom);
+        }
+
+        if (!localize_scan(hdl_loc, cloud, frame.stamp, use_imu, imu_index > 0, timing))
+        {
+            continue;
+        }
+        auto t_end = std::chrono::steady_clock::now();
+
+        t_load.push_back(elapsed_ms(t_begin, t_loaded));
+        t_preprocess.push_back(timing.preprocess);
+        t_predict.push_back(timing.predict);
+        t_correct.push_back(timing.correct);
+        t_total.push_back(elapsed_ms(t_loaded, t_end));
+
+        Eigen::Vector3f pos = hdl_loc.pose_estimator->pos();
+        Eigen::Quaternionf quat = hdl_loc.pose_estimator->quat();
+        ofs << frame.stamp << " " << pos.x() << " " << pos.y() << " " << pos.z() << " "
+            << quat.x() << " " << quat.y() << " " << quat.z() << " " << quat.w() << "\n";
+
+        if (!gt_rows.empty())
+        {
+            while (gt_index + 1 < gt_rows.size() && std::abs(gt_rows[gt_index + 1][0] - frame.stamp) <= std::abs(gt_rows[gt_index][0] - frame.stamp))
+            {
+                gt_index++;
+            }
+            const auto& gt = gt_rows[gt_index];
+            if (std::abs(gt[0] - frame.stamp) < 0.05)
+            {
+                errors.push_back((pos.cast<double>() - Eigen::Vector3d(gt[1], gt[2], gt[3])).norm());
+            }
+        }
+    }
+
+    std::cout << t_total.size() << " frames localized, poses written to " << output_path << std::endl;
+    print_stats("load", t_load);
+    print_stats("preprocess", t_preprocess);
+    print_stats("predict", t_predict);
+    print_stats("correct", t_correct);
+    print_stats("total", t_total);
+
+    if (!errors.empty())
+    {
+        double sq_sum = 0.0;
+        for (double e : errors)
+        {
+            sq_sum += e * e;
+        }
+        std::cout << "translation error (" << errors.size() << " matched) rmse " << std::sqrt(sq_sum / errors.size())
+                  << " max " << *std::max_element(errors.begin(), errors.end()) << " [m]" << std::endl;
+    }
+
+    return 0;
+}
@@ -120,8 +120,10 @@ void PoseEstimator::predict(const double& stamp, const Eigen::Vector3f& acc, con
 
 /**
  * @brief update the state of the odomety-based pose estimation
+ * @param odom_delta  relative motion since the previous call
+ * @param dt          time span of odom_delta [sec]
  */
-void PoseEstimator::predict_odom(const Eigen::Matrix4f& odom_delta) {
+void PoseEstimator::predict_odom(const Eigen::Matrix4f& odom_delta, double dt) {
   if(!odom_ukf) {
     Eigen::MatrixXf odom_process_noise = Eigen::MatrixXf::Identity(7, 7);
     Eigen::MatrixXf odom_measurement_noise = Eigen::MatrixXf::Identity(7, 7) * 1e-3;
@@ -145,9 +147,12 @@ void PoseEstimator::predict_odom(const Eigen::Matrix4f& odom_delta) {
   control.middleRows(0, 3) = odom_delta.block<3, 1>(0, 3);
   control.middleRows(3, 4) = Eigen::Vector4f(quat.w(), quat.x(), quat.y(), quat.z());
 
+  // the noise floor is given per second so that the accumulated uncertainty does not depend on the odometry rate
+  // (1e-3 per call at the 50Hz chassis tick)
+  const float noise_floor = 0.05f * dt;
   Eigen::MatrixXf process_noise = Eigen::MatrixXf::Identity(7, 7);
-  process_noise.topLeftCorner(3, 3) = Eigen::Matrix3f::Identity() * odom_delta.block<3, 1>(0, 3).norm() + Eigen::Matrix3f::Identity() * 1e-3;
-  process_noise.bottomRightCorner(4, 4) = Eigen::Matrix4f::Identity() * (1 - std::abs(quat.w())) + Eigen::Matrix4f::Identity() * 1e-3;
+  process_noise.topLeftCorner(3, 3) = Eigen::Matrix3f::Identity() * odom_delta.block<3, 1>(0, 3).norm() + Eigen::Matrix3f::Identity() * noise_floor;
+  process_noise.bottomRightCorner(4, 4) = Eigen::Matrix4f::Identity() * (1 - std::abs(quat.w())) + Eigen::Matrix4f::Identity() * noise_floor;
 
   odom_ukf->setProcessNoiseCov(process_noise);
   odom_ukf->predict(control);
@@ -267,6 +272,15 @@ Eigen::Matrix4f PoseEstimator::matrix() const {
   return m;
 }
 
+Eigen::MatrixXf PoseEstimator::pose_cov() const {
+  Eigen::MatrixXf cov(7, 7);
+  cov.block<3, 3>(0, 0) = ukf->cov.block<3, 3>(0, 0);
+  cov.block<3, 4>(0, 3) = ukf->cov.block<3, 4>(0, 6);
+  cov.block<4, 3>(3, 0) = ukf->cov.block<4, 3>(6, 0);
+  cov.block<4, 4>(3, 3) = ukf->cov.block<4, 4>(6, 6);
+  return cov;
+}
+
 Eigen::Vector3f PoseEstimator::odom_pos() const {
   return Eigen::Vector3f(odom_ukf->mean[0], odom_ukf->mean[1], odom_ukf->mean[2]);
 }
@@ -0,0 +1,72 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "pose_logger.hpp"
+
+// convert binary pose logs written by hdl_localization (PoseLogger) into csv
+// usage: pose_log_to_csv output.csv pose_log.bin.3 pose_log.bin.2 pose_log.bin.1 pose_log.bin
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: " << argv[0] << " output.csv pose_log.bin [pose_log.bin ...]" << std::endl;
+        return 1;
+    }
+
+    std::FILE* out = std::fopen(argv[1], "w");
+    if (!out)
+    {
+        std::cerr << "[ERROR] Could not open file: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::fprintf(out, "seq,stamp,x,y,z,qw,qx,qy,qz");
+    for (int i = 0; i < 7; i++)
+    {
+        for (int j = i; j < 7; j++)
+        {
+            std::fprintf(out, ",cov_%d_%d", i, j);
+        }
+    }
+    std::fprintf(out, ",fitness,iterations,num_points,t_preprocess_ms,t_predict_ms,t_correct_ms,t_total_ms,flags\n");
+
+    size_t num_records = 0;
+    for (int arg = 2; arg < argc; arg++)
+    {
+        std::FILE* in = std::fopen(argv[arg], "rb");
+        if (!in)
+        {
+            std::cerr << "[ERROR] Could not read file: " << argv[arg] << std::endl;
+            continue;
+        }
+
+        hdl_localization::PoseLogHeader header;
+        if (std::fread(&header, sizeof(header), 1, in) != 1 || !header.valid())
+        {
+            std::cerr << "[ERROR] Not a pose log: " << argv[arg] << std::endl;
+            std::fclose(in);
+            continue;
+        }
+
+        hdl_localization::PoseRecord r;
+        while (std::fread(&r, sizeof(r), 1, in) == 1)
+        {
+            std::fprintf(out, "%u,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f", r.seq, r.stamp,
+                         r.pos[0], r.pos[1], r.pos[2], r.quat[0], r.quat[1], r.quat[2], r.quat[3]);
+            for (int i = 0; i < 28; i++)
+            {
+                std::fprintf(out, ",%g", r.cov[i]);
+            }
+            std::fprintf(out, ",%g,%d,%u,%.3f,%.3f,%.3f,%.3f,%u\n", r.fitness, r.iterations, r.num_points,
+                         r.t_preprocess, r.t_predict, r.t_correct, r.t_total, r.flags);
+            num_records++;
+        }
+        std::fclose(in);
+    }
+
+    std::fclose(out);
+    std::cout << num_records << " records written to " << argv[1] << std::endl;
+    return 0;
+}
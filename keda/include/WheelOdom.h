@@ -0,0 +1,16 @@
+#ifndef WHEELODOM_H
+#define WHEELODOM_H
+
+#include <cstdint>
+
+// wheel odometry decoded from the chassis state frame (body frame, base_link)
+struct WheelOdom_h
+{
+    double stamp;       // s
+    uint32_t seq;
+    float vx;           // m/s
+    float vy;           // m/s
+    float wz;           // rad/s
+};
+
+#endif
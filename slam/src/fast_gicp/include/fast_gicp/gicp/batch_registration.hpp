@@ -0,0 +1,124 @@
+#ifndef FAST_GICP_BATCH_REGISTRATION_HPP
+#define FAST_GICP_BATCH_REGISTRATION_HPP
+
+#include <vector>
+#include <cassert>
+#include <memory>
+#include <functional>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <pcl/point_cloud.h>
+
+namespace fast_gicp {
+
+/**
+ * @brief Aligns many source clouds against one shared target concurrently
+ *        The target structures (kd-tree, covariances, voxel map) are built once and shared by one registration per thread.
+ *        Each source/guess pair is aligned by a single thread, so small alignments scale with the number of cores
+ *        instead of being bound by the OpenMP overhead inside each alignment.
+ *
+ * @tparam Registration  FastGICP, FastGICPSingleThread or FastVGICP
+ */
+template<typename Registration>
+class BatchRegistration {
+public:
+  using PointCloudSource = typename Registration::PointCloudSource;
+  using PointCloudSourceConstPtr = typename Registration::PointCloudSourceConstPtr;
+  using PointCloudTargetConstPtr = typename Registration::PointCloudTargetConstPtr;
+
+  struct Result {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    bool converged;
+    double fitness_score;
+    Eigen::Matrix4f transformation;
+    Eigen::Matrix<double, 6, 6> hessian;
+  };
+  using Results = std::vector<Result, Eigen::aligned_allocator<Result>>;
+
+  /**
+   * @brief constructor
+   * @param num_threads  number of concurrent alignments (0 = omp_get_max_threads())
+   * @param configure    called once for each registration to set its parameters (resolution, epsilons, ...)
+   */
+  BatchRegistration(int num_threads = 0, const std::function<void(Registration&)>& configure = nullptr) {
+#ifdef _OPENMP
+    num_threads_ = num_threads > 0 ? num_threads : omp_get_max_threads();
+#else
+    num_threads_ = 1;
+#endif
+
+    registrations_.resize(num_threads_);
+    for (auto& reg : registrations_) {
+      reg.reset(new Registration());
+      if (configure) {
+        configure(*reg);
+      }
+      // parallelism comes from aligning the pairs concurrently
+      reg->setNumThreads(1);
+    }
+  }
+
+  /**
+   * @brief set the target and build its structures once
+   */
+  void setInputTarget(const PointCloudTargetConstPtr& cloud) {
+    registrations_[0]->setNumThreads(num_threads_);
+    registrations_[0]->setInputTarget(cloud);
+    registrations_[0]->prepareTarget();
+    registrations_[0]->setNumThreads(1);
+
+    for (int i = 1; i < registrations_.size(); i++) {
+      registrations_[i]->shareTarget(*registrations_[0]);
+    }
+  }
+
+  /**
+   * @brief align sources[i] with the initial guess guesses[i] against the target
+   */
+  Results align(const std::vector<PointCloudSourceConstPtr>& sources, const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& guesses) {
+    assert(sources.size() == guesses.size());
+    Results results(sources.size());
+
+#pragma omp parallel for num_threads(num_threads_) schedule(dynamic, 1)
+    for (int i = 0; i < sources.size(); i++) {
+#ifdef _OPENMP
+      auto& reg = registrations_[omp_get_thread_num()];
+#else
+      auto& reg = registrations_[0];
+#endif
+
+      PointCloudSource aligned;
+      reg->setInputSource(sources[i]);
+      reg->align(aligned, guesses[i]);
+
+      results[i].converged = reg->hasConverged();
+      results[i].fitness_score = reg->getFitnessScore();
+      results[i].transformation = reg->getFinalTransformation();
+      results[i].hessian = reg->getFinalHessian();
+    }
+
+    return results;
+  }
+
+  /**
+   * @brief align one source with several initial guesses (e.g., multi-hypothesis relocalization)
+   */
+  Results align(const PointCloudSourceConstPtr& source, const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& guesses) {
+    return align(std::vector<PointCloudSourceConstPtr>(guesses.size(), source), guesses);
+  }
+
+  int numThreads() const {
+    return num_threads_;
+  }
+
+private:
+  int num_threads_;
+  std::vector<std::shared_ptr<Registration>> registrations_;
+};
+
+}  // namespace fast_gicp
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef FAST_GICP_EXECUTOR_HPP
+#define FAST_GICP_EXECUTOR_HPP
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include <Eigen/Core>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace fast_gicp {
+
+/**
+ * @brief Task execution backend of the parallel loops of registrations
+ *        An executor can be shared by registrations running concurrently (e.g., odometry, localization and loop detection in one process)
+ *        so that they do not oversubscribe the cores with their own thread teams.
+ */
+class Executor {
+public:
+  virtual ~Executor() {}
+
+  virtual int num_threads() const = 0;
+
+  /**
+   * @brief call task(chunk) for every chunk in [0, num_chunks) and block until all of them are done
+   *        chunks may run concurrently and in any order
+   */
+  virtual void run(int num_chunks, const std::function<void(int)>& task) = 0;
+};
+
+/**
+ * @brief Runs all chunks on the calling thread
+ */
+class SequentialExecutor : public Executor {
+public:
+  virtual int num_threads() const override { return 1; }
+
+  virtual void run(int num_chunks, const std::function<void(int)>& task) override {
+    for (int i = 0; i < num_chunks; i++) {
+      task(i);
+    }
+  }
+};
+
+/**
+ * @brief Runs the chunks in an OpenMP parallel region (the previous behavior of registrations)
+ */
+class OpenMPExecutor : public Executor {
+public:
+  /**
+   * @param num_threads  number of threads (0 = omp_get_max_threads())
+   */
+  explicit OpenMPExecutor(int num_threads = 0) {
+#ifdef _OPENMP
+    num_threads_ = num_threads > 0 ? num_threads : omp_get_max_threads();
+#else
+    num_threads_ = 1;
+#endif
+  }
+
+  virtual int num_threads() const override { return num_threads_; }
+
+  virtual void run(int num_chunks, const std::function<void(int)>& task) override {
+    if (num_threads_ == 1 || num_chunks <= 1) {
+      for (int i = 0; i < num_chunks; i++) {
+        task(i);
+      }
+      return;
+    }
+
+#pragma omp parallel for num_threads(num_threads_) schedule(dynamic, 1)
+    for (int i = 0; i < num_chunks; i++) {
+      task(i);
+    }
+  }
+
+private:
+  int num_threads_;
+};
+
+/**
+ * @brief Persistent worker threads shared by all the registrations using this executor
+ *        Jobs of concurrent callers are served in the submission order, and a caller works on its own job while it waits,
+ *        so a job always progresses even if all the workers are busy.
+ */
+class ThreadPoolExecutor : public Executor {
+public:
+  /**
+   * @param num_threads  number of threads including the calling thread (0 = std::thread::hardware_concurrency())
+   */
+  explicit ThreadPoolExecutor(int num_threads = 0) : stop_(false) {
+    if (num_threads <= 0) {
+      num_threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+    }
+
+    for (int i = 0; i < num_threads - 1; i++) {
+      workers_.emplace_back([this] { worker_loop(); });
+    }
+  }
+
+  virtual ~ThreadPoolExecutor() override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    job_cond_.notify_all();
+
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  ThreadPoolExecutor(const ThreadPoolExecutor&) = delete;
+  ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+
+  virtual int num_threads() const override { return workers_.size() + 1; }
+
+  virtual void run(int num_chunks, const std::function<void(int)>& task) override {
+    if (workers_.empty() || num_chunks <= 1) {
+      for (int i = 0; i < num_chunks; i++) {
+        task(i);
+      }
+      return;
+    }
+
+    Job job{&task, num_chunks, 0, 0};
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobs_.push_back(&job);
+    job_cond_.notify_all();
+
+    while (job.next_chunk < job.num_chunks) {
+      const int chunk = claim(&job);
+      lock.unlock();
+      task(chunk);
+      lock.lock();
+      job.num_done++;
+    }
+
+    done_cond_.wait(lock, [&job] { return job.num_done == job.num_chunks; });
+  }
+
+private:
+  struct Job {
+    const std::function<void(int)>* task;
+    int num_chunks;
+    int next_chunk;  // guarded by mutex_
+    int num_done;    // guarded by mutex_
+  };
+
+  // take the next chunk of the job, the job leaves the queue once all of its chunks are taken (mutex_ must be held)
+  int claim(Job* job) {
+    const int chunk = job->next_chunk++;
+    if (job->next_chunk == job->num_chunks) {
+      jobs_.erase(std::find(jobs_.begin(), jobs_.end(), job));
+    }
+    return chunk;
+  }
+
+  void worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      job_cond_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+      if (stop_) {
+        return;
+      }
+
+      Job* job = jobs_.front();
+      const int chunk = claim(job);
+      lock.unlock();
+      (*job->task)(chunk);
+      lock.lock();
+
+      if (++job->num_done == job->num_chunks) {
+        done_cond_.notify_all();
+      }
+    }
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable job_cond_;
+  std::condition_variable done_cond_;
+  std::deque<Job*> jobs_;  // jobs with chunks not taken yet
+  bool stop_;
+  std::vector<std::thread> workers_;
+};
+
+/**
+ * @brief f(begin, end) for the chunks of [0, n)
+ */
+template<typename Func>
+void parallel_for(Executor& executor, int n, int chunk_size, const Func& f) {
+  const int num_chunks = (n + chunk_size - 1) / chunk_size;
+  executor.run(num_chunks, [&](int chunk) {
+    const int begin = chunk * chunk_size;
+    f(begin, std::min(begin + chunk_size, n));
+  });
+}
+
+/**
+ * @brief reduce the results of f(begin, end) for the chunks of [0, n)
+ *        The chunk boundaries depend only on n and chunk_size and the chunk results are reduced in the chunk order,
+ *        so the result is bitwise identical for any executor and number of threads.
+ */
+template<typename T, typename Func, typename Reduce>
+T parallel_reduce(Executor& executor, int n, int chunk_size, const T& identity, const Func& f, const Reduce& reduce) {
+  const int num_chunks = (n + chunk_size - 1) / chunk_size;
+
+  std::vector<T, Eigen::aligned_allocator<T>> partials(num_chunks, identity);
+  executor.run(num_chunks, [&](int chunk) {
+    const int begin = chunk * chunk_size;
+    partials[chunk] = f(begin, std::min(begin + chunk_size, n));
+  });
+
+  T result = identity;
+  for (const auto& partial : partials) {
+    result = reduce(result, partial);
+  }
+  return result;
+}
+
+}  // namespace fast_gicp
+
+#endif
@@ -6,10 +6,13 @@
 
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
-#include <pcl/search/kdtree.h>
 #include <pcl/registration/registration.h>
+#include <fast_gicp/gicp/executor.hpp>
 #include <fast_gicp/gicp/lsq_registration.hpp>
 #include <fast_gicp/gicp/gicp_settings.hpp>
+#include <fast_gicp/gicp/packed_covariance.hpp>
+#include <fast_gicp/gicp/nearest_neighbor_search.hpp>
+#include <fast_gicp/gicp/target_model.hpp>
 
 namespace fast_gicp {
 
@@ -49,8 +52,26 @@ public:
   virtual ~FastGICP() override;
 
   void setNumThreads(int n);
+
+  /**
+   * @brief run the parallel loops on the given executor instead of an OpenMP team of setNumThreads() threads
+   *        the executor can be shared by registrations running concurrently
+   */
+  void setExecutor(const std::shared_ptr<Executor>& executor);
   void setCorrespondenceRandomness(int k);
   void setRegularizationMethod(RegularizationMethod method);
+  void setComputePrecision(ComputePrecision precision);
+  void setNearestNeighborMethod(NearestNeighborMethod method);
+
+  /**
+   * @brief skip the kNN search of a linearization while the pose has moved less than the thresholds since the last search
+   *        The Mahalanobis matrices of the reused correspondences are recomputed unless the rotation since their last update
+   *        is also below mahalanobis_rotation_threshold. Zero thresholds (default) search on every linearization.
+   * @param translation_threshold           [m]
+   * @param rotation_threshold              [rad]
+   * @param mahalanobis_rotation_threshold  [rad]
+   */
+  void setCorrespondenceUpdateThresholds(double translation_threshold, double rotation_threshold, double mahalanobis_rotation_threshold = 0.0);
 
   virtual void swapSourceAndTarget() override;
   virtual void clearSource() override;
@@ -61,42 +82,104 @@ public:
   virtual void setInputTarget(const PointCloudTargetConstPtr& cloud) override;
   virtual void setTargetCovariances(const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs);
 
+  /**
+   * @brief build the target structures (covariances, and the voxel map for VGICP) now instead of in the first align()
+   */
+  virtual void prepareTarget();
+
+  /**
+   * @brief use the target cloud, kd-trees and covariances of another registration without rebuilding them
+   *        the shared structures are only read during alignment, so registrations sharing a target can run concurrently
+   */
+  virtual void shareTarget(const FastGICP& other);
+
+  /**
+   * @brief save the target (points, covariances, covariance estimation parameters, and the voxel map for VGICP) to a binary file
+   *        the target structures are built first if needed. Only xyz of the target points is stored.
+   */
+  bool saveTargetModel(const std::string& filename);
+
+  /**
+   * @brief load a target saved with saveTargetModel() instead of setInputTarget() (no covariance estimation or voxel map creation)
+   *        the file is memory mapped and validated by its content hash.
+   *        The covariance estimation parameters of the file (k, regularization, nearest neighbor method) are applied to this registration.
+   */
+  bool loadTargetModel(const std::string& filename);
+
   const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& getSourceCovariances() const {
-    return source_covs_;
+    return *source_covs_;
   }
 
   const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& getTargetCovariances() const {
-    return target_covs_;
+    return *target_covs_;
+  }
+
+  /**
+   * @brief how the correspondences were updated in each linearization of the last alignment (same order as getIterationStats())
+   */
+  const std::vector<CorrespondenceUpdate>& getCorrespondenceUpdates() const {
+    return correspondence_updates_;
   }
 
 protected:
   virtual void computeTransformation(PointCloudSource& output, const Matrix4& guess) override;
 
+  virtual bool write_target_model(TargetModelWriter& writer);
+  virtual bool read_target_model(TargetModelReader& reader, TargetModelFormat::Section section, std::uint64_t payload_size);
+
   virtual void update_correspondences(const Eigen::Isometry3d& trans);
 
+  CorrespondenceUpdate select_correspondence_update(const Eigen::Isometry3d& trans);
+
   virtual double linearize(const Eigen::Isometry3d& trans, Eigen::Matrix<double, 6, 6>* H, Eigen::Matrix<double, 6, 1>* b) override;
 
   virtual double compute_error(const Eigen::Isometry3d& trans) override;
 
+  void update_correspondences_float(const Eigen::Isometry3d& trans);
+
+  double linearize_float(const Eigen::Isometry3d& trans, Eigen::Matrix<double, 6, 6>* H, Eigen::Matrix<double, 6, 1>* b);
+
   template<typename PointT>
-  bool calculate_covariances(const typename pcl::PointCloud<PointT>::ConstPtr& cloud, pcl::search::KdTree<PointT>& kdtree, std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covariances);
+  bool calculate_covariances(const typename pcl::PointCloud<PointT>::ConstPtr& cloud, NearestNeighborSearch<PointT>& kdtree, std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covariances);
+
+  // estimate (and pack for ComputePrecision::FLOAT) the covariances that are not up to date
+  void update_source_covariances();
+  void update_target_covariances();
 
 protected:
   int num_threads_;
+  std::shared_ptr<Executor> executor_;
   int k_correspondences_;
 
   RegularizationMethod regularization_method_;
+  ComputePrecision precision_;
+  NearestNeighborMethod nn_method_;
 
-  std::shared_ptr<pcl::search::KdTree<PointSource>> source_kdtree_;
-  std::shared_ptr<pcl::search::KdTree<PointTarget>> target_kdtree_;
+  std::shared_ptr<NearestNeighborSearch<PointSource>> source_kdtree_;
+  std::shared_ptr<NearestNeighborSearch<PointTarget>> target_kdtree_;
 
-  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> source_covs_;
-  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> target_covs_;
+  // covariances are shared by shareTarget() like the kd-trees, so they are replaced and never modified in place
+  std::shared_ptr<const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>> source_covs_;
+  std::shared_ptr<const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>> target_covs_;
 
   std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> mahalanobis_;
 
   std::vector<int> correspondences_;
   std::vector<float> sq_distances_;
+
+  // lazy correspondence update (setCorrespondenceUpdateThresholds)
+  double update_translation_threshold_;
+  double update_rotation_threshold_;
+  double mahalanobis_rotation_threshold_;
+  bool correspondences_valid_;           // false forces a kNN search in the next update
+  Eigen::Isometry3d knn_trans_;          // pose of the last kNN search
+  Eigen::Isometry3d mahalanobis_trans_;  // pose of the last Mahalanobis matrix update
+  std::vector<CorrespondenceUpdate> correspondence_updates_;
+
+  // single precision path (ComputePrecision::FLOAT)
+  std::shared_ptr<const PackedCov3fVector> source_covs_f_;
+  std::shared_ptr<const PackedCov3fVector> target_covs_f_;
+  PackedCov3fVector mahalanobis_f_;
 };
 }  // namespace fast_gicp
 
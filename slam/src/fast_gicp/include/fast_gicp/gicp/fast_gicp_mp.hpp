@@ -0,0 +1,79 @@
+#ifndef FAST_GICP_FAST_GICP_MP_HPP
+#define FAST_GICP_FAST_GICP_MP_HPP
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/registration/registration.h>
+#include <fast_gicp/gicp/fast_gicp.hpp>
+#include <fast_gicp/gicp/gicp_settings.hpp>
+
+namespace fast_gicp {
+
+/**
+ * @brief GICP with multiple correspondences per source point
+ *        Each source point is associated with its k nearest target points (within the max correspondence distance)
+ *        and every pair contributes a GICP residual. The denser association converges in fewer iterations on sparse scans.
+ *        Covariances, nearest neighbor search and the optimizer are shared with FastGICP. The cost is always evaluated in double precision.
+ */
+template<typename PointSource, typename PointTarget>
+class FastGICPMultiPoints : public FastGICP<PointSource, PointTarget> {
+public:
+  using Scalar = float;
+  using Matrix4 = typename pcl::Registration<PointSource, PointTarget, Scalar>::Matrix4;
+
+  using PointCloudSource = typename pcl::Registration<PointSource, PointTarget, Scalar>::PointCloudSource;
+  using PointCloudSourcePtr = typename PointCloudSource::Ptr;
+  using PointCloudSourceConstPtr = typename PointCloudSource::ConstPtr;
+
+  using PointCloudTarget = typename pcl::Registration<PointSource, PointTarget, Scalar>::PointCloudTarget;
+  using PointCloudTargetPtr = typename PointCloudTarget::Ptr;
+  using PointCloudTargetConstPtr = typename PointCloudTarget::ConstPtr;
+
+#if PCL_VERSION >= PCL_VERSION_CALC(1, 10, 0)
+  using Ptr = pcl::shared_ptr<FastGICPMultiPoints<PointSource, PointTarget>>;
+  using ConstPtr = pcl::shared_ptr<const FastGICPMultiPoints<PointSource, PointTarget>>;
+#else
+  using Ptr = boost::shared_ptr<FastGICPMultiPoints<PointSource, PointTarget>>;
+  using ConstPtr = boost::shared_ptr<const FastGICPMultiPoints<PointSource, PointTarget>>;
+#endif
+
+protected:
+  using pcl::Registration<PointSource, PointTarget, Scalar>::input_;
+  using pcl::Registration<PointSource, PointTarget, Scalar>::target_;
+  using pcl::Registration<PointSource, PointTarget, Scalar>::corr_dist_threshold_;
+
+  using FastGICP<PointSource, PointTarget>::num_threads_;
+  using FastGICP<PointSource, PointTarget>::executor_;
+  using FastGICP<PointSource, PointTarget>::target_kdtree_;
+  using FastGICP<PointSource, PointTarget>::correspondences_;
+  using FastGICP<PointSource, PointTarget>::sq_distances_;
+  using FastGICP<PointSource, PointTarget>::source_covs_;
+  using FastGICP<PointSource, PointTarget>::target_covs_;
+  using FastGICP<PointSource, PointTarget>::mahalanobis_;
+
+public:
+  FastGICPMultiPoints();
+  virtual ~FastGICPMultiPoints() override;
+
+  /**
+   * @brief number of target points associated with each source point
+   */
+  void setNumCorrespondences(int k);
+
+protected:
+  virtual void update_correspondences(const Eigen::Isometry3d& trans) override;
+
+  virtual double linearize(const Eigen::Isometry3d& trans, Eigen::Matrix<double, 6, 6>* H = nullptr, Eigen::Matrix<double, 6, 1>* b = nullptr) override;
+
+  virtual double compute_error(const Eigen::Isometry3d& trans) override;
+
+private:
+  int num_correspondences_;
+  int k_;  // number of correspondences per source point in correspondences_ (i * k_ + j, -1 if not associated)
+};
+}  // namespace fast_gicp
+
+#endif
@@ -34,6 +34,8 @@ public:
   using PointCloudTargetPtr = typename PointCloudTarget::Ptr;
   using PointCloudTargetConstPtr = typename PointCloudTarget::ConstPtr;
 
+  using KdTreePtr = typename pcl::Registration<PointSource, PointTarget, Scalar>::KdTreePtr;
+
 #if PCL_VERSION >= PCL_VERSION_CALC(1, 10, 0)
   using Ptr = pcl::shared_ptr<FastVGICP<PointSource, PointTarget>>;
   using ConstPtr = pcl::shared_ptr<const FastVGICP<PointSource, PointTarget>>;
@@ -47,6 +49,7 @@ protected:
   using pcl::Registration<PointSource, PointTarget, Scalar>::target_;
 
   using FastGICP<PointSource, PointTarget>::num_threads_;
+  using FastGICP<PointSource, PointTarget>::executor_;
   using FastGICP<PointSource, PointTarget>::source_kdtree_;
   using FastGICP<PointSource, PointTarget>::target_kdtree_;
   using FastGICP<PointSource, PointTarget>::source_covs_;
@@ -61,10 +64,40 @@ public:
   void setNeighborSearchMethod(NeighborSearchMethod method);
 
   virtual void swapSourceAndTarget() override;
+  virtual void clearTarget() override;
   virtual void setInputTarget(const PointCloudTargetConstPtr& cloud) override;
+  virtual void setTargetCovariances(const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs) override;
+
+  virtual void prepareTarget() override;
+  virtual void shareTarget(const FastGICP<PointSource, PointTarget>& other) override;
+
+  /**
+   * @brief incremental target (e.g., local map of scan-to-map odometry)
+   *        points are merged into the target voxel map in O(new points) instead of rebuilding the covariances, kd-tree and voxel map with setInputTarget().
+   *        The first call switches to the incremental mode, setInputTarget() switches back.
+   *        In the incremental mode the target cloud consists of the voxel means, and getFitnessScore() measures the distances
+   *        to the nearest voxel means (looked up in the voxel map, see VoxelMeanSearch).
+   * @param cloud  points to be inserted
+   * @param covs   their covariances (e.g., getSourceCovariances() after aligning the scan)
+   * @param pose   transformation into the target frame (e.g., getFinalTransformation())
+   */
+  void insertTarget(const pcl::PointCloud<PointTarget>& cloud, const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs, const Eigen::Isometry3d& pose = Eigen::Isometry3d::Identity());
+
+  /**
+   * @brief remove voxels from the incremental target
+   * @param max_age       voxels not updated in the last max_age insertTarget() calls are removed (negative = disabled)
+   * @param center        map center (e.g., the current sensor position)
+   * @param max_distance  voxels farther than this from the center are removed (negative = disabled)
+   * @return number of removed voxels
+   */
+  int evictTarget(int max_age, const Eigen::Vector3d& center = Eigen::Vector3d::Zero(), double max_distance = -1.0);
 
 protected:
   virtual void computeTransformation(PointCloudSource& output, const Matrix4& guess) override;
+  virtual bool write_target_model(TargetModelWriter& writer) override;
+  virtual bool read_target_model(TargetModelReader& reader, TargetModelFormat::Section section, std::uint64_t payload_size) override;
+  void reset_incremental_target();
+  void create_voxelmap();
   virtual void update_correspondences(const Eigen::Isometry3d& trans) override;
   virtual double linearize(const Eigen::Isometry3d& trans, Eigen::Matrix<double, 6, 6>* H = nullptr, Eigen::Matrix<double, 6, 1>* b = nullptr) override;
   virtual double compute_error(const Eigen::Isometry3d& trans) override;
@@ -74,9 +107,11 @@ protected:
   NeighborSearchMethod search_method_;
   VoxelAccumulationMode voxel_mode_;
 
-  std::unique_ptr<GaussianVoxelMap<PointTarget>> voxelmap_;
+  // built lazily and kept until the target changes, may be shared with other registrations (shareTarget)
+  std::shared_ptr<const GaussianVoxelMap<PointTarget>> voxelmap_;
+  std::shared_ptr<IncrementalGaussianVoxelMap<PointTarget>> incremental_voxelmap_;  // non-null in the incremental target mode
 
-  std::vector<std::pair<int, GaussianVoxel::Ptr>> voxel_correspondences_;
+  std::vector<std::pair<int, int>> voxel_correspondences_;  // (source point index, voxel index)
   std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> voxel_mahalanobis_;
 };
 }  // namespace fast_gicp
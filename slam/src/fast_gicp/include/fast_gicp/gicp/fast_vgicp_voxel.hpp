@@ -1,8 +1,18 @@
 #ifndef FAST_GICP_FAST_VGICP_VOXEL_HPP
 #define FAST_GICP_FAST_VGICP_VOXEL_HPP
 
+#include <limits>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
 #include <unordered_map>
+#include <Eigen/Core>
+#include <Eigen/Eigenvalues>
+#include <Eigen/Geometry>
 #include <boost/functional/hash.hpp>
+#include <pcl/point_cloud.h>
+#include <pcl/search/kdtree.h>
 #include <fast_gicp/gicp/gicp_settings.hpp>
 
 namespace fast_gicp {
@@ -54,37 +64,24 @@ public:
   }
 };
 
-struct GaussianVoxel {
-public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-  using Ptr = std::shared_ptr<GaussianVoxel>;
-
-  GaussianVoxel() {
-    num_points = 0;
-    mean.setZero();
-    cov.setZero();
+/**
+ * @brief Voxel accumulation policies (template parameter of GaussianVoxelMap::create_voxelmap)
+ *        append() is called for each point in the voxel, then finalize() once
+ */
+struct AdditiveVoxelAccumulator {
+  static void append(const Eigen::Vector4d& mean_, const Eigen::Matrix4d& cov_, Eigen::Vector4d& mean, Eigen::Matrix4d& cov) {
+    mean += mean_;
+    cov += cov_;
   }
-  virtual ~GaussianVoxel() {}
-
-  virtual void append(const Eigen::Vector4d& mean_, const Eigen::Matrix4d& cov_) = 0;
-
-  virtual void finalize() = 0;
 
-public:
-  int num_points;
-  Eigen::Vector4d mean;
-  Eigen::Matrix4d cov;
+  static void finalize(int num_points, Eigen::Vector4d& mean, Eigen::Matrix4d& cov) {
+    mean /= num_points;
+    cov /= num_points;
+  }
 };
 
-struct MultiplicativeGaussianVoxel : GaussianVoxel {
-public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-  MultiplicativeGaussianVoxel() : GaussianVoxel() {}
-  virtual ~MultiplicativeGaussianVoxel() {}
-
-  virtual void append(const Eigen::Vector4d& mean_, const Eigen::Matrix4d& cov_) override {
-    num_points++;
+struct MultiplicativeVoxelAccumulator {
+  static void append(const Eigen::Vector4d& mean_, const Eigen::Matrix4d& cov_, Eigen::Vector4d& mean, Eigen::Matrix4d& cov) {
     Eigen::Matrix4d cov_inv = cov_;
     cov_inv(3, 3) = 1;
     cov_inv = cov_inv.inverse().eval();
@@ -93,7 +90,7 @@ public:
     mean += cov_inv * mean_;
   }
 
-  virtual void finalize() override {
+  static void finalize(int num_points, Eigen::Vector4d& mean, Eigen::Matrix4d& cov) {
     cov(3, 3) = 1;
     mean[3] = 1;
 
@@ -102,57 +99,125 @@ public:
   }
 };
 
-struct AdditiveGaussianVoxel : GaussianVoxel {
-public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-  AdditiveGaussianVoxel() : GaussianVoxel() {}
-  virtual ~AdditiveGaussianVoxel() {}
-
-  virtual void append(const Eigen::Vector4d& mean_, const Eigen::Matrix4d& cov_) override {
-    num_points++;
+/**
+ * @brief NDT voxel statistics: the input covariances are ignored and the voxel covariance is the sample covariance of the points
+ *        (regularized by clamping the eigenvalues as RegularizationMethod::MIN_EIG)
+ */
+struct PointDistributionAccumulator {
+  static void append(const Eigen::Vector4d& mean_, const Eigen::Matrix4d& cov_, Eigen::Vector4d& mean, Eigen::Matrix4d& cov) {
     mean += mean_;
-    cov += cov_;
+    cov += mean_ * mean_.transpose();
   }
 
-  virtual void finalize() override {
+  static void finalize(int num_points, Eigen::Vector4d& mean, Eigen::Matrix4d& cov) {
     mean /= num_points;
-    cov /= num_points;
+    cov = cov / num_points - mean * mean.transpose();
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eig;
+    eig.computeDirect(cov.block<3, 3>(0, 0));
+    const Eigen::Vector3d values = eig.eigenvalues().array().max(1e-3);
+
+    cov.setZero();
+    cov.block<3, 3>(0, 0) = eig.eigenvectors() * values.asDiagonal() * eig.eigenvectors().transpose();
   }
 };
 
+/**
+ * @brief Gaussian voxel map
+ *        voxels are stored in contiguous arrays (means, covs, num_points) and indexed by a flat open addressing table,
+ *        so a lookup is a linear probe over (coord, index) slots instead of a node based hash map traversal
+ */
 template<typename PointT>
 class GaussianVoxelMap {
 public:
-  GaussianVoxelMap(double resolution, VoxelAccumulationMode mode) : voxel_resolution_(resolution), voxel_mode_(mode) {}
+  GaussianVoxelMap(double resolution, VoxelAccumulationMode mode) : voxel_resolution_(resolution), voxel_mode_(mode), slot_mask_(0) {}
+
+  void create_voxelmap(const pcl::PointCloud<PointT>& cloud, const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs, int num_threads = 1) {
+    switch(voxel_mode_) {
+      case VoxelAccumulationMode::ADDITIVE:
+      case VoxelAccumulationMode::ADDITIVE_WEIGHTED:
+        create_voxelmap<AdditiveVoxelAccumulator>(cloud, covs, num_threads);
+        break;
+      case VoxelAccumulationMode::MULTIPLICATIVE:
+        create_voxelmap<MultiplicativeVoxelAccumulator>(cloud, covs, num_threads);
+        break;
+    }
+  }
 
-  void create_voxelmap(const pcl::PointCloud<PointT>& cloud, const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs) {
-    voxels_.clear();
-    for(int i = 0; i < cloud.size(); i++) {
-      Eigen::Vector3i coord = voxel_coord(cloud.at(i).getVector4fMap().template cast<double>());
-
-      auto found = voxels_.find(coord);
-      if(found == voxels_.end()) {
-        GaussianVoxel::Ptr voxel;
-        switch(voxel_mode_) {
-          case VoxelAccumulationMode::ADDITIVE:
-          case VoxelAccumulationMode::ADDITIVE_WEIGHTED:
-            voxel = std::shared_ptr<AdditiveGaussianVoxel>(new AdditiveGaussianVoxel);
-            break;
-          case VoxelAccumulationMode::MULTIPLICATIVE:
-            voxel = std::shared_ptr<MultiplicativeGaussianVoxel>(new MultiplicativeGaussianVoxel);
-            break;
-        }
-        found = voxels_.insert(found, std::make_pair(coord, voxel));
-      }
+  /**
+   * @brief build a voxel map of the point distributions (NDT)
+   */
+  void create_voxelmap(const pcl::PointCloud<PointT>& cloud, int num_threads = 1) {
+    create_voxelmap<PointDistributionAccumulator>(cloud, std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>(), num_threads);
+  }
 
-      auto& voxel = found->second;
-      voxel->append(cloud.at(i).getVector4fMap().template cast<double>(), covs[i]);
+  /**
+   * @brief build the voxel map
+   *        covs can be empty if the accumulator does not use the point covariances
+   *        voxel assignment is a single sequential pass over the hash table,
+   *        accumulation and finalization run in parallel over voxels (each voxel sums its points in the input order,
+   *        so the result does not depend on the number of threads)
+   */
+  template<typename Accumulator>
+  void create_voxelmap(const pcl::PointCloud<PointT>& cloud, const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs, int num_threads = 1) {
+    const int num_points = cloud.size();
+    std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> point_coords(num_points);
+#pragma omp parallel for num_threads(num_threads) schedule(guided, 32)
+    for(int i = 0; i < num_points; i++) {
+      point_coords[i] = voxel_coord(cloud.at(i).getVector4fMap().template cast<double>());
     }
 
-    for(auto& voxel : voxels_) {
-      voxel.second->finalize();
+    // assign voxel indices in the order of first appearance
+    clear(num_points);
+    std::vector<int> point_voxels(num_points);
+    for(int i = 0; i < num_points; i++) {
+      point_voxels[i] = find_or_insert(point_coords[i]);
     }
+
+    const Eigen::Matrix4d zero_cov = Eigen::Matrix4d::Zero();
+    const int num_voxels = coords_.size();
+    means_.assign(num_voxels, Eigen::Vector4d::Zero());
+    covs_.assign(num_voxels, Eigen::Matrix4d::Zero());
+    num_points_.assign(num_voxels, 0);
+
+    // bucket the points by voxel (CSR) so that each voxel is accumulated by one thread
+    std::vector<int> offsets(num_voxels + 1, 0);
+    for(int i = 0; i < num_points; i++) {
+      offsets[point_voxels[i] + 1]++;
+    }
+    for(int i = 0; i < num_voxels; i++) {
+      offsets[i + 1] += offsets[i];
+    }
+    std::vector<int> sorted_points(num_points);
+    std::vector<int> cursor(offsets.begin(), offsets.end() - 1);
+    for(int i = 0; i < num_points; i++) {
+      sorted_points[cursor[point_voxels[i]]++] = i;
+    }
+
+#pragma omp parallel for num_threads(num_threads) schedule(guided, 8)
+    for(int v = 0; v < num_voxels; v++) {
+      for(int j = offsets[v]; j < offsets[v + 1]; j++) {
+        const int i = sorted_points[j];
+        Accumulator::append(cloud.at(i).getVector4fMap().template cast<double>(), covs.empty() ? zero_cov : covs[i], means_[v], covs_[v]);
+      }
+      num_points_[v] = offsets[v + 1] - offsets[v];
+      Accumulator::finalize(num_points_[v], means_[v], covs_[v]);
+    }
+  }
+
+  /**
+   * @brief set the voxels directly (e.g., a voxel map loaded from a file)
+   */
+  void assign(
+    const std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>>& coords,
+    const std::vector<Eigen::Vector4d, Eigen::aligned_allocator<Eigen::Vector4d>>& means,
+    const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs,
+    const std::vector<int>& num_points) {
+    coords_ = coords;
+    means_ = means;
+    covs_ = covs;
+    num_points_ = num_points;
+    rehash(coords_.size());
   }
 
   Eigen::Vector3i voxel_coord(const Eigen::Vector4d& x) const {
@@ -164,21 +229,278 @@ public:
     return Eigen::Vector4d(origin[0], origin[1], origin[2], 1.0f);
   }
 
-  GaussianVoxel::Ptr lookup_voxel(const Eigen::Vector3i& coord) const {
-    auto found = voxels_.find(coord);
-    if(found == voxels_.end()) {
-      return nullptr;
+  /**
+   * @brief find a voxel
+   * @return voxel index, or -1 if the voxel does not exist
+   */
+  int lookup_voxel(const Eigen::Vector3i& coord) const {
+    if(slots_.empty()) {
+      return -1;
     }
 
-    return found->second;
+    for(size_t slot = hash(coord) & slot_mask_;; slot = (slot + 1) & slot_mask_) {
+      const Slot& s = slots_[slot];
+      if(s.index < 0) {
+        return -1;
+      }
+      if(s.coord == coord) {
+        return s.index;
+      }
+    }
   }
 
-private:
+  double resolution() const { return voxel_resolution_; }
+  int size() const { return coords_.size(); }
+
+  const Eigen::Vector3i& coord(int i) const { return coords_[i]; }
+  const Eigen::Vector4d& mean(int i) const { return means_[i]; }
+  const Eigen::Matrix4d& cov(int i) const { return covs_[i]; }
+  int num_points(int i) const { return num_points_[i]; }
+
+protected:
+  struct Slot {
+    Eigen::Vector3i coord;
+    int index;  // -1 if empty
+  };
+
+  static size_t hash(const Eigen::Vector3i& coord) {
+    // spatial hash (Teschner et al.), the table size is a power of two
+    return (static_cast<uint32_t>(coord[0]) * 73856093u) ^ (static_cast<uint32_t>(coord[1]) * 19349669u) ^ (static_cast<uint32_t>(coord[2]) * 83492791u);
+  }
+
+  void clear(int max_num_voxels) {
+    coords_.clear();
+    rehash(max_num_voxels);
+  }
+
+  // resize the table for max_num_voxels voxels (load factor below 0.5) and re-insert the existing voxels
+  void rehash(int max_num_voxels) {
+    size_t num_slots = 16;
+    while(num_slots < static_cast<size_t>(max_num_voxels) * 2) {
+      num_slots <<= 1;
+    }
+    slots_.assign(num_slots, Slot{Eigen::Vector3i::Zero(), -1});
+    slot_mask_ = num_slots - 1;
+
+    for(int i = 0; i < coords_.size(); i++) {
+      size_t slot = hash(coords_[i]) & slot_mask_;
+      while(slots_[slot].index >= 0) {
+        slot = (slot + 1) & slot_mask_;
+      }
+      slots_[slot].coord = coords_[i];
+      slots_[slot].index = i;
+    }
+  }
+
+  int find_or_insert(const Eigen::Vector3i& coord) {
+    size_t slot = hash(coord) & slot_mask_;
+    for(; slots_[slot].index >= 0; slot = (slot + 1) & slot_mask_) {
+      if(slots_[slot].coord == coord) {
+        return slots_[slot].index;
+      }
+    }
+
+    slots_[slot].coord = coord;
+    slots_[slot].index = coords_.size();
+    coords_.push_back(coord);
+    return slots_[slot].index;
+  }
+
+protected:
   double voxel_resolution_;
   VoxelAccumulationMode voxel_mode_;
 
-  using VoxelMap = std::unordered_map<Eigen::Vector3i, GaussianVoxel::Ptr, Vector3iHash, std::equal_to<Eigen::Vector3i>, Eigen::aligned_allocator<std::pair<const Eigen::Vector3i, GaussianVoxel::Ptr>>>;
-  VoxelMap voxels_;
+  std::vector<Slot> slots_;
+  size_t slot_mask_;
+
+  std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> coords_;
+  std::vector<Eigen::Vector4d, Eigen::aligned_allocator<Eigen::Vector4d>> means_;
+  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> covs_;
+  std::vector<int> num_points_;
+};
+
+/**
+ * @brief Gaussian voxel map updated incrementally (e.g., a sliding local map for scan-to-map odometry)
+ *        the raw accumulations of each voxel are kept so that new points are merged into existing voxels in O(new points),
+ *        and voxels can be evicted by age (number of insertions since the last update) or by distance
+ */
+template<typename PointT>
+class IncrementalGaussianVoxelMap : public GaussianVoxelMap<PointT> {
+public:
+  using Base = GaussianVoxelMap<PointT>;
+  using PointCloudConstPtr = typename pcl::PointCloud<PointT>::ConstPtr;
+
+  IncrementalGaussianVoxelMap(double resolution, VoxelAccumulationMode mode) : Base(resolution, mode), frame_(0), means_cloud_(new pcl::PointCloud<PointT>) {
+    Base::clear(0);
+  }
+
+  /**
+   * @brief insert points
+   * @param cloud  points
+   * @param covs   point covariances
+   * @param pose   transformation applied to the points and covariances before insertion
+   */
+  void insert(const pcl::PointCloud<PointT>& cloud, const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs, const Eigen::Isometry3d& pose = Eigen::Isometry3d::Identity()) {
+    switch(this->voxel_mode_) {
+      case VoxelAccumulationMode::ADDITIVE:
+      case VoxelAccumulationMode::ADDITIVE_WEIGHTED:
+        insert<AdditiveVoxelAccumulator>(cloud, covs, pose);
+        break;
+      case VoxelAccumulationMode::MULTIPLICATIVE:
+        insert<MultiplicativeVoxelAccumulator>(cloud, covs, pose);
+        break;
+    }
+  }
+
+  template<typename Accumulator>
+  void insert(const pcl::PointCloud<PointT>& cloud, const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs, const Eigen::Isometry3d& pose = Eigen::Isometry3d::Identity()) {
+    frame_++;
+    if(2 * (this->coords_.size() + cloud.size()) > this->slots_.size()) {
+      this->rehash(this->coords_.size() + cloud.size());
+    }
+
+    std::vector<int> updated;
+    for(int i = 0; i < cloud.size(); i++) {
+      const Eigen::Vector4d pt = pose * cloud.at(i).getVector4fMap().template cast<double>();
+      const Eigen::Matrix4d cov = pose.matrix() * covs[i] * pose.matrix().transpose();
+
+      const int voxel = this->find_or_insert(this->voxel_coord(pt));
+      if(voxel == acc_means_.size()) {
+        acc_means_.push_back(Eigen::Vector4d::Zero());
+        acc_covs_.push_back(Eigen::Matrix4d::Zero());
+        this->means_.push_back(Eigen::Vector4d::Zero());
+        this->covs_.push_back(Eigen::Matrix4d::Zero());
+        this->num_points_.push_back(0);
+        last_update_.push_back(0);
+        means_cloud_->push_back(PointT());
+      }
+
+      if(last_update_[voxel] != frame_) {
+        last_update_[voxel] = frame_;
+        updated.push_back(voxel);
+      }
+
+      Accumulator::append(pt, cov, acc_means_[voxel], acc_covs_[voxel]);
+      this->num_points_[voxel]++;
+    }
+
+    for(int voxel : updated) {
+      this->means_[voxel] = acc_means_[voxel];
+      this->covs_[voxel] = acc_covs_[voxel];
+      Accumulator::finalize(this->num_points_[voxel], this->means_[voxel], this->covs_[voxel]);
+      means_cloud_->at(voxel).getVector3fMap() = this->means_[voxel].template head<3>().template cast<float>();
+    }
+  }
+
+  /**
+   * @brief remove old or distant voxels
+   * @param max_age       voxels not updated in the last max_age insertions are removed (negative = disabled)
+   * @param center        center of the map (e.g., the latest sensor position)
+   * @param max_distance  voxels whose mean is farther than this from center are removed (negative = disabled)
+   * @return number of removed voxels
+   */
+  int evict(int max_age, const Eigen::Vector3d& center = Eigen::Vector3d::Zero(), double max_distance = -1.0) {
+    const double max_sq_distance = max_distance * max_distance;
+
+    int num_kept = 0;
+    for(int i = 0; i < this->coords_.size(); i++) {
+      const bool too_old = max_age >= 0 && frame_ - last_update_[i] > max_age;
+      const bool too_far = max_distance >= 0.0 && (this->means_[i].template head<3>() - center).squaredNorm() > max_sq_distance;
+      if(too_old || too_far) {
+        continue;
+      }
+
+      this->coords_[num_kept] = this->coords_[i];
+      this->means_[num_kept] = this->means_[i];
+      this->covs_[num_kept] = this->covs_[i];
+      this->num_points_[num_kept] = this->num_points_[i];
+      acc_means_[num_kept] = acc_means_[i];
+      acc_covs_[num_kept] = acc_covs_[i];
+      last_update_[num_kept] = last_update_[i];
+      means_cloud_->at(num_kept) = means_cloud_->at(i);
+      num_kept++;
+    }
+
+    const int num_removed = this->coords_.size() - num_kept;
+    if(num_removed == 0) {
+      return 0;
+    }
+
+    this->coords_.resize(num_kept);
+    this->means_.resize(num_kept);
+    this->covs_.resize(num_kept);
+    this->num_points_.resize(num_kept);
+    acc_means_.resize(num_kept);
+    acc_covs_.resize(num_kept);
+    last_update_.resize(num_kept);
+    means_cloud_->resize(num_kept);
+
+    // voxel indices changed, rebuild the table (O(voxels))
+    this->rehash(num_kept);
+    return num_removed;
+  }
+
+  // number of insertions so far
+  int frame() const { return frame_; }
+  int last_update(int i) const { return last_update_[i]; }
+
+  // voxel means as a point cloud (the i-th point is the mean of the i-th voxel), updated in place by insert() and evict()
+  PointCloudConstPtr means_cloud() const { return means_cloud_; }
+
+private:
+  int frame_;
+  typename pcl::PointCloud<PointT>::Ptr means_cloud_;
+
+  std::vector<Eigen::Vector4d, Eigen::aligned_allocator<Eigen::Vector4d>> acc_means_;
+  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> acc_covs_;
+  std::vector<int> last_update_;
+};
+
+/**
+ * @brief pcl::search::KdTree stand-in that answers nearest neighbor queries with the voxel means of a Gaussian voxel map
+ *        only the 27 voxels around the query are examined, so no tree needs to be built when the voxel map changes.
+ *        If none of them exists, the single result has an infinite distance (pcl::Registration::getFitnessScore() then skips the point).
+ *        Used as the target search of pcl::Registration with force_no_recompute (setInputCloud() is never called).
+ */
+template<typename PointT>
+class VoxelMeanSearch : public pcl::search::KdTree<PointT> {
+public:
+  VoxelMeanSearch(const std::shared_ptr<const GaussianVoxelMap<PointT>>& voxelmap) : voxelmap_(voxelmap), offsets_(neighbor_offsets(NeighborSearchMethod::DIRECT27)) {}
+
+  virtual int nearestKSearch(const PointT& point, int k, std::vector<int>& k_indices, std::vector<float>& k_sqr_distances) const override {
+    const Eigen::Vector4d pt = point.getVector4fMap().template cast<double>();
+    const Eigen::Vector3i coord = voxelmap_->voxel_coord(pt);
+
+    std::vector<std::pair<float, int>> candidates;
+    candidates.reserve(offsets_.size());
+    for(const auto& offset : offsets_) {
+      const int voxel = voxelmap_->lookup_voxel(coord + offset);
+      if(voxel >= 0) {
+        candidates.emplace_back((voxelmap_->mean(voxel) - pt).template head<3>().squaredNorm(), voxel);
+      }
+    }
+
+    if(candidates.empty()) {
+      k_indices.assign(1, -1);
+      k_sqr_distances.assign(1, std::numeric_limits<float>::infinity());
+      return 0;
+    }
+
+    const int num_found = std::min<int>(k, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + num_found, candidates.end());
+
+    k_indices.resize(num_found);
+    k_sqr_distances.resize(num_found);
+    for(int i = 0; i < num_found; i++) {
+      k_sqr_distances[i] = candidates[i].first;
+      k_indices[i] = candidates[i].second;
+    }
+    return num_found;
+  }
+
+private:
+  std::shared_ptr<const GaussianVoxelMap<PointT>> voxelmap_;
+  std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> offsets_;
 };
 
 }  // namespace fast_gicp
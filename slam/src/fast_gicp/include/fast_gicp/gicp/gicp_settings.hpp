@@ -7,7 +7,13 @@ enum class RegularizationMethod { NONE, MIN_EIG, NORMALIZED_MIN_EIG, PLANE, FROB
 
 enum class NeighborSearchMethod { DIRECT27, DIRECT7, DIRECT1, /* supported on only VGICP_CUDA */ DIRECT_RADIUS };
 
+enum class NearestNeighborMethod { PCL_KDTREE, STATIC_KDTREE, /* approximate kNN for covariance estimation */ APPROX_VOXEL_HASH };
+
 enum class VoxelAccumulationMode { ADDITIVE, ADDITIVE_WEIGHTED, MULTIPLICATIVE };
+
+enum class ComputePrecision { DOUBLE, /* supported on only FastGICP */ FLOAT };
+
+enum class CorrespondenceUpdate { FULL, /* kNN search skipped */ MAHALANOBIS_ONLY, /* kNN search and Mahalanobis matrices reused */ REUSED };
 }
 
 #endif
\ No newline at end of file
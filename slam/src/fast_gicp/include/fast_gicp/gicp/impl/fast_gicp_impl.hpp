@@ -12,14 +12,28 @@ FastGICP<PointSource, PointTarget>::FastGICP() {
 #else
   num_threads_ = 1;
 #endif
+  executor_ = std::make_shared<OpenMPExecutor>(num_threads_);
 
   k_correspondences_ = 20;
   reg_name_ = "FastGICP";
   corr_dist_threshold_ = std::numeric_limits<float>::max();
 
   regularization_method_ = RegularizationMethod::PLANE;
-  source_kdtree_.reset(new pcl::search::KdTree<PointSource>);
-  target_kdtree_.reset(new pcl::search::KdTree<PointTarget>);
+  precision_ = ComputePrecision::DOUBLE;
+  nn_method_ = NearestNeighborMethod::PCL_KDTREE;
+  source_kdtree_ = create_nearest_neighbor_search<PointSource>(nn_method_);
+  target_kdtree_ = create_nearest_neighbor_search<PointTarget>(nn_method_);
+  source_covs_ = std::make_shared<std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>>();
+  target_covs_ = std::make_shared<std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>>();
+  source_covs_f_ = std::make_shared<PackedCov3fVector>();
+  target_covs_f_ = std::make_shared<PackedCov3fVector>();
+
+  update_translation_threshold_ = 0.0;
+  update_rotation_threshold_ = 0.0;
+  mahalanobis_rotation_threshold_ = 0.0;
+  correspondences_valid_ = false;
+  knn_trans_.setIdentity();
+  mahalanobis_trans_.setIdentity();
 }
 
 template <typename PointSource, typename PointTarget>
@@ -34,6 +48,14 @@ void FastGICP<PointSource, PointTarget>::setNumThreads(int n) {
     num_threads_ = omp_get_max_threads();
   }
 #endif
+
+  executor_ = std::make_shared<OpenMPExecutor>(num_threads_);
+}
+
+template <typename PointSource, typename PointTarget>
+void FastGICP<PointSource, PointTarget>::setExecutor(const std::shared_ptr<Executor>& executor) {
+  executor_ = executor;
+  num_threads_ = executor->num_threads();
 }
 
 template <typename PointSource, typename PointTarget>
@@ -46,26 +68,62 @@ void FastGICP<PointSource, PointTarget>::setRegularizationMethod(RegularizationM
   regularization_method_ = method;
 }
 
+template <typename PointSource, typename PointTarget>
+void FastGICP<PointSource, PointTarget>::setComputePrecision(ComputePrecision precision) {
+  precision_ = precision;
+  correspondences_valid_ = false;
+}
+
+template <typename PointSource, typename PointTarget>
+void FastGICP<PointSource, PointTarget>::setNearestNeighborMethod(NearestNeighborMethod method) {
+  if (nn_method_ == method) {
+    return;
+  }
+
+  nn_method_ = method;
+  source_kdtree_ = create_nearest_neighbor_search<PointSource>(method);
+  target_kdtree_ = create_nearest_neighbor_search<PointTarget>(method);
+  if (input_) {
+    source_kdtree_->setInputCloud(input_);
+  }
+  if (target_) {
+    target_kdtree_->setInputCloud(target_);
+  }
+}
+
+template <typename PointSource, typename PointTarget>
+void FastGICP<PointSource, PointTarget>::setCorrespondenceUpdateThresholds(double translation_threshold, double rotation_threshold, double mahalanobis_rotation_threshold) {
+  update_translation_threshold_ = translation_threshold;
+  update_rotation_threshold_ = rotation_threshold;
+  mahalanobis_rotation_threshold_ = mahalanobis_rotation_threshold;
+}
+
 template <typename PointSource, typename PointTarget>
 void FastGICP<PointSource, PointTarget>::swapSourceAndTarget() {
   input_.swap(target_);
   source_kdtree_.swap(target_kdtree_);
   source_covs_.swap(target_covs_);
+  source_covs_f_.swap(target_covs_f_);
 
   correspondences_.clear();
   sq_distances_.clear();
+  correspondences_valid_ = false;
 }
 
 template <typename PointSource, typename PointTarget>
 void FastGICP<PointSource, PointTarget>::clearSource() {
   input_.reset();
-  source_covs_.clear();
+  source_covs_ = std::make_shared<std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>>();
+  source_covs_f_ = std::make_shared<PackedCov3fVector>();
+  correspondences_valid_ = false;
 }
 
 template <typename PointSource, typename PointTarget>
 void FastGICP<PointSource, PointTarget>::clearTarget() {
   target_.reset();
-  target_covs_.clear();
+  target_covs_ = std::make_shared<std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>>();
+  target_covs_f_ = std::make_shared<PackedCov3fVector>();
+  correspondences_valid_ = false;
 }
 
 template <typename PointSource, typename PointTarget>
@@ -76,7 +134,9 @@ void FastGICP<PointSource, PointTarget>::setInputSource(const PointCloudSourceCo
 
   pcl::Registration<PointSource, PointTarget, Scalar>::setInputSource(cloud);
   source_kdtree_->setInputCloud(cloud);
-  source_covs_.clear();
+  source_covs_ = std::make_shared<std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>>();
+  source_covs_f_ = std::make_shared<PackedCov3fVector>();
+  correspondences_valid_ = false;
 }
 
 template <typename PointSource, typename PointTarget>
@@ -86,35 +146,192 @@ void FastGICP<PointSource, PointTarget>::setInputTarget(const PointCloudTargetCo
   }
   pcl::Registration<PointSource, PointTarget, Scalar>::setInputTarget(cloud);
   target_kdtree_->setInputCloud(cloud);
-  target_covs_.clear();
+  target_covs_ = std::make_shared<std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>>();
+  target_covs_f_ = std::make_shared<PackedCov3fVector>();
+  correspondences_valid_ = false;
 }
 
 template <typename PointSource, typename PointTarget>
 void FastGICP<PointSource, PointTarget>::setSourceCovariances(const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs) {
-  source_covs_ = covs;
+  source_covs_ = std::make_shared<std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>>(covs);
+  source_covs_f_ = std::make_shared<PackedCov3fVector>();
+  correspondences_valid_ = false;
 }
 
 template <typename PointSource, typename PointTarget>
 void FastGICP<PointSource, PointTarget>::setTargetCovariances(const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs) {
-  target_covs_ = covs;
+  target_covs_ = std::make_shared<std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>>(covs);
+  target_covs_f_ = std::make_shared<PackedCov3fVector>();
+  correspondences_valid_ = false;
 }
 
 template <typename PointSource, typename PointTarget>
-void FastGICP<PointSource, PointTarget>::computeTransformation(PointCloudSource& output, const Matrix4& guess) {
-  if (source_covs_.size() != input_->size()) {
-    calculate_covariances(input_, *source_kdtree_, source_covs_);
+void FastGICP<PointSource, PointTarget>::prepareTarget() {
+  update_target_covariances();
+
+  // build the kd-tree of pcl::Registration (used by getFitnessScore) here as initCompute() would do
+  if (this->target_cloud_updated_ && !this->force_no_recompute_) {
+    this->tree_->setInputCloud(target_);
+    this->target_cloud_updated_ = false;
+  }
+}
+
+template <typename PointSource, typename PointTarget>
+void FastGICP<PointSource, PointTarget>::shareTarget(const FastGICP& other) {
+  target_ = other.target_;
+  this->tree_ = other.tree_;
+  this->target_cloud_updated_ = other.target_cloud_updated_;
+
+  target_kdtree_ = other.target_kdtree_;
+  target_covs_ = other.target_covs_;
+  target_covs_f_ = other.target_covs_f_;
+  correspondences_valid_ = false;
+}
+
+template <typename PointSource, typename PointTarget>
+bool FastGICP<PointSource, PointTarget>::saveTargetModel(const std::string& filename) {
+  if (target_ == nullptr) {
+    std::cerr << "error: target cloud is not set" << std::endl;
+    return false;
+  }
+
+  prepareTarget();
+
+  TargetModelWriter writer;
+  if (!write_target_model(writer)) {
+    return false;
+  }
+  return writer.save(filename);
+}
+
+template <typename PointSource, typename PointTarget>
+bool FastGICP<PointSource, PointTarget>::loadTargetModel(const std::string& filename) {
+  TargetModelReader reader;
+  if (!reader.open(filename)) {
+    return false;
+  }
+
+  bool has_points = false;
+  TargetModelFormat::Section section;
+  std::uint64_t payload_size;
+  while (reader.next_section(section, payload_size)) {
+    if (!read_target_model(reader, section, payload_size)) {
+      std::cerr << "error: failed to read " << filename << std::endl;
+      return false;
+    }
+    has_points |= section == TargetModelFormat::POINTS;
   }
-  if (target_covs_.size() != target_->size()) {
-    calculate_covariances(target_, *target_kdtree_, target_covs_);
+
+  if (!has_points) {
+    std::cerr << "error: " << filename << " has no target points" << std::endl;
+    return false;
+  }
+
+  // kd-trees are rebuilt here (the voxel map, if any, has been loaded)
+  prepareTarget();
+  return true;
+}
+
+template <typename PointSource, typename PointTarget>
+bool FastGICP<PointSource, PointTarget>::write_target_model(TargetModelWriter& writer) {
+  writer.begin_section(TargetModelFormat::POINTS);
+  writer.write<std::int32_t>(k_correspondences_);
+  writer.write<std::int32_t>(static_cast<std::int32_t>(regularization_method_));
+  writer.write<std::int32_t>(static_cast<std::int32_t>(nn_method_));
+  writer.write<std::int32_t>(0);
+  writer.write<std::uint64_t>(target_->size());
+
+  std::vector<float> points(target_->size() * 3);
+  std::vector<double> covs(target_->size() * 6);
+  for (int i = 0; i < target_->size(); i++) {
+    Eigen::Map<Eigen::Vector3f>(points.data() + i * 3) = target_->at(i).getVector3fMap();
+
+    // upper triangle of the 3x3 block (xx, xy, xz, yy, yz, zz)
+    const auto& cov = (*target_covs_)[i];
+    double* c = covs.data() + i * 6;
+    c[0] = cov(0, 0);
+    c[1] = cov(0, 1);
+    c[2] = cov(0, 2);
+    c[3] = cov(1, 1);
+    c[4] = cov(1, 2);
+    c[5] = cov(2, 2);
   }
+  writer.write_array(points.data(), points.size());
+  writer.write_array(covs.data(), covs.size());
+  writer.end_section();
+
+  return true;
+}
+
+template <typename PointSource, typename PointTarget>
+bool FastGICP<PointSource, PointTarget>::read_target_model(TargetModelReader& reader, TargetModelFormat::Section section, std::uint64_t payload_size) {
+  if (section != TargetModelFormat::POINTS) {
+    return reader.skip(payload_size);
+  }
+
+  std::int32_t k, regularization_method, nn_method, reserved;
+  std::uint64_t num_points;
+  if (!reader.read(k) || !reader.read(regularization_method) || !reader.read(nn_method) || !reader.read(reserved) || !reader.read(num_points)) {
+    return false;
+  }
+
+  std::vector<float> points(num_points * 3);
+  std::vector<double> covs(num_points * 6);
+  if (!reader.read_array(points.data(), points.size()) || !reader.read_array(covs.data(), covs.size())) {
+    return false;
+  }
+
+  k_correspondences_ = k;
+  regularization_method_ = static_cast<RegularizationMethod>(regularization_method);
+  setNearestNeighborMethod(static_cast<NearestNeighborMethod>(nn_method));
+
+  PointCloudTargetPtr cloud(new PointCloudTarget);
+  cloud->resize(num_points);
+  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> target_covs(num_points, Eigen::Matrix4d::Zero());
+  for (size_t i = 0; i < num_points; i++) {
+    cloud->at(i).getVector3fMap() = Eigen::Map<const Eigen::Vector3f>(points.data() + i * 3);
+
+    const double* c = covs.data() + i * 6;
+    auto& cov = target_covs[i];
+    cov(0, 0) = c[0];
+    cov(0, 1) = cov(1, 0) = c[1];
+    cov(0, 2) = cov(2, 0) = c[2];
+    cov(1, 1) = c[3];
+    cov(1, 2) = cov(2, 1) = c[4];
+    cov(2, 2) = c[5];
+  }
+
+  setInputTarget(cloud);
+  setTargetCovariances(target_covs);
+  return true;
+}
+
+template <typename PointSource, typename PointTarget>
+void FastGICP<PointSource, PointTarget>::computeTransformation(PointCloudSource& output, const Matrix4& guess) {
+  update_source_covariances();
+  update_target_covariances();
+
+  // the initial guess can be anywhere, the first linearization always searches
+  correspondences_valid_ = false;
+  correspondence_updates_.clear();
 
   LsqRegistration<PointSource, PointTarget>::computeTransformation(output, guess);
 }
 
 template <typename PointSource, typename PointTarget>
 void FastGICP<PointSource, PointTarget>::update_correspondences(const Eigen::Isometry3d& trans) {
-  assert(source_covs_.size() == input_->size());
-  assert(target_covs_.size() == target_->size());
+  if (precision_ == ComputePrecision::FLOAT) {
+    update_correspondences_float(trans);
+    return;
+  }
+
+  assert(source_covs_->size() == input_->size());
+  assert(target_covs_->size() == target_->size());
+
+  const CorrespondenceUpdate update = select_correspondence_update(trans);
+  if (update == CorrespondenceUpdate::REUSED) {
+    return;
+  }
 
   Eigen::Isometry3f trans_f = trans.cast<float>();
 
@@ -122,177 +339,341 @@ void FastGICP<PointSource, PointTarget>::update_correspondences(const Eigen::Iso
   sq_distances_.resize(input_->size());
   mahalanobis_.resize(input_->size());
 
-  std::vector<int> k_indices(1);
-  std::vector<float> k_sq_dists(1);
+  parallel_for(*executor_, input_->size(), 256, [&](int begin, int end) {
+    std::vector<int> k_indices(1);
+    std::vector<float> k_sq_dists(1);
 
-#pragma omp parallel for num_threads(num_threads_) firstprivate(k_indices, k_sq_dists) schedule(guided, 8)
-  for (int i = 0; i < input_->size(); i++) {
-    PointTarget pt;
-    pt.getVector4fMap() = trans_f * input_->at(i).getVector4fMap();
+    for (int i = begin; i < end; i++) {
+      if (update == CorrespondenceUpdate::FULL) {
+        PointTarget pt;
+        pt.getVector4fMap() = trans_f * input_->at(i).getVector4fMap();
 
-    target_kdtree_->nearestKSearch(pt, 1, k_indices, k_sq_dists);
+        target_kdtree_->nearestKSearch(pt, 1, k_indices, k_sq_dists);
 
-    sq_distances_[i] = k_sq_dists[0];
-    correspondences_[i] = k_sq_dists[0] < corr_dist_threshold_ * corr_dist_threshold_ ? k_indices[0] : -1;
+        sq_distances_[i] = k_sq_dists[0];
+        correspondences_[i] = k_sq_dists[0] < corr_dist_threshold_ * corr_dist_threshold_ ? k_indices[0] : -1;
+      }
 
-    if (correspondences_[i] < 0) {
-      continue;
-    }
+      if (correspondences_[i] < 0) {
+        continue;
+      }
+
+      const int target_index = correspondences_[i];
+      const auto& cov_A = (*source_covs_)[i];
+      const auto& cov_B = (*target_covs_)[target_index];
 
-    const int target_index = correspondences_[i];
-    const auto& cov_A = source_covs_[i];
-    const auto& cov_B = target_covs_[target_index];
+      Eigen::Matrix4d RCR = cov_B + trans.matrix() * cov_A * trans.matrix().transpose();
+      RCR(3, 3) = 1.0;
 
-    Eigen::Matrix4d RCR = cov_B + trans.matrix() * cov_A * trans.matrix().transpose();
-    RCR(3, 3) = 1.0;
+      mahalanobis_[i] = RCR.inverse();
+      mahalanobis_[i](3, 3) = 0.0f;
+    }
+  });
+}
+
+template <typename PointSource, typename PointTarget>
+CorrespondenceUpdate FastGICP<PointSource, PointTarget>::select_correspondence_update(const Eigen::Isometry3d& trans) {
+  CorrespondenceUpdate update = CorrespondenceUpdate::FULL;
+
+  if (correspondences_valid_ && correspondences_.size() == input_->size()) {
+    const Eigen::Isometry3d knn_delta = knn_trans_.inverse() * trans;
+    if (knn_delta.translation().norm() < update_translation_threshold_ && Eigen::AngleAxisd(knn_delta.linear()).angle() < update_rotation_threshold_) {
+      // the Mahalanobis matrices depend only on the rotation
+      const Eigen::Matrix3d mahalanobis_delta = mahalanobis_trans_.linear().transpose() * trans.linear();
+      update = Eigen::AngleAxisd(mahalanobis_delta).angle() < mahalanobis_rotation_threshold_ ? CorrespondenceUpdate::REUSED : CorrespondenceUpdate::MAHALANOBIS_ONLY;
+    }
+  }
 
-    mahalanobis_[i] = RCR.inverse();
-    mahalanobis_[i](3, 3) = 0.0f;
+  if (update == CorrespondenceUpdate::FULL) {
+    knn_trans_ = trans;
+    correspondences_valid_ = true;
+  }
+  if (update != CorrespondenceUpdate::REUSED) {
+    mahalanobis_trans_ = trans;
   }
+
+  correspondence_updates_.push_back(update);
+  return update;
 }
 
 template <typename PointSource, typename PointTarget>
 double FastGICP<PointSource, PointTarget>::linearize(const Eigen::Isometry3d& trans, Eigen::Matrix<double, 6, 6>* H, Eigen::Matrix<double, 6, 1>* b) {
+  if (precision_ == ComputePrecision::FLOAT) {
+    update_correspondences_float(trans);
+    return linearize_float(trans, H, b);
+  }
+
   update_correspondences(trans);
 
-  double sum_errors = 0.0;
-  std::vector<Eigen::Matrix<double, 6, 6>, Eigen::aligned_allocator<Eigen::Matrix<double, 6, 6>>> Hs(num_threads_);
-  std::vector<Eigen::Matrix<double, 6, 1>, Eigen::aligned_allocator<Eigen::Matrix<double, 6, 1>>> bs(num_threads_);
-  for (int i = 0; i < num_threads_; i++) {
-    Hs[i].setZero();
-    bs[i].setZero();
-  }
+  const LinearizedSum sum = parallel_reduce(*executor_, input_->size(), 256, LinearizedSum(), [&](int begin, int end) {
+    LinearizedSum partial;
+    for (int i = begin; i < end; i++) {
+      int target_index = correspondences_[i];
+      if (target_index < 0) {
+        continue;
+      }
 
-#pragma omp parallel for num_threads(num_threads_) reduction(+ : sum_errors) schedule(guided, 8)
-  for (int i = 0; i < input_->size(); i++) {
-    int target_index = correspondences_[i];
-    if (target_index < 0) {
-      continue;
-    }
+      const Eigen::Vector4d mean_A = input_->at(i).getVector4fMap().template cast<double>();
+      const auto& cov_A = (*source_covs_)[i];
 
-    const Eigen::Vector4d mean_A = input_->at(i).getVector4fMap().template cast<double>();
-    const auto& cov_A = source_covs_[i];
+      const Eigen::Vector4d mean_B = target_->at(target_index).getVector4fMap().template cast<double>();
+      const auto& cov_B = (*target_covs_)[target_index];
 
-    const Eigen::Vector4d mean_B = target_->at(target_index).getVector4fMap().template cast<double>();
-    const auto& cov_B = target_covs_[target_index];
+      const Eigen::Vector4d transed_mean_A = trans * mean_A;
+      const Eigen::Vector4d error = mean_B - transed_mean_A;
 
-    const Eigen::Vector4d transed_mean_A = trans * mean_A;
-    const Eigen::Vector4d error = mean_B - transed_mean_A;
+      partial.error += error.transpose() * mahalanobis_[i] * error;
 
-    sum_errors += error.transpose() * mahalanobis_[i] * error;
+      if (H == nullptr || b == nullptr) {
+        continue;
+      }
 
-    if (H == nullptr || b == nullptr) {
-      continue;
-    }
+      Eigen::Matrix<double, 4, 6> dtdx0 = Eigen::Matrix<double, 4, 6>::Zero();
+      dtdx0.block<3, 3>(0, 0) = skewd(transed_mean_A.head<3>());
+      dtdx0.block<3, 3>(0, 3) = -Eigen::Matrix3d::Identity();
 
-    Eigen::Matrix<double, 4, 6> dtdx0 = Eigen::Matrix<double, 4, 6>::Zero();
-    dtdx0.block<3, 3>(0, 0) = skewd(transed_mean_A.head<3>());
-    dtdx0.block<3, 3>(0, 3) = -Eigen::Matrix3d::Identity();
+      Eigen::Matrix<double, 4, 6> jlossexp = dtdx0;
 
-    Eigen::Matrix<double, 4, 6> jlossexp = dtdx0;
+      Eigen::Matrix<double, 6, 6> Hi = jlossexp.transpose() * mahalanobis_[i] * jlossexp;
+      Eigen::Matrix<double, 6, 1> bi = jlossexp.transpose() * mahalanobis_[i] * error;
 
-    Eigen::Matrix<double, 6, 6> Hi = jlossexp.transpose() * mahalanobis_[i] * jlossexp;
-    Eigen::Matrix<double, 6, 1> bi = jlossexp.transpose() * mahalanobis_[i] * error;
+      partial.H += Hi;
+      partial.b += bi;
+    }
+    return partial;
+  }, std::plus<LinearizedSum>());
 
-    Hs[omp_get_thread_num()] += Hi;
-    bs[omp_get_thread_num()] += bi;
+  if (H && b) {
+    *H = sum.H;
+    *b = sum.b;
   }
 
-  if (H && b) {
-    H->setZero();
-    b->setZero();
-    for (int i = 0; i < num_threads_; i++) {
-      (*H) += Hs[i];
-      (*b) += bs[i];
-    }
+  return sum.error;
+}
+
+template <typename PointSource, typename PointTarget>
+double FastGICP<PointSource, PointTarget>::compute_error(const Eigen::Isometry3d& trans) {
+  if (precision_ == ComputePrecision::FLOAT) {
+    return linearize_float(trans, nullptr, nullptr);
   }
 
+  const double sum_errors = parallel_reduce(*executor_, input_->size(), 256, 0.0, [&](int begin, int end) {
+    double partial = 0.0;
+    for (int i = begin; i < end; i++) {
+      int target_index = correspondences_[i];
+      if (target_index < 0) {
+        continue;
+      }
+
+      const Eigen::Vector4d mean_A = input_->at(i).getVector4fMap().template cast<double>();
+      const auto& cov_A = (*source_covs_)[i];
+
+      const Eigen::Vector4d mean_B = target_->at(target_index).getVector4fMap().template cast<double>();
+      const auto& cov_B = (*target_covs_)[target_index];
+
+      const Eigen::Vector4d transed_mean_A = trans * mean_A;
+      const Eigen::Vector4d error = mean_B - transed_mean_A;
+
+      partial += error.transpose() * mahalanobis_[i] * error;
+    }
+    return partial;
+  }, std::plus<double>());
+
   return sum_errors;
 }
 
 template <typename PointSource, typename PointTarget>
-double FastGICP<PointSource, PointTarget>::compute_error(const Eigen::Isometry3d& trans) {
-  double sum_errors = 0.0;
+void FastGICP<PointSource, PointTarget>::update_correspondences_float(const Eigen::Isometry3d& trans) {
+  assert(source_covs_f_->size() == input_->size());
+  assert(target_covs_f_->size() == target_->size());
+
+  const CorrespondenceUpdate update = select_correspondence_update(trans);
+  if (update == CorrespondenceUpdate::REUSED) {
+    return;
+  }
+
+  Eigen::Isometry3f trans_f = trans.cast<float>();
+  const Eigen::Matrix3f R = trans_f.linear();
+
+  correspondences_.resize(input_->size());
+  sq_distances_.resize(input_->size());
+  mahalanobis_f_.resize(input_->size());
+
+  parallel_for(*executor_, input_->size(), 256, [&](int begin, int end) {
+    std::vector<int> k_indices(1);
+    std::vector<float> k_sq_dists(1);
+
+    for (int i = begin; i < end; i++) {
+      if (update == CorrespondenceUpdate::FULL) {
+        PointTarget pt;
+        pt.getVector4fMap() = trans_f * input_->at(i).getVector4fMap();
+
+        target_kdtree_->nearestKSearch(pt, 1, k_indices, k_sq_dists);
 
-#pragma omp parallel for num_threads(num_threads_) reduction(+ : sum_errors) schedule(guided, 8)
-  for (int i = 0; i < input_->size(); i++) {
-    int target_index = correspondences_[i];
-    if (target_index < 0) {
-      continue;
+        sq_distances_[i] = k_sq_dists[0];
+        correspondences_[i] = k_sq_dists[0] < corr_dist_threshold_ * corr_dist_threshold_ ? k_indices[0] : -1;
+      }
+
+      if (correspondences_[i] < 0) {
+        continue;
+      }
+
+      // the fourth row and column of the covariances are zero, so only the 3x3 block has to be inverted
+      const Eigen::Matrix3f RCR = unpack_cov((*target_covs_f_)[correspondences_[i]]) + R * unpack_cov((*source_covs_f_)[i]) * R.transpose();
+      mahalanobis_f_[i] = inverse_cov(pack_cov(RCR));
     }
+  });
+}
 
-    const Eigen::Vector4d mean_A = input_->at(i).getVector4fMap().template cast<double>();
-    const auto& cov_A = source_covs_[i];
+template <typename PointSource, typename PointTarget>
+double FastGICP<PointSource, PointTarget>::linearize_float(const Eigen::Isometry3d& trans, Eigen::Matrix<double, 6, 6>* H, Eigen::Matrix<double, 6, 1>* b) {
+  const Eigen::Isometry3f trans_f = trans.cast<float>();
+
+  const LinearizedSum sum = parallel_reduce(*executor_, input_->size(), 256, LinearizedSum(), [&](int begin, int end) {
+    LinearizedSum partial;
+    for (int i = begin; i < end; i++) {
+      int target_index = correspondences_[i];
+      if (target_index < 0) {
+        continue;
+      }
+
+      const Eigen::Vector3f transed_mean_A = trans_f * input_->at(i).getVector3fMap();
+      const Eigen::Vector3f error = target_->at(target_index).getVector3fMap() - transed_mean_A;
+      const Eigen::Matrix3f mahalanobis = unpack_cov(mahalanobis_f_[i]);
+      const Eigen::Vector3f weighted_error = mahalanobis * error;
 
-    const Eigen::Vector4d mean_B = target_->at(target_index).getVector4fMap().template cast<double>();
-    const auto& cov_B = target_covs_[target_index];
+      partial.error += error.dot(weighted_error);
+
+      if (H == nullptr || b == nullptr) {
+        continue;
+      }
 
-    const Eigen::Vector4d transed_mean_A = trans * mean_A;
-    const Eigen::Vector4d error = mean_B - transed_mean_A;
+      // J = [skew(RA + t), -I], accumulated per point in float and summed up in double
+      Eigen::Matrix<float, 3, 6> J;
+      J.block<3, 3>(0, 0) = skew(transed_mean_A);
+      J.block<3, 3>(0, 3) = -Eigen::Matrix3f::Identity();
 
-    sum_errors += error.transpose() * mahalanobis_[i] * error;
+      const Eigen::Matrix<float, 6, 3> JtM = J.transpose() * mahalanobis;
+      const Eigen::Matrix<float, 6, 6> Hi = JtM * J;
+      const Eigen::Matrix<float, 6, 1> bi = J.transpose() * weighted_error;
+
+      partial.H += Hi.cast<double>();
+      partial.b += bi.cast<double>();
+    }
+    return partial;
+  }, std::plus<LinearizedSum>());
+
+  if (H && b) {
+    *H = sum.H;
+    *b = sum.b;
   }
 
-  return sum_errors;
+  return sum.error;
+}
+
+template <typename PointSource, typename PointTarget>
+void FastGICP<PointSource, PointTarget>::update_source_covariances() {
+  if (source_covs_->size() != input_->size()) {
+    auto covs = std::make_shared<std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>>();
+    calculate_covariances(input_, *source_kdtree_, *covs);
+    source_covs_ = covs;
+  }
+  if (precision_ == ComputePrecision::FLOAT && source_covs_f_->size() != source_covs_->size()) {
+    auto packed = std::make_shared<PackedCov3fVector>();
+    pack_covs(*source_covs_, *packed);
+    source_covs_f_ = packed;
+  }
+}
+
+template <typename PointSource, typename PointTarget>
+void FastGICP<PointSource, PointTarget>::update_target_covariances() {
+  if (target_covs_->size() != target_->size()) {
+    auto covs = std::make_shared<std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>>();
+    calculate_covariances(target_, *target_kdtree_, *covs);
+    target_covs_ = covs;
+  }
+  if (precision_ == ComputePrecision::FLOAT && target_covs_f_->size() != target_covs_->size()) {
+    auto packed = std::make_shared<PackedCov3fVector>();
+    pack_covs(*target_covs_, *packed);
+    target_covs_f_ = packed;
+  }
 }
 
 template <typename PointSource, typename PointTarget>
 template <typename PointT>
 bool FastGICP<PointSource, PointTarget>::calculate_covariances(
   const typename pcl::PointCloud<PointT>::ConstPtr& cloud,
-  pcl::search::KdTree<PointT>& kdtree,
+  NearestNeighborSearch<PointT>& kdtree,
   std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covariances) {
   if (kdtree.getInputCloud() != cloud) {
     kdtree.setInputCloud(cloud);
   }
   covariances.resize(cloud->size());
 
-#pragma omp parallel for num_threads(num_threads_) schedule(guided, 8)
-  for (int i = 0; i < cloud->size(); i++) {
-    std::vector<int> k_indices;
-    std::vector<float> k_sq_distances;
-    kdtree.nearestKSearch(cloud->at(i), k_correspondences_, k_indices, k_sq_distances);
+  // neighbors of all points in one batched query
+  const int k = std::min<int>(k_correspondences_, cloud->size());
+  std::vector<int> k_indices;
+  kdtree.nearestKSearchAll(k, k_indices, *executor_);
 
-    Eigen::Matrix<double, 4, -1> neighbors(4, k_correspondences_);
-    for (int j = 0; j < k_indices.size(); j++) {
-      neighbors.col(j) = cloud->at(k_indices[j]).getVector4fMap().template cast<double>();
-    }
+  parallel_for(*executor_, cloud->size(), 128, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      const int* neighbor_indices = k_indices.data() + i * k;
+
+      if (precision_ == ComputePrecision::FLOAT) {
+        Eigen::Matrix<float, 3, -1> neighbors(3, k);
+        for (int j = 0; j < k; j++) {
+          neighbors.col(j) = cloud->at(neighbor_indices[j]).getVector3fMap();
+        }
+
+        neighbors.colwise() -= neighbors.rowwise().mean().eval();
+        Eigen::Matrix3f cov = neighbors * neighbors.transpose() / k_correspondences_;
 
-    neighbors.colwise() -= neighbors.rowwise().mean().eval();
-    Eigen::Matrix4d cov = neighbors * neighbors.transpose() / k_correspondences_;
-
-    if (regularization_method_ == RegularizationMethod::NONE) {
-      covariances[i] = cov;
-    } else if (regularization_method_ == RegularizationMethod::FROBENIUS) {
-      double lambda = 1e-3;
-      Eigen::Matrix3d C = cov.block<3, 3>(0, 0).cast<double>() + lambda * Eigen::Matrix3d::Identity();
-      Eigen::Matrix3d C_inv = C.inverse();
-      covariances[i].setZero();
-      covariances[i].template block<3, 3>(0, 0) = (C_inv / C_inv.norm()).inverse();
-    } else {
-      Eigen::JacobiSVD<Eigen::Matrix3d> svd(cov.block<3, 3>(0, 0), Eigen::ComputeFullU | Eigen::ComputeFullV);
-      Eigen::Vector3d values;
-
-      switch (regularization_method_) {
-        default:
-          std::cerr << "here must not be reached" << std::endl;
-          abort();
-        case RegularizationMethod::PLANE:
-          values = Eigen::Vector3d(1, 1, 1e-3);
-          break;
-        case RegularizationMethod::MIN_EIG:
-          values = svd.singularValues().array().max(1e-3);
-          break;
-        case RegularizationMethod::NORMALIZED_MIN_EIG:
-          values = svd.singularValues() / svd.singularValues().maxCoeff();
-          values = values.array().max(1e-3);
-          break;
+        covariances[i].setZero();
+        covariances[i].template block<3, 3>(0, 0) = regularize_cov(cov, regularization_method_).template cast<double>();
+        continue;
       }
 
-      covariances[i].setZero();
-      covariances[i].template block<3, 3>(0, 0) = svd.matrixU() * values.asDiagonal() * svd.matrixV().transpose();
+      Eigen::Matrix<double, 4, -1> neighbors(4, k);
+      for (int j = 0; j < k; j++) {
+        neighbors.col(j) = cloud->at(neighbor_indices[j]).getVector4fMap().template cast<double>();
+      }
+
+      neighbors.colwise() -= neighbors.rowwise().mean().eval();
+      Eigen::Matrix4d cov = neighbors * neighbors.transpose() / k_correspondences_;
+
+      if (regularization_method_ == RegularizationMethod::NONE) {
+        covariances[i] = cov;
+      } else if (regularization_method_ == RegularizationMethod::FROBENIUS) {
+        double lambda = 1e-3;
+        Eigen::Matrix3d C = cov.block<3, 3>(0, 0).cast<double>() + lambda * Eigen::Matrix3d::Identity();
+        Eigen::Matrix3d C_inv = C.inverse();
+        covariances[i].setZero();
+        covariances[i].template block<3, 3>(0, 0) = (C_inv / C_inv.norm()).inverse();
+      } else {
+        Eigen::JacobiSVD<Eigen::Matrix3d> svd(cov.block<3, 3>(0, 0), Eigen::ComputeFullU | Eigen::ComputeFullV);
+        Eigen::Vector3d values;
+
+        switch (regularization_method_) {
+          default:
+            std::cerr << "here must not be reached" << std::endl;
+            abort();
+          case RegularizationMethod::PLANE:
+            values = Eigen::Vector3d(1, 1, 1e-3);
+            break;
+          case RegularizationMethod::MIN_EIG:
+            values = svd.singularValues().array().max(1e-3);
+            break;
+          case RegularizationMethod::NORMALIZED_MIN_EIG:
+            values = svd.singularValues() / svd.singularValues().maxCoeff();
+            values = values.array().max(1e-3);
+            break;
+        }
+
+        covariances[i].setZero();
+        covariances[i].template block<3, 3>(0, 0) = svd.matrixU() * values.asDiagonal() * svd.matrixV().transpose();
+      }
     }
-  }
+  });
 
   return true;
 }
@@ -0,0 +1,141 @@
+#ifndef FAST_GICP_FAST_GICP_MP_IMPL_HPP
+#define FAST_GICP_FAST_GICP_MP_IMPL_HPP
+
+#include <fast_gicp/so3/so3.hpp>
+#include <fast_gicp/gicp/fast_gicp_mp.hpp>
+
+namespace fast_gicp {
+
+template <typename PointSource, typename PointTarget>
+FastGICPMultiPoints<PointSource, PointTarget>::FastGICPMultiPoints() : FastGICP<PointSource, PointTarget>() {
+  this->reg_name_ = "FastGICPMultiPoints";
+  num_correspondences_ = 4;
+  k_ = 0;
+}
+
+template <typename PointSource, typename PointTarget>
+FastGICPMultiPoints<PointSource, PointTarget>::~FastGICPMultiPoints() {}
+
+template <typename PointSource, typename PointTarget>
+void FastGICPMultiPoints<PointSource, PointTarget>::setNumCorrespondences(int k) {
+  num_correspondences_ = std::max(k, 1);
+}
+
+template <typename PointSource, typename PointTarget>
+void FastGICPMultiPoints<PointSource, PointTarget>::update_correspondences(const Eigen::Isometry3d& trans) {
+  assert(source_covs_->size() == input_->size());
+  assert(target_covs_->size() == target_->size());
+
+  Eigen::Isometry3f trans_f = trans.cast<float>();
+
+  k_ = std::min<int>(num_correspondences_, target_->size());
+  correspondences_.resize(input_->size() * k_);
+  sq_distances_.resize(input_->size() * k_);
+  mahalanobis_.resize(input_->size() * k_);
+
+  parallel_for(*executor_, input_->size(), 256, [&](int begin, int end) {
+    std::vector<int> k_indices(k_);
+    std::vector<float> k_sq_dists(k_);
+
+    for (int i = begin; i < end; i++) {
+      PointTarget pt;
+      pt.getVector4fMap() = trans_f * input_->at(i).getVector4fMap();
+
+      target_kdtree_->nearestKSearch(pt, k_, k_indices, k_sq_dists);
+
+      const Eigen::Matrix4d RCR_A = trans.matrix() * (*source_covs_)[i] * trans.matrix().transpose();
+
+      for (int j = 0; j < k_; j++) {
+        const int index = i * k_ + j;
+        const bool associated = j < k_indices.size() && k_sq_dists[j] < corr_dist_threshold_ * corr_dist_threshold_;
+
+        sq_distances_[index] = associated ? k_sq_dists[j] : std::numeric_limits<float>::max();
+        correspondences_[index] = associated ? k_indices[j] : -1;
+        if (!associated) {
+          continue;
+        }
+
+        Eigen::Matrix4d RCR = (*target_covs_)[k_indices[j]] + RCR_A;
+        RCR(3, 3) = 1.0;
+
+        mahalanobis_[index] = RCR.inverse();
+        mahalanobis_[index](3, 3) = 0.0;
+      }
+    }
+  });
+}
+
+template <typename PointSource, typename PointTarget>
+double FastGICPMultiPoints<PointSource, PointTarget>::linearize(const Eigen::Isometry3d& trans, Eigen::Matrix<double, 6, 6>* H, Eigen::Matrix<double, 6, 1>* b) {
+  update_correspondences(trans);
+
+  const LinearizedSum sum = parallel_reduce(*executor_, input_->size(), 256, LinearizedSum(), [&](int begin, int end) {
+    LinearizedSum partial;
+    for (int i = begin; i < end; i++) {
+      const Eigen::Vector4d mean_A = input_->at(i).getVector4fMap().template cast<double>();
+      const Eigen::Vector4d transed_mean_A = trans * mean_A;
+
+      // the jacobian only depends on the source point
+      Eigen::Matrix<double, 4, 6> dtdx0 = Eigen::Matrix<double, 4, 6>::Zero();
+      dtdx0.block<3, 3>(0, 0) = skewd(transed_mean_A.head<3>());
+      dtdx0.block<3, 3>(0, 3) = -Eigen::Matrix3d::Identity();
+
+      for (int j = 0; j < k_; j++) {
+        const int index = i * k_ + j;
+        const int target_index = correspondences_[index];
+        if (target_index < 0) {
+          continue;
+        }
+
+        const Eigen::Vector4d mean_B = target_->at(target_index).getVector4fMap().template cast<double>();
+        const Eigen::Vector4d error = mean_B - transed_mean_A;
+        const Eigen::Vector4d weighted_error = mahalanobis_[index] * error;
+
+        partial.error += error.dot(weighted_error);
+
+        if (H == nullptr || b == nullptr) {
+          continue;
+        }
+
+        partial.H += dtdx0.transpose() * mahalanobis_[index] * dtdx0;
+        partial.b += dtdx0.transpose() * weighted_error;
+      }
+    }
+    return partial;
+  }, std::plus<LinearizedSum>());
+
+  if (H && b) {
+    *H = sum.H;
+    *b = sum.b;
+  }
+
+  return sum.error;
+}
+
+template <typename PointSource, typename PointTarget>
+double FastGICPMultiPoints<PointSource, PointTarget>::compute_error(const Eigen::Isometry3d& trans) {
+  const double sum_errors = parallel_reduce(*executor_, input_->size(), 256, 0.0, [&](int begin, int end) {
+    double partial = 0.0;
+    for (int i = begin; i < end; i++) {
+      const Eigen::Vector4d transed_mean_A = trans * input_->at(i).getVector4fMap().template cast<double>();
+
+      for (int j = 0; j < k_; j++) {
+        const int index = i * k_ + j;
+        const int target_index = correspondences_[index];
+        if (target_index < 0) {
+          continue;
+        }
+
+        const Eigen::Vector4d error = target_->at(target_index).getVector4fMap().template cast<double>() - transed_mean_A;
+        partial += error.transpose() * mahalanobis_[index] * error;
+      }
+    }
+    return partial;
+  }, std::plus<double>());
+
+  return sum_errors;
+}
+
+}  // namespace fast_gicp
+
+#endif
@@ -9,7 +9,7 @@ namespace fast_gicp {
 template <typename PointSource, typename PointTarget>
 FastGICPSingleThread<PointSource, PointTarget>::FastGICPSingleThread() : FastGICP<PointSource, PointTarget>() {
   this->reg_name_ = "FastGICPSingleThread";
-  this->num_threads_ = 1;
+  this->setNumThreads(1);
 }
 
 template <typename PointSource, typename PointTarget>
@@ -23,8 +23,8 @@ void FastGICPSingleThread<PointSource, PointTarget>::computeTransformation(Point
 
 template <typename PointSource, typename PointTarget>
 void FastGICPSingleThread<PointSource, PointTarget>::update_correspondences(const Eigen::Isometry3d& x) {
-  assert(source_covs_.size() == input_->size());
-  assert(target_covs_.size() == target_->size());
+  assert(source_covs_->size() == input_->size());
+  assert(target_covs_->size() == target_->size());
 
   Eigen::Isometry3f trans = x.template cast<float>();
 
@@ -65,8 +65,8 @@ void FastGICPSingleThread<PointSource, PointTarget>::update_correspondences(cons
     }
 
     const int target_index = correspondences_[i];
-    const auto& cov_A = source_covs_[i];
-    const auto& cov_B = target_covs_[target_index];
+    const auto& cov_A = (*source_covs_)[i];
+    const auto& cov_B = (*target_covs_)[target_index];
 
     Eigen::Matrix4d RCR = cov_B + x.matrix() * cov_A * x.matrix().transpose();
     RCR(3, 3) = 1.0;
@@ -92,10 +92,10 @@ double FastGICPSingleThread<PointSource, PointTarget>::linearize(const Eigen::Is
     }
 
     const Eigen::Vector4d mean_A = input_->at(i).getVector4fMap().template cast<double>();
-    const auto& cov_A = source_covs_[i];
+    const auto& cov_A = (*source_covs_)[i];
 
     const Eigen::Vector4d mean_B = target_->at(target_index).getVector4fMap().template cast<double>();
-    const auto& cov_B = target_covs_[target_index];
+    const auto& cov_B = (*target_covs_)[target_index];
 
     const Eigen::Vector4d transed_mean_A = trans * mean_A;
     const Eigen::Vector4d error = mean_B - transed_mean_A;
@@ -29,6 +29,10 @@ FastVGICP<PointSource, PointTarget>::~FastVGICP() {}
 
 template <typename PointSource, typename PointTarget>
 void FastVGICP<PointSource, PointTarget>::setResolution(double resolution) {
+  if (voxel_resolution_ != resolution) {
+    reset_incremental_target();
+    voxelmap_.reset();
+  }
   voxel_resolution_ = resolution;
 }
 
@@ -39,11 +43,16 @@ void FastVGICP<PointSource, PointTarget>::setNeighborSearchMethod(NeighborSearch
 
 template <typename PointSource, typename PointTarget>
 void FastVGICP<PointSource, PointTarget>::setVoxelAccumulationMode(VoxelAccumulationMode mode) {
+  if (voxel_mode_ != mode) {
+    reset_incremental_target();
+    voxelmap_.reset();
+  }
   voxel_mode_ = mode;
 }
 
 template <typename PointSource, typename PointTarget>
 void FastVGICP<PointSource, PointTarget>::swapSourceAndTarget() {
+  reset_incremental_target();
   input_.swap(target_);
   source_kdtree_.swap(target_kdtree_);
   source_covs_.swap(target_covs_);
@@ -52,21 +61,196 @@ void FastVGICP<PointSource, PointTarget>::swapSourceAndTarget() {
   voxel_mahalanobis_.clear();
 }
 
+template <typename PointSource, typename PointTarget>
+void FastVGICP<PointSource, PointTarget>::clearTarget() {
+  reset_incremental_target();
+  FastGICP<PointSource, PointTarget>::clearTarget();
+  voxelmap_.reset();
+}
+
 template <typename PointSource, typename PointTarget>
 void FastVGICP<PointSource, PointTarget>::setInputTarget(const PointCloudTargetConstPtr& cloud) {
   if (target_ == cloud) {
     return;
   }
 
+  reset_incremental_target();
   FastGICP<PointSource, PointTarget>::setInputTarget(cloud);
   voxelmap_.reset();
 }
 
 template <typename PointSource, typename PointTarget>
-void FastVGICP<PointSource, PointTarget>::computeTransformation(PointCloudSource& output, const Matrix4& guess) {
+void FastVGICP<PointSource, PointTarget>::setTargetCovariances(const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs) {
+  reset_incremental_target();
+  FastGICP<PointSource, PointTarget>::setTargetCovariances(covs);
   voxelmap_.reset();
+}
+
+template <typename PointSource, typename PointTarget>
+void FastVGICP<PointSource, PointTarget>::prepareTarget() {
+  FastGICP<PointSource, PointTarget>::prepareTarget();
+  create_voxelmap();
+}
+
+template <typename PointSource, typename PointTarget>
+void FastVGICP<PointSource, PointTarget>::shareTarget(const FastGICP<PointSource, PointTarget>& other) {
+  reset_incremental_target();
+  FastGICP<PointSource, PointTarget>::shareTarget(other);
+
+  const auto* vgicp = dynamic_cast<const FastVGICP<PointSource, PointTarget>*>(&other);
+  if (vgicp && vgicp->voxel_resolution_ == voxel_resolution_ && vgicp->voxel_mode_ == voxel_mode_) {
+    voxelmap_ = vgicp->voxelmap_;
+  } else {
+    voxelmap_.reset();
+  }
+}
+
+template <typename PointSource, typename PointTarget>
+void FastVGICP<PointSource, PointTarget>::insertTarget(
+  const pcl::PointCloud<PointTarget>& cloud,
+  const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs,
+  const Eigen::Isometry3d& pose) {
+  if (incremental_voxelmap_ == nullptr) {
+    // leave the batch target mode, the target structures of FastGICP are not used anymore
+    FastGICP<PointSource, PointTarget>::clearTarget();
+    incremental_voxelmap_.reset(new IncrementalGaussianVoxelMap<PointTarget>(voxel_resolution_, voxel_mode_));
+    voxelmap_ = incremental_voxelmap_;
+
+    // pcl::Registration::align() requires a target cloud, the voxel means (updated in place) are used.
+    // the kd-tree of pcl::Registration is replaced by a voxel lookup that is never rebuilt (used by getFitnessScore())
+    target_ = incremental_voxelmap_->means_cloud();
+    this->setSearchMethodTarget(KdTreePtr(new VoxelMeanSearch<PointTarget>(incremental_voxelmap_)), true);
+  }
+
+  incremental_voxelmap_->insert(cloud, covs, pose);
+}
+
+template <typename PointSource, typename PointTarget>
+int FastVGICP<PointSource, PointTarget>::evictTarget(int max_age, const Eigen::Vector3d& center, double max_distance) {
+  if (incremental_voxelmap_ == nullptr) {
+    return 0;
+  }
+
+  return incremental_voxelmap_->evict(max_age, center, max_distance);
+}
+
+template <typename PointSource, typename PointTarget>
+void FastVGICP<PointSource, PointTarget>::create_voxelmap() {
+  if (voxelmap_ != nullptr) {
+    return;
+  }
+
+  auto voxelmap = std::make_shared<GaussianVoxelMap<PointTarget>>(voxel_resolution_, voxel_mode_);
+  voxelmap->create_voxelmap(*target_, *target_covs_, num_threads_);
+  voxelmap_ = voxelmap;
+}
+
+template <typename PointSource, typename PointTarget>
+bool FastVGICP<PointSource, PointTarget>::write_target_model(TargetModelWriter& writer) {
+  if (incremental_voxelmap_) {
+    std::cerr << "error: an incremental target cannot be saved" << std::endl;
+    return false;
+  }
+
+  if (!FastGICP<PointSource, PointTarget>::write_target_model(writer)) {
+    return false;
+  }
+
+  create_voxelmap();
+  const int num_voxels = voxelmap_->size();
+
+  writer.begin_section(TargetModelFormat::VOXELS);
+  writer.write<double>(voxel_resolution_);
+  writer.write<std::int32_t>(static_cast<std::int32_t>(voxel_mode_));
+  writer.write<std::int32_t>(0);
+  writer.write<std::uint64_t>(num_voxels);
+
+  // the voxel statistics are stored as they are (4d means and 4x4 covariances, column major)
+  std::vector<std::int32_t> coords(num_voxels * 3);
+  std::vector<double> means(num_voxels * 4);
+  std::vector<double> covs(num_voxels * 16);
+  std::vector<std::int32_t> num_points(num_voxels);
+  for (int i = 0; i < num_voxels; i++) {
+    Eigen::Map<Eigen::Vector3i>(coords.data() + i * 3) = voxelmap_->coord(i);
+    Eigen::Map<Eigen::Vector4d>(means.data() + i * 4) = voxelmap_->mean(i);
+    Eigen::Map<Eigen::Matrix4d>(covs.data() + i * 16) = voxelmap_->cov(i);
+    num_points[i] = voxelmap_->num_points(i);
+  }
+  writer.write_array(coords.data(), coords.size());
+  writer.write_array(means.data(), means.size());
+  writer.write_array(covs.data(), covs.size());
+  writer.write_array(num_points.data(), num_points.size());
+  writer.end_section();
+
+  return true;
+}
+
+template <typename PointSource, typename PointTarget>
+bool FastVGICP<PointSource, PointTarget>::read_target_model(TargetModelReader& reader, TargetModelFormat::Section section, std::uint64_t payload_size) {
+  if (section != TargetModelFormat::VOXELS) {
+    return FastGICP<PointSource, PointTarget>::read_target_model(reader, section, payload_size);
+  }
+
+  double resolution;
+  std::int32_t mode, reserved;
+  std::uint64_t num_voxels;
+  if (!reader.read(resolution) || !reader.read(mode) || !reader.read(reserved) || !reader.read(num_voxels)) {
+    return false;
+  }
+
+  std::vector<std::int32_t> raw_coords(num_voxels * 3);
+  std::vector<double> raw_means(num_voxels * 4);
+  std::vector<double> raw_covs(num_voxels * 16);
+  std::vector<int> num_points(num_voxels);
+  if (!reader.read_array(raw_coords.data(), raw_coords.size()) || !reader.read_array(raw_means.data(), raw_means.size()) || !reader.read_array(raw_covs.data(), raw_covs.size()) ||
+      !reader.read_array(num_points.data(), num_points.size())) {
+    return false;
+  }
 
-  FastGICP<PointSource, PointTarget>::computeTransformation(output, guess);
+  // the voxel map replaces the one of the points section (which resets it), so the voxel parameters of the file are applied
+  setResolution(resolution);
+  setVoxelAccumulationMode(static_cast<VoxelAccumulationMode>(mode));
+
+  std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> coords(num_voxels);
+  std::vector<Eigen::Vector4d, Eigen::aligned_allocator<Eigen::Vector4d>> means(num_voxels);
+  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> covs(num_voxels);
+  for (size_t i = 0; i < num_voxels; i++) {
+    coords[i] = Eigen::Map<const Eigen::Vector3i>(raw_coords.data() + i * 3);
+    means[i] = Eigen::Map<const Eigen::Vector4d>(raw_means.data() + i * 4);
+    covs[i] = Eigen::Map<const Eigen::Matrix4d>(raw_covs.data() + i * 16);
+  }
+
+  auto voxelmap = std::make_shared<GaussianVoxelMap<PointTarget>>(voxel_resolution_, voxel_mode_);
+  voxelmap->assign(coords, means, covs, num_points);
+  voxelmap_ = voxelmap;
+  return true;
+}
+
+template <typename PointSource, typename PointTarget>
+void FastVGICP<PointSource, PointTarget>::computeTransformation(PointCloudSource& output, const Matrix4& guess) {
+  if (incremental_voxelmap_ == nullptr) {
+    FastGICP<PointSource, PointTarget>::computeTransformation(output, guess);
+    return;
+  }
+
+  // incremental target: the voxel map is already up to date, only the source needs covariances
+  this->update_source_covariances();
+
+  LsqRegistration<PointSource, PointTarget>::computeTransformation(output, guess);
+}
+
+template <typename PointSource, typename PointTarget>
+void FastVGICP<PointSource, PointTarget>::reset_incremental_target() {
+  if (incremental_voxelmap_ == nullptr) {
+    return;
+  }
+
+  // back to the batch target mode: drop the voxel means target and restore the default kd-tree of pcl::Registration
+  FastGICP<PointSource, PointTarget>::clearTarget();
+  incremental_voxelmap_.reset();
+  voxelmap_.reset();
+  this->setSearchMethodTarget(KdTreePtr(new pcl::search::KdTree<PointTarget>));
+  this->force_no_recompute_ = false;  // not cleared by setSearchMethodTarget() in PCL <= 1.10
 }
 
 template <typename PointSource, typename PointTarget>
@@ -74,24 +258,27 @@ void FastVGICP<PointSource, PointTarget>::update_correspondences(const Eigen::Is
   voxel_correspondences_.clear();
   auto offsets = neighbor_offsets(search_method_);
 
-  std::vector<std::vector<std::pair<int, GaussianVoxel::Ptr>>> corrs(num_threads_);
-  for (auto& c : corrs) {
-    c.reserve((input_->size() * offsets.size()) / num_threads_);
-  }
+  // correspondences of each chunk are concatenated in the chunk order (same order for any executor)
+  const int chunk_size = 256;
+  std::vector<std::vector<std::pair<int, int>>> corrs((input_->size() + chunk_size - 1) / chunk_size);
 
-#pragma omp parallel for num_threads(num_threads_) schedule(guided, 8)
-  for (int i = 0; i < input_->size(); i++) {
-    const Eigen::Vector4d mean_A = input_->at(i).getVector4fMap().template cast<double>();
-    Eigen::Vector4d transed_mean_A = trans * mean_A;
-    Eigen::Vector3i coord = voxelmap_->voxel_coord(transed_mean_A);
+  parallel_for(*executor_, input_->size(), chunk_size, [&](int begin, int end) {
+    auto& c = corrs[begin / chunk_size];
+    c.reserve((end - begin) * offsets.size());
 
-    for (const auto& offset : offsets) {
-      auto voxel = voxelmap_->lookup_voxel(coord + offset);
-      if (voxel != nullptr) {
-        corrs[omp_get_thread_num()].push_back(std::make_pair(i, voxel));
+    for (int i = begin; i < end; i++) {
+      const Eigen::Vector4d mean_A = input_->at(i).getVector4fMap().template cast<double>();
+      Eigen::Vector4d transed_mean_A = trans * mean_A;
+      Eigen::Vector3i coord = voxelmap_->voxel_coord(transed_mean_A);
+
+      for (const auto& offset : offsets) {
+        int voxel = voxelmap_->lookup_voxel(coord + offset);
+        if (voxel >= 0) {
+          c.push_back(std::make_pair(i, voxel));
+        }
       }
     }
-  }
+  });
 
   voxel_correspondences_.reserve(input_->size() * offsets.size());
   for (const auto& c : corrs) {
@@ -101,104 +288,86 @@ void FastVGICP<PointSource, PointTarget>::update_correspondences(const Eigen::Is
   // precompute combined covariances
   voxel_mahalanobis_.resize(voxel_correspondences_.size());
 
-#pragma omp parallel for num_threads(num_threads_) schedule(guided, 8)
-  for (int i = 0; i < voxel_correspondences_.size(); i++) {
-    const auto& corr = voxel_correspondences_[i];
-    const auto& cov_A = source_covs_[corr.first];
-    const auto& cov_B = corr.second->cov;
+  parallel_for(*executor_, voxel_correspondences_.size(), 256, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      const auto& corr = voxel_correspondences_[i];
+      const auto& cov_A = (*source_covs_)[corr.first];
+      const auto& cov_B = voxelmap_->cov(corr.second);
 
-    Eigen::Matrix4d RCR = cov_B + trans.matrix() * cov_A * trans.matrix().transpose();
-    RCR(3, 3) = 1.0;
+      Eigen::Matrix4d RCR = cov_B + trans.matrix() * cov_A * trans.matrix().transpose();
+      RCR(3, 3) = 1.0;
 
-    voxel_mahalanobis_[i] = RCR.inverse();
-    voxel_mahalanobis_[i](3, 3) = 0.0;
-  }
+      voxel_mahalanobis_[i] = RCR.inverse();
+      voxel_mahalanobis_[i](3, 3) = 0.0;
+    }
+  });
 }
 
 template <typename PointSource, typename PointTarget>
 double FastVGICP<PointSource, PointTarget>::linearize(const Eigen::Isometry3d& trans, Eigen::Matrix<double, 6, 6>* H, Eigen::Matrix<double, 6, 1>* b) {
-  if (voxelmap_ == nullptr) {
-    voxelmap_.reset(new GaussianVoxelMap<PointTarget>(voxel_resolution_, voxel_mode_));
-    voxelmap_->create_voxelmap(*target_, target_covs_);
-  }
+  create_voxelmap();
 
   update_correspondences(trans);
 
-  double sum_errors = 0.0;
-  std::vector<Eigen::Matrix<double, 6, 6>, Eigen::aligned_allocator<Eigen::Matrix<double, 6, 6>>> Hs(num_threads_);
-  std::vector<Eigen::Matrix<double, 6, 1>, Eigen::aligned_allocator<Eigen::Matrix<double, 6, 1>>> bs(num_threads_);
-  for (int i = 0; i < num_threads_; i++) {
-    Hs[i].setZero();
-    bs[i].setZero();
-  }
-
-#pragma omp parallel for num_threads(num_threads_) reduction(+ : sum_errors) schedule(guided, 8)
-  for (int i = 0; i < voxel_correspondences_.size(); i++) {
-    const auto& corr = voxel_correspondences_[i];
-    auto target_voxel = corr.second;
+  const LinearizedSum sum = parallel_reduce(*executor_, voxel_correspondences_.size(), 256, LinearizedSum(), [&](int begin, int end) {
+    LinearizedSum partial;
+    for (int i = begin; i < end; i++) {
+      const auto& corr = voxel_correspondences_[i];
 
-    const Eigen::Vector4d mean_A = input_->at(corr.first).getVector4fMap().template cast<double>();
-    const auto& cov_A = source_covs_[corr.first];
+      const Eigen::Vector4d mean_A = input_->at(corr.first).getVector4fMap().template cast<double>();
+      const Eigen::Vector4d& mean_B = voxelmap_->mean(corr.second);
 
-    const Eigen::Vector4d mean_B = corr.second->mean;
-    const auto& cov_B = corr.second->cov;
+      const Eigen::Vector4d transed_mean_A = trans * mean_A;
+      const Eigen::Vector4d error = mean_B - transed_mean_A;
 
-    const Eigen::Vector4d transed_mean_A = trans * mean_A;
-    const Eigen::Vector4d error = mean_B - transed_mean_A;
+      double w = std::sqrt(voxelmap_->num_points(corr.second));
+      partial.error += w * error.transpose() * voxel_mahalanobis_[i] * error;
 
-    double w = std::sqrt(target_voxel->num_points);
-    sum_errors += w * error.transpose() * voxel_mahalanobis_[i] * error;
-
-    if (H == nullptr || b == nullptr) {
-      continue;
-    }
+      if (H == nullptr || b == nullptr) {
+        continue;
+      }
 
-    Eigen::Matrix<double, 4, 6> dtdx0 = Eigen::Matrix<double, 4, 6>::Zero();
-    dtdx0.block<3, 3>(0, 0) = skewd(transed_mean_A.head<3>());
-    dtdx0.block<3, 3>(0, 3) = -Eigen::Matrix3d::Identity();
+      Eigen::Matrix<double, 4, 6> dtdx0 = Eigen::Matrix<double, 4, 6>::Zero();
+      dtdx0.block<3, 3>(0, 0) = skewd(transed_mean_A.head<3>());
+      dtdx0.block<3, 3>(0, 3) = -Eigen::Matrix3d::Identity();
 
-    Eigen::Matrix<double, 4, 6> jlossexp = dtdx0;
+      Eigen::Matrix<double, 4, 6> jlossexp = dtdx0;
 
-    Eigen::Matrix<double, 6, 6> Hi = w * jlossexp.transpose() * voxel_mahalanobis_[i] * jlossexp;
-    Eigen::Matrix<double, 6, 1> bi = w * jlossexp.transpose() * voxel_mahalanobis_[i] * error;
+      Eigen::Matrix<double, 6, 6> Hi = w * jlossexp.transpose() * voxel_mahalanobis_[i] * jlossexp;
+      Eigen::Matrix<double, 6, 1> bi = w * jlossexp.transpose() * voxel_mahalanobis_[i] * error;
 
-    int thread_num = omp_get_thread_num();
-    Hs[thread_num] += Hi;
-    bs[thread_num] += bi;
-  }
+      partial.H += Hi;
+      partial.b += bi;
+    }
+    return partial;
+  }, std::plus<LinearizedSum>());
 
   if (H && b) {
-    H->setZero();
-    b->setZero();
-    for (int i = 0; i < num_threads_; i++) {
-      (*H) += Hs[i];
-      (*b) += bs[i];
-    }
+    *H = sum.H;
+    *b = sum.b;
   }
 
-  return sum_errors;
+  return sum.error;
 }
 
 template <typename PointSource, typename PointTarget>
 double FastVGICP<PointSource, PointTarget>::compute_error(const Eigen::Isometry3d& trans) {
-  double sum_errors = 0.0;
-#pragma omp parallel for num_threads(num_threads_) reduction(+ : sum_errors)
-  for (int i = 0; i < voxel_correspondences_.size(); i++) {
-    const auto& corr = voxel_correspondences_[i];
-    auto target_voxel = corr.second;
-
-    const Eigen::Vector4d mean_A = input_->at(corr.first).getVector4fMap().template cast<double>();
-    const auto& cov_A = source_covs_[corr.first];
+  const double sum_errors = parallel_reduce(*executor_, voxel_correspondences_.size(), 256, 0.0, [&](int begin, int end) {
+    double partial = 0.0;
+    for (int i = begin; i < end; i++) {
+      const auto& corr = voxel_correspondences_[i];
 
-    const Eigen::Vector4d mean_B = corr.second->mean;
-    const auto& cov_B = corr.second->cov;
+      const Eigen::Vector4d mean_A = input_->at(corr.first).getVector4fMap().template cast<double>();
+      const Eigen::Vector4d& mean_B = voxelmap_->mean(corr.second);
 
-    const Eigen::Vector4d transed_mean_A = trans * mean_A;
-    const Eigen::Vector4d error = mean_B - transed_mean_A;
+      const Eigen::Vector4d transed_mean_A = trans * mean_A;
+      const Eigen::Vector4d error = mean_B - transed_mean_A;
 
-    double w = std::sqrt(target_voxel->num_points);
-    sum_errors += w * error.transpose() * voxel_mahalanobis_[i] * error;
-  }
+      double w = std::sqrt(voxelmap_->num_points(corr.second));
+      partial += w * error.transpose() * voxel_mahalanobis_[i] * error;
+    }
+    return partial;
+  }, std::plus<double>());
 
   return sum_errors;
 }
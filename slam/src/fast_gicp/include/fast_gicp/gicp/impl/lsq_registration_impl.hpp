@@ -18,6 +18,8 @@ LsqRegistration<PointTarget, PointSource>::LsqRegistration() {
   lm_init_lambda_factor_ = 1e-9;
   lm_lambda_ = -1.0;
 
+  dogleg_radius_ = -1.0;
+
   final_hessian_.setIdentity();
 }
 
@@ -39,11 +41,21 @@ void LsqRegistration<PointTarget, PointSource>::setDebugPrint(bool lm_debug_prin
   lm_debug_print_ = lm_debug_print;
 }
 
+template <typename PointTarget, typename PointSource>
+void LsqRegistration<PointTarget, PointSource>::setOptimizerType(LSQ_OPTIMIZER_TYPE type) {
+  lsq_optimizer_type_ = type;
+}
+
 template <typename PointTarget, typename PointSource>
 const Eigen::Matrix<double, 6, 6>& LsqRegistration<PointTarget, PointSource>::getFinalHessian() const {
   return final_hessian_;
 }
 
+template <typename PointTarget, typename PointSource>
+const std::vector<LsqIterationStats>& LsqRegistration<PointTarget, PointSource>::getIterationStats() const {
+  return iteration_stats_;
+}
+
 template <typename PointTarget, typename PointSource>
 double LsqRegistration<PointTarget, PointSource>::evaluateCost(const Eigen::Matrix4f& relative_pose, Eigen::Matrix<double, 6, 6>* H, Eigen::Matrix<double, 6, 1>* b) {
   return this->linearize(Eigen::Isometry3f(relative_pose).cast<double>(), H, b);
@@ -54,7 +66,9 @@ void LsqRegistration<PointTarget, PointSource>::computeTransformation(PointCloud
   Eigen::Isometry3d x0 = Eigen::Isometry3d(guess.template cast<double>());
 
   lm_lambda_ = -1.0;
+  dogleg_radius_ = -1.0;
   converged_ = false;
+  iteration_stats_.clear();
 
   if (lm_debug_print_) {
     std::cout << "********************************************" << std::endl;
@@ -97,6 +111,10 @@ bool LsqRegistration<PointTarget, PointSource>::step_optimize(Eigen::Isometry3d&
       return step_lm(x0, delta);
     case LSQ_OPTIMIZER_TYPE::GaussNewton:
       return step_gn(x0, delta);
+    case LSQ_OPTIMIZER_TYPE::Dogleg:
+      return step_dogleg(x0, delta);
+    case LSQ_OPTIMIZER_TYPE::GaussNewtonLineSearch:
+      return step_gn_line_search(x0, delta);
   }
 
   return step_lm(x0, delta);
@@ -118,6 +136,7 @@ bool LsqRegistration<PointTarget, PointSource>::step_gn(Eigen::Isometry3d& x0, E
   x0 = delta * x0;
   final_hessian_ = H;
 
+  iteration_stats_.push_back(LsqIterationStats{y0, y0, d.norm(), 0.0, 0, true});
   return true;
 }
 
@@ -154,6 +173,7 @@ bool LsqRegistration<PointTarget, PointSource>::step_lm(Eigen::Isometry3d& x0, E
 
     if (rho < 0) {
       if (is_converged(delta)) {
+        iteration_stats_.push_back(LsqIterationStats{y0, y0, 0.0, lm_lambda_, i + 1, false});
         return true;
       }
 
@@ -163,11 +183,137 @@ bool LsqRegistration<PointTarget, PointSource>::step_lm(Eigen::Isometry3d& x0, E
     }
 
     x0 = xi;
+    iteration_stats_.push_back(LsqIterationStats{y0, yi, d.norm(), lm_lambda_, i + 1, true});
     lm_lambda_ = lm_lambda_ * std::max(1.0 / 3.0, 1 - std::pow(2 * rho - 1, 3));
     final_hessian_ = H;
     return true;
   }
 
+  iteration_stats_.push_back(LsqIterationStats{y0, y0, 0.0, lm_lambda_, lm_max_iterations_, false});
+  return false;
+}
+
+template <typename PointTarget, typename PointSource>
+bool LsqRegistration<PointTarget, PointSource>::step_dogleg(Eigen::Isometry3d& x0, Eigen::Isometry3d& delta) {
+  Eigen::Matrix<double, 6, 6> H;
+  Eigen::Matrix<double, 6, 1> b;
+  double y0 = linearize(x0, &H, &b);
+
+  // quadratic model of the error: y(d) = y0 + 2 b^T d + d^T H d
+  Eigen::LDLT<Eigen::Matrix<double, 6, 6>> solver(H);
+  const Eigen::Matrix<double, 6, 1> d_gn = solver.solve(-b);
+
+  // minimizer of the model along the steepest descent direction (Cauchy point)
+  const double bHb = b.dot(H * b);
+  const Eigen::Matrix<double, 6, 1> d_sd = bHb > 0.0 ? Eigen::Matrix<double, 6, 1>(-(b.squaredNorm() / bHb) * b) : Eigen::Matrix<double, 6, 1>(-b);
+
+  if (dogleg_radius_ < 0.0) {
+    dogleg_radius_ = d_gn.norm();
+  }
+
+  for (int i = 0; i < lm_max_iterations_; i++) {
+    Eigen::Matrix<double, 6, 1> d;
+    if (d_gn.norm() <= dogleg_radius_) {
+      d = d_gn;
+    } else if (d_sd.norm() >= dogleg_radius_) {
+      d = (dogleg_radius_ / d_sd.norm()) * d_sd;
+    } else {
+      // d_sd + beta * (d_gn - d_sd) on the trust region boundary
+      const Eigen::Matrix<double, 6, 1> v = d_gn - d_sd;
+      const double a = v.squaredNorm();
+      const double c = d_sd.dot(v);
+      const double beta = (-c + std::sqrt(c * c + a * (dogleg_radius_ * dogleg_radius_ - d_sd.squaredNorm()))) / a;
+      d = d_sd + beta * v;
+    }
+
+    delta.setIdentity();
+    delta.linear() = so3_exp(d.head<3>()).toRotationMatrix();
+    delta.translation() = d.tail<3>();
+
+    Eigen::Isometry3d xi = delta * x0;
+    double yi = compute_error(xi);
+    double predicted = -(2.0 * b.dot(d) + d.dot(H * d));
+    double rho = predicted > 0.0 ? (y0 - yi) / predicted : -1.0;
+
+    if (lm_debug_print_) {
+      if (i == 0) {
+        std::cout << boost::format("--- Dogleg optimization ---\n%5s %15s %15s %15s %15s %15s %5s\n") % "i" % "y0" % "yi" % "rho" % "radius" % "|delta|" % "dec";
+      }
+      char dec = rho > 0.0 ? 'x' : ' ';
+      std::cout << boost::format("%5d %15g %15g %15g %15g %15g %5c") % i % y0 % yi % rho % dogleg_radius_ % d.norm() % dec << std::endl;
+    }
+
+    if (rho > 0.75) {
+      dogleg_radius_ = std::max(dogleg_radius_, 3.0 * d.norm());
+    } else if (rho < 0.25) {
+      dogleg_radius_ = 0.5 * d.norm();
+    }
+
+    if (rho <= 0.0) {
+      if (is_converged(delta)) {
+        iteration_stats_.push_back(LsqIterationStats{y0, y0, 0.0, dogleg_radius_, i + 1, false});
+        return true;
+      }
+      continue;
+    }
+
+    x0 = xi;
+    final_hessian_ = H;
+    iteration_stats_.push_back(LsqIterationStats{y0, yi, d.norm(), dogleg_radius_, i + 1, true});
+    return true;
+  }
+
+  iteration_stats_.push_back(LsqIterationStats{y0, y0, 0.0, dogleg_radius_, lm_max_iterations_, false});
+  return false;
+}
+
+template <typename PointTarget, typename PointSource>
+bool LsqRegistration<PointTarget, PointSource>::step_gn_line_search(Eigen::Isometry3d& x0, Eigen::Isometry3d& delta) {
+  Eigen::Matrix<double, 6, 6> H;
+  Eigen::Matrix<double, 6, 1> b;
+  double y0 = linearize(x0, &H, &b);
+
+  Eigen::LDLT<Eigen::Matrix<double, 6, 6>> solver(H);
+  const Eigen::Matrix<double, 6, 1> d_gn = solver.solve(-b);
+
+  // Armijo condition: y(alpha) <= y0 + c * alpha * y'(0), with y'(0) = 2 b^T d
+  const double c = 1e-4;
+  const double slope = 2.0 * b.dot(d_gn);
+
+  for (int i = 0; i < lm_max_iterations_; i++) {
+    const double alpha = std::pow(0.5, i);
+    const Eigen::Matrix<double, 6, 1> d = alpha * d_gn;
+
+    delta.setIdentity();
+    delta.linear() = so3_exp(d.head<3>()).toRotationMatrix();
+    delta.translation() = d.tail<3>();
+
+    Eigen::Isometry3d xi = delta * x0;
+    double yi = compute_error(xi);
+    bool accepted = yi <= y0 + c * alpha * std::min(slope, 0.0);
+
+    if (lm_debug_print_) {
+      if (i == 0) {
+        std::cout << boost::format("--- GN line search ---\n%5s %15s %15s %15s %15s %5s\n") % "i" % "y0" % "yi" % "alpha" % "|delta|" % "dec";
+      }
+      std::cout << boost::format("%5d %15g %15g %15g %15g %5c") % i % y0 % yi % alpha % d.norm() % (accepted ? 'x' : ' ') << std::endl;
+    }
+
+    if (!accepted) {
+      if (is_converged(delta)) {
+        iteration_stats_.push_back(LsqIterationStats{y0, y0, 0.0, alpha, i + 1, false});
+        return true;
+      }
+      continue;
+    }
+
+    x0 = xi;
+    final_hessian_ = H;
+    iteration_stats_.push_back(LsqIterationStats{y0, yi, d.norm(), alpha, i + 1, true});
+    return true;
+  }
+
+  iteration_stats_.push_back(LsqIterationStats{y0, y0, 0.0, std::pow(0.5, lm_max_iterations_ - 1), lm_max_iterations_, false});
   return false;
 }
 
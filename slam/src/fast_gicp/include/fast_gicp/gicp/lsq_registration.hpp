@@ -1,6 +1,7 @@
 #ifndef FAST_GICP_LSQ_REGISTRATION_HPP
 #define FAST_GICP_LSQ_REGISTRATION_HPP
 
+#include <vector>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 
@@ -10,7 +11,46 @@
 
 namespace fast_gicp {
 
-enum class LSQ_OPTIMIZER_TYPE { GaussNewton, LevenbergMarquardt };
+enum class LSQ_OPTIMIZER_TYPE {
+  GaussNewton,
+  LevenbergMarquardt,
+  Dogleg,                 // Powell's dogleg with a trust region kept over the iterations
+  GaussNewtonLineSearch   // Gauss-Newton with Armijo backtracking along the GN direction
+};
+
+/**
+ * @brief Statistics of one outer iteration of LsqRegistration
+ *        Trial steps are evaluated with compute_error() on the correspondences of the last linearize() call.
+ */
+struct LsqIterationStats {
+  double error;           // error at the linearization point
+  double accepted_error;  // error after the accepted step (= error if no step was accepted)
+  double step_norm;       // norm of the accepted step in the tangent space
+  double damping;         // lambda (LM), trust region radius (dogleg) or step length (line search), 0 for GN
+  int num_trials;         // number of trial steps evaluated with compute_error()
+  bool accepted;
+};
+
+/**
+ * @brief Sum of the errors and the linearized system over a range of residuals (chunk partial of linearize())
+ */
+struct LinearizedSum {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  LinearizedSum() : error(0.0), H(Eigen::Matrix<double, 6, 6>::Zero()), b(Eigen::Matrix<double, 6, 1>::Zero()) {}
+
+  LinearizedSum operator+(const LinearizedSum& rhs) const {
+    LinearizedSum sum;
+    sum.error = error + rhs.error;
+    sum.H = H + rhs.H;
+    sum.b = b + rhs.b;
+    return sum;
+  }
+
+  double error;
+  Eigen::Matrix<double, 6, 6> H;
+  Eigen::Matrix<double, 6, 1> b;
+};
 
 template<typename PointSource, typename PointTarget>
 class LsqRegistration : public pcl::Registration<PointSource, PointTarget, float> {
@@ -51,9 +91,15 @@ public:
   void setRotationEpsilon(double eps);
   void setInitialLambdaFactor(double init_lambda_factor);
   void setDebugPrint(bool lm_debug_print);
+  void setOptimizerType(LSQ_OPTIMIZER_TYPE type);
 
   const Eigen::Matrix<double, 6, 6>& getFinalHessian() const;
 
+  /**
+   * @brief per-iteration statistics of the last alignment (one linearize() call per entry)
+   */
+  const std::vector<LsqIterationStats>& getIterationStats() const;
+
   double evaluateCost(const Eigen::Matrix4f& relative_pose, Eigen::Matrix<double, 6, 6>* H = nullptr, Eigen::Matrix<double, 6, 1>* b = nullptr);
 
   virtual void swapSourceAndTarget() {}
@@ -71,6 +117,8 @@ protected:
   bool step_optimize(Eigen::Isometry3d& x0, Eigen::Isometry3d& delta);
   bool step_gn(Eigen::Isometry3d& x0, Eigen::Isometry3d& delta);
   bool step_lm(Eigen::Isometry3d& x0, Eigen::Isometry3d& delta);
+  bool step_dogleg(Eigen::Isometry3d& x0, Eigen::Isometry3d& delta);
+  bool step_gn_line_search(Eigen::Isometry3d& x0, Eigen::Isometry3d& delta);
 
 protected:
   double rotation_epsilon_;
@@ -81,7 +129,10 @@ protected:
   double lm_lambda_;
   bool lm_debug_print_;
 
+  double dogleg_radius_;  // trust region radius (negative = initialized with the first GN step)
+
   Eigen::Matrix<double, 6, 6> final_hessian_;
+  std::vector<LsqIterationStats> iteration_stats_;
 };
 }  // namespace fast_gicp
 
@@ -0,0 +1,456 @@
+#ifndef FAST_GICP_NEAREST_NEIGHBOR_SEARCH_HPP
+#define FAST_GICP_NEAREST_NEIGHBOR_SEARCH_HPP
+
+#include <cmath>
+#include <mutex>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <Eigen/Core>
+
+#include <pcl/point_cloud.h>
+#include <pcl/search/kdtree.h>
+#include <fast_gicp/gicp/gicp_settings.hpp>
+#include <fast_gicp/gicp/executor.hpp>
+
+namespace fast_gicp {
+
+/**
+ * @brief Nearest neighbor search used for covariance estimation and correspondence search
+ */
+template<typename PointT>
+class NearestNeighborSearch {
+public:
+  using PointCloudConstPtr = typename pcl::PointCloud<PointT>::ConstPtr;
+
+  virtual ~NearestNeighborSearch() {}
+
+  virtual void setInputCloud(const PointCloudConstPtr& cloud) = 0;
+  virtual PointCloudConstPtr getInputCloud() const = 0;
+
+  /**
+   * @brief k nearest neighbors sorted by distance (same as pcl::search::Search::nearestKSearch), can be called concurrently
+   */
+  virtual int nearestKSearch(const PointT& pt, int k, std::vector<int>& k_indices, std::vector<float>& k_sq_distances) const = 0;
+
+  /**
+   * @brief k nearest neighbors of every point of the input cloud (batched query for covariance estimation)
+   * @param k          number of neighbors (must not exceed the number of points)
+   * @param k_indices  neighbors of the i-th point are stored in [i * k, (i + 1) * k), not necessarily sorted by distance
+   */
+  virtual void nearestKSearchAll(int k, std::vector<int>& k_indices, Executor& executor) {
+    const auto& cloud = getInputCloud();
+    k_indices.resize(cloud->size() * k);
+
+    parallel_for(executor, cloud->size(), 128, [&](int begin, int end) {
+      std::vector<int> indices;
+      std::vector<float> sq_dists;
+      for(int i = begin; i < end; i++) {
+        nearestKSearch(cloud->at(i), k, indices, sq_dists);
+        std::copy(indices.begin(), indices.end(), k_indices.begin() + i * k);
+      }
+    });
+  }
+};
+
+/**
+ * @brief pcl::search::KdTree (FLANN)
+ */
+template<typename PointT>
+class PclKdTreeSearch : public NearestNeighborSearch<PointT> {
+public:
+  using PointCloudConstPtr = typename NearestNeighborSearch<PointT>::PointCloudConstPtr;
+
+  PclKdTreeSearch() : kdtree_(new pcl::search::KdTree<PointT>) {}
+
+  virtual void setInputCloud(const PointCloudConstPtr& cloud) override {
+    kdtree_->setInputCloud(cloud);
+  }
+
+  virtual PointCloudConstPtr getInputCloud() const override {
+    return kdtree_->getInputCloud();
+  }
+
+  virtual int nearestKSearch(const PointT& pt, int k, std::vector<int>& k_indices, std::vector<float>& k_sq_distances) const override {
+    return kdtree_->nearestKSearch(pt, k, k_indices, k_sq_distances);
+  }
+
+private:
+  std::shared_ptr<pcl::search::KdTree<PointT>> kdtree_;
+};
+
+/**
+ * @brief fixed capacity list of the k nearest candidates sorted by distance
+ */
+class KnnResult {
+public:
+  KnnResult(int k, int* indices, float* sq_dists) : k_(k), num_(0), indices_(indices), sq_dists_(sq_dists) {}
+
+  int size() const { return num_; }
+
+  float worst() const { return num_ < k_ ? std::numeric_limits<float>::max() : sq_dists_[k_ - 1]; }
+
+  void push(int index, float sq_dist) {
+    if(sq_dist >= worst()) {
+      return;
+    }
+
+    int i = std::min(num_, k_ - 1);
+    for(; i > 0 && sq_dists_[i - 1] > sq_dist; i--) {
+      indices_[i] = indices_[i - 1];
+      sq_dists_[i] = sq_dists_[i - 1];
+    }
+    indices_[i] = index;
+    sq_dists_[i] = sq_dist;
+    num_ = std::min(num_ + 1, k_);
+  }
+
+private:
+  const int k_;
+  int num_;
+  int* indices_;
+  float* sq_dists_;
+};
+
+/**
+ * @brief Static kd-tree in the manner of nanoflann
+ *        The tree is a flat node array over points stored contiguously in the leaf order, and queries do not allocate.
+ *        Batched queries are issued in the leaf order so that consecutive queries traverse the same nodes.
+ */
+template<typename PointT>
+class StaticKdTree : public NearestNeighborSearch<PointT> {
+public:
+  using PointCloudConstPtr = typename NearestNeighborSearch<PointT>::PointCloudConstPtr;
+
+  StaticKdTree(int max_leaf_size = 16) : max_leaf_size_(max_leaf_size) {}
+
+  virtual void setInputCloud(const PointCloudConstPtr& cloud) override {
+    cloud_ = cloud;
+    nodes_.clear();
+
+    const int num_points = cloud->size();
+    points_.resize(num_points);
+    indices_.resize(num_points);
+    for(int i = 0; i < num_points; i++) {
+      points_[i] = cloud->at(i).getVector3fMap();
+      indices_[i] = i;
+    }
+
+    if(num_points == 0) {
+      return;
+    }
+
+    nodes_.reserve(2 * num_points / max_leaf_size_ + 1);
+    build(0, num_points);
+
+    // reorder the points in the leaf order
+    std::vector<Eigen::Vector3f> sorted(num_points);
+    for(int i = 0; i < num_points; i++) {
+      sorted[i] = points_[indices_[i]];
+    }
+    points_.swap(sorted);
+  }
+
+  virtual PointCloudConstPtr getInputCloud() const override {
+    return cloud_;
+  }
+
+  virtual int nearestKSearch(const PointT& pt, int k, std::vector<int>& k_indices, std::vector<float>& k_sq_distances) const override {
+    k = std::min<int>(k, points_.size());
+    k_indices.resize(k);
+    k_sq_distances.resize(k);
+    if(k == 0) {
+      return 0;
+    }
+
+    KnnResult result(k, k_indices.data(), k_sq_distances.data());
+    search(0, pt.getVector3fMap(), result);
+
+    for(int i = 0; i < k; i++) {
+      k_indices[i] = indices_[k_indices[i]];
+    }
+    return k;
+  }
+
+  virtual void nearestKSearchAll(int k, std::vector<int>& k_indices, Executor& executor) override {
+    const int num_points = points_.size();
+    k_indices.resize(num_points * k);
+    if(k == 0) {
+      return;
+    }
+
+    parallel_for(executor, num_points, 256, [&](int begin, int end) {
+      std::vector<float> sq_dists(k);
+      for(int i = begin; i < end; i++) {
+        int* indices = k_indices.data() + indices_[i] * k;
+        KnnResult result(k, indices, sq_dists.data());
+        search(0, points_[i], result);
+
+        for(int j = 0; j < k; j++) {
+          indices[j] = indices_[indices[j]];
+        }
+      }
+    });
+  }
+
+private:
+  struct Node {
+    int first;  // range of the points in the leaf order
+    int last;
+    int left;  // -1 for leaves
+    int right;
+    int axis;
+    float split;
+  };
+
+  // builds the subtree of points_[indices_[first..last)] and returns its node index
+  int build(int first, int last) {
+    const int node_index = nodes_.size();
+    nodes_.emplace_back();
+
+    Node node;
+    node.first = first;
+    node.last = last;
+    node.left = node.right = -1;
+    node.axis = 0;
+    node.split = 0.0f;
+
+    if(last - first > max_leaf_size_) {
+      Eigen::Vector3f min_pt = points_[indices_[first]];
+      Eigen::Vector3f max_pt = min_pt;
+      for(int i = first + 1; i < last; i++) {
+        min_pt = min_pt.cwiseMin(points_[indices_[i]]);
+        max_pt = max_pt.cwiseMax(points_[indices_[i]]);
+      }
+
+      // median split along the widest extent
+      (max_pt - min_pt).maxCoeff(&node.axis);
+      const int mid = (first + last) / 2;
+      const int axis = node.axis;
+      std::nth_element(indices_.begin() + first, indices_.begin() + mid, indices_.begin() + last, [&](int lhs, int rhs) { return points_[lhs][axis] < points_[rhs][axis]; });
+      node.split = points_[indices_[mid]][axis];
+
+      node.left = build(first, mid);
+      node.right = build(mid, last);
+    }
+
+    nodes_[node_index] = node;
+    return node_index;
+  }
+
+  void search(int node_index, const Eigen::Vector3f& query, KnnResult& result) const {
+    const Node& node = nodes_[node_index];
+    if(node.left < 0) {
+      for(int i = node.first; i < node.last; i++) {
+        result.push(i, (points_[i] - query).squaredNorm());
+      }
+      return;
+    }
+
+    const float diff = query[node.axis] - node.split;
+    search(diff < 0.0f ? node.left : node.right, query, result);
+    if(diff * diff < result.worst()) {
+      search(diff < 0.0f ? node.right : node.left, query, result);
+    }
+  }
+
+private:
+  const int max_leaf_size_;
+
+  PointCloudConstPtr cloud_;
+  std::vector<Node> nodes_;
+  std::vector<Eigen::Vector3f> points_;  // in the leaf order
+  std::vector<int> indices_;             // leaf order -> cloud index
+};
+
+/**
+ * @brief Approximate kNN on a voxel hash for covariance estimation
+ *        Points are bucketed into voxels, and the candidates of all points in a voxel are gathered once from its 27 neighbor voxels
+ *        (widened up to 7x7x7 voxels in sparse regions). The result is exact for points whose k-th neighbor is within the voxel resolution,
+ *        otherwise the k nearest candidates are returned.
+ *        Single queries (correspondence search) are answered exactly by a StaticKdTree that is built on first use.
+ */
+template<typename PointT>
+class ApproxVoxelNearestNeighborSearch : public NearestNeighborSearch<PointT> {
+public:
+  using PointCloudConstPtr = typename NearestNeighborSearch<PointT>::PointCloudConstPtr;
+
+  /**
+   * @param resolution  voxel resolution (0 = median k-th neighbor distance of sampled points)
+   */
+  ApproxVoxelNearestNeighborSearch(double resolution = 0.0) : resolution_(resolution) {}
+
+  virtual void setInputCloud(const PointCloudConstPtr& cloud) override {
+    cloud_ = cloud;
+    kdtree_.reset();
+    kdtree_once_.reset(new std::once_flag);
+  }
+
+  virtual PointCloudConstPtr getInputCloud() const override {
+    return cloud_;
+  }
+
+  virtual int nearestKSearch(const PointT& pt, int k, std::vector<int>& k_indices, std::vector<float>& k_sq_distances) const override {
+    return exact_kdtree().nearestKSearch(pt, k, k_indices, k_sq_distances);
+  }
+
+  virtual void nearestKSearchAll(int k, std::vector<int>& k_indices, Executor& executor) override {
+    const int num_points = cloud_->size();
+    k_indices.resize(num_points * k);
+    if(k == 0) {
+      return;
+    }
+
+    const double resolution = resolution_ > 0.0 ? resolution_ : estimate_resolution(k);
+    const double inv_resolution = 1.0 / resolution;
+
+    // sort the points by voxel
+    std::vector<std::pair<std::uint64_t, int>> keyed(num_points);
+    parallel_for(executor, num_points, 1024, [&](int begin, int end) {
+      for(int i = begin; i < end; i++) {
+        keyed[i] = std::make_pair(voxel_key(voxel_coord(cloud_->at(i).getVector3fMap(), inv_resolution)), i);
+      }
+    });
+    std::sort(keyed.begin(), keyed.end());
+
+    std::vector<Eigen::Vector3f> points(num_points);
+    std::vector<std::uint64_t> voxel_keys;
+    std::vector<int> voxel_begin;
+    for(int i = 0; i < num_points; i++) {
+      points[i] = cloud_->at(keyed[i].second).getVector3fMap();
+      if(i == 0 || keyed[i].first != keyed[i - 1].first) {
+        voxel_keys.push_back(keyed[i].first);
+        voxel_begin.push_back(i);
+      }
+    }
+    voxel_begin.push_back(num_points);
+
+    parallel_for(executor, voxel_keys.size(), 16, [&](int begin, int end) {
+      std::vector<int> candidates;
+      std::vector<std::pair<float, int>> sq_dists;
+      for(int v = begin; v < end; v++) {
+        const Eigen::Vector3i coord = voxel_coord(points[voxel_begin[v]], inv_resolution);
+
+        // widen the neighborhood for sparse points (the result is exact if the k-th neighbor is within radius * resolution)
+        candidates.clear();
+        for(int radius = 1; radius <= max_search_radius && candidates.size() < k; radius++) {
+          gather_candidates(coord, radius, voxel_keys, voxel_begin, candidates);
+        }
+
+        for(int i = voxel_begin[v]; i < voxel_begin[v + 1]; i++) {
+          int* indices = k_indices.data() + keyed[i].second * k;
+
+          if(candidates.size() < k) {
+            // isolated point, fall back to the exact search
+            std::vector<int> exact_indices;
+            std::vector<float> exact_sq_dists;
+            exact_kdtree().nearestKSearch(cloud_->at(keyed[i].second), k, exact_indices, exact_sq_dists);
+            std::copy(exact_indices.begin(), exact_indices.end(), indices);
+            continue;
+          }
+
+          sq_dists.resize(candidates.size());
+          for(int j = 0; j < candidates.size(); j++) {
+            sq_dists[j] = std::make_pair((points[candidates[j]] - points[i]).squaredNorm(), candidates[j]);
+          }
+          std::nth_element(sq_dists.begin(), sq_dists.begin() + (k - 1), sq_dists.end());
+
+          for(int j = 0; j < k; j++) {
+            indices[j] = keyed[sq_dists[j].second].second;
+          }
+        }
+      }
+    });
+  }
+
+private:
+  static constexpr int max_search_radius = 3;
+
+  // points of the voxels within the given (Chebyshev) radius, voxels with the same (x, y) have consecutive keys
+  static void gather_candidates(const Eigen::Vector3i& coord, int radius, const std::vector<std::uint64_t>& voxel_keys, const std::vector<int>& voxel_begin, std::vector<int>& candidates) {
+    candidates.clear();
+    for(int dx = -radius; dx <= radius; dx++) {
+      for(int dy = -radius; dy <= radius; dy++) {
+        const std::uint64_t first_key = voxel_key(coord + Eigen::Vector3i(dx, dy, -radius));
+        const std::uint64_t last_key = voxel_key(coord + Eigen::Vector3i(dx, dy, radius));
+
+        const int first = std::lower_bound(voxel_keys.begin(), voxel_keys.end(), first_key) - voxel_keys.begin();
+        int last = first;
+        while(last < voxel_keys.size() && voxel_keys[last] <= last_key) {
+          last++;
+        }
+
+        for(int i = voxel_begin[first]; i < voxel_begin[last]; i++) {
+          candidates.push_back(i);
+        }
+      }
+    }
+  }
+
+  static Eigen::Vector3i voxel_coord(const Eigen::Vector3f& pt, double inv_resolution) {
+    return (pt.cast<double>() * inv_resolution).array().floor().template cast<int>();
+  }
+
+  // 21 bits per axis
+  static std::uint64_t voxel_key(const Eigen::Vector3i& coord) {
+    const std::uint64_t mask = (1ull << 21) - 1;
+    const std::uint64_t offset = 1ull << 20;
+    return (((coord[0] + offset) & mask) << 42) | (((coord[1] + offset) & mask) << 21) | ((coord[2] + offset) & mask);
+  }
+
+  // median distance to the k-th neighbor of evenly sampled points (brute force, O(num_samples * N))
+  double estimate_resolution(int k) const {
+    const int num_points = cloud_->size();
+    const int num_samples = std::min(16, num_points);
+    const int kth = std::min(k, num_points - 1);  // the sample itself is at 0
+
+    std::vector<float> kth_sq_dists(num_samples);
+    std::vector<float> sq_dists(num_points);
+    for(int s = 0; s < num_samples; s++) {
+      const Eigen::Vector3f query = cloud_->at((static_cast<long>(s) * num_points) / num_samples).getVector3fMap();
+      for(int i = 0; i < num_points; i++) {
+        sq_dists[i] = (cloud_->at(i).getVector3fMap() - query).squaredNorm();
+      }
+      std::nth_element(sq_dists.begin(), sq_dists.begin() + kth, sq_dists.end());
+      kth_sq_dists[s] = sq_dists[kth];
+    }
+
+    std::nth_element(kth_sq_dists.begin(), kth_sq_dists.begin() + num_samples / 2, kth_sq_dists.end());
+    return std::max(std::sqrt(static_cast<double>(kth_sq_dists[num_samples / 2])), 1e-3);
+  }
+
+  const StaticKdTree<PointT>& exact_kdtree() const {
+    std::call_once(*kdtree_once_, [this] {
+      kdtree_.reset(new StaticKdTree<PointT>());
+      kdtree_->setInputCloud(cloud_);
+    });
+    return *kdtree_;
+  }
+
+private:
+  const double resolution_;
+
+  PointCloudConstPtr cloud_;
+  mutable std::unique_ptr<std::once_flag> kdtree_once_;
+  mutable std::unique_ptr<StaticKdTree<PointT>> kdtree_;
+};
+
+template<typename PointT>
+std::shared_ptr<NearestNeighborSearch<PointT>> create_nearest_neighbor_search(NearestNeighborMethod method) {
+  switch(method) {
+    default:
+    case NearestNeighborMethod::PCL_KDTREE:
+      return std::make_shared<PclKdTreeSearch<PointT>>();
+    case NearestNeighborMethod::STATIC_KDTREE:
+      return std::make_shared<StaticKdTree<PointT>>();
+    case NearestNeighborMethod::APPROX_VOXEL_HASH:
+      return std::make_shared<ApproxVoxelNearestNeighborSearch<PointT>>();
+  }
+}
+
+}  // namespace fast_gicp
+
+#endif
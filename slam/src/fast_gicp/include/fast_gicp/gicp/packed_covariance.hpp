@@ -0,0 +1,92 @@
+#ifndef FAST_GICP_PACKED_COVARIANCE_HPP
+#define FAST_GICP_PACKED_COVARIANCE_HPP
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Eigenvalues>
+#include <fast_gicp/gicp/gicp_settings.hpp>
+
+namespace fast_gicp {
+
+/**
+ * @brief Symmetric 3x3 matrix stored as its upper triangle (xx, xy, xz, yy, yz, zz) in single precision
+ */
+using PackedCov3f = Eigen::Matrix<float, 6, 1>;
+using PackedCov3fVector = std::vector<PackedCov3f, Eigen::aligned_allocator<PackedCov3f>>;
+
+inline PackedCov3f pack_cov(const Eigen::Matrix3f& m) {
+  PackedCov3f p;
+  p << m(0, 0), m(0, 1), m(0, 2), m(1, 1), m(1, 2), m(2, 2);
+  return p;
+}
+
+inline Eigen::Matrix3f unpack_cov(const PackedCov3f& p) {
+  Eigen::Matrix3f m;
+  m << p[0], p[1], p[2], p[1], p[3], p[4], p[2], p[4], p[5];
+  return m;
+}
+
+inline void pack_covs(const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>& covs, PackedCov3fVector& packed) {
+  packed.resize(covs.size());
+  for (int i = 0; i < covs.size(); i++) {
+    packed[i] = pack_cov(covs[i].block<3, 3>(0, 0).cast<float>());
+  }
+}
+
+/**
+ * @brief closed form inverse (adjugate / determinant) of a packed symmetric matrix
+ */
+inline PackedCov3f inverse_cov(const PackedCov3f& p) {
+  const float a = p[0], b = p[1], c = p[2], d = p[3], e = p[4], f = p[5];
+
+  const float c00 = d * f - e * e;
+  const float c01 = c * e - b * f;
+  const float c02 = b * e - c * d;
+  const float det = a * c00 + b * c01 + c * c02;
+  const float inv_det = 1.0f / det;
+
+  PackedCov3f inv;
+  inv << c00, c01, c02, a * f - c * c, b * c - a * e, a * d - b * b;
+  return inv * inv_det;
+}
+
+/**
+ * @brief covariance regularization with the closed form 3x3 eigen decomposition (SelfAdjointEigenSolver::computeDirect)
+ *        equivalent to the JacobiSVD based regularization for symmetric positive semi-definite matrices
+ */
+inline Eigen::Matrix3f regularize_cov(const Eigen::Matrix3f& cov, RegularizationMethod method) {
+  if (method == RegularizationMethod::NONE) {
+    return cov;
+  }
+
+  if (method == RegularizationMethod::FROBENIUS) {
+    const float lambda = 1e-3f;
+    Eigen::Matrix3f C_inv = (cov + lambda * Eigen::Matrix3f::Identity()).inverse();
+    return (C_inv / C_inv.norm()).inverse();
+  }
+
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> eig;
+  eig.computeDirect(cov);
+
+  // eigenvalues are in increasing order
+  Eigen::Vector3f values;
+  switch (method) {
+    default:
+    case RegularizationMethod::PLANE:
+      values = Eigen::Vector3f(1e-3f, 1.0f, 1.0f);
+      break;
+    case RegularizationMethod::MIN_EIG:
+      values = eig.eigenvalues().array().max(1e-3f);
+      break;
+    case RegularizationMethod::NORMALIZED_MIN_EIG:
+      values = eig.eigenvalues() / eig.eigenvalues()[2];
+      values = values.array().max(1e-3f);
+      break;
+  }
+
+  return eig.eigenvectors() * values.asDiagonal() * eig.eigenvectors().transpose();
+}
+
+}  // namespace fast_gicp
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef FAST_GICP_TARGET_MODEL_HPP
+#define FAST_GICP_TARGET_MODEL_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace fast_gicp {
+
+/**
+ * @brief Binary format of a serialized target model (FastGICP::saveTargetModel)
+ *
+ *        header   : magic "FGICPTM\0", version (u32), reserved (u32)
+ *        sections : tag (u32), reserved (u32), payload size (u64), payload (see write_target_model() of each registration)
+ *        trailer  : content hash (u64) of all the preceding bytes
+ *
+ *        All values are little endian, arrays are stored field by field without padding.
+ */
+struct TargetModelFormat {
+  static const char* magic() { return "FGICPTM"; }  // 8 bytes with the terminating null
+  static std::uint32_t version() { return 1; }
+
+  enum Section : std::uint32_t {
+    POINTS = 1,  // points and covariances (FastGICP)
+    VOXELS = 2   // gaussian voxel map (FastVGICP)
+  };
+
+  /**
+   * @brief FNV-1a over 64-bit words (the tail is zero padded)
+   */
+  static std::uint64_t hash(const char* data, size_t size) {
+    std::uint64_t h = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+      std::uint64_t word;
+      std::memcpy(&word, data + i, 8);
+      h = (h ^ word) * 1099511628211ull;
+    }
+
+    if (i < size) {
+      std::uint64_t word = 0;
+      std::memcpy(&word, data + i, size - i);
+      h = (h ^ word) * 1099511628211ull;
+    }
+    return h;
+  }
+};
+
+/**
+ * @brief Builds a target model in memory and writes it with the trailing content hash
+ */
+class TargetModelWriter {
+public:
+  TargetModelWriter() : section_begin_(0) {
+    write_array(TargetModelFormat::magic(), 8);
+    write<std::uint32_t>(TargetModelFormat::version());
+    write<std::uint32_t>(0);
+  }
+
+  void begin_section(TargetModelFormat::Section section) {
+    write<std::uint32_t>(section);
+    write<std::uint32_t>(0);
+    write<std::uint64_t>(0);
+    section_begin_ = buffer_.size();
+  }
+
+  void end_section() {
+    const std::uint64_t payload_size = buffer_.size() - section_begin_;
+    std::memcpy(buffer_.data() + section_begin_ - sizeof(payload_size), &payload_size, sizeof(payload_size));
+  }
+
+  template<typename T>
+  void write(const T& value) {
+    write_array(&value, 1);
+  }
+
+  template<typename T>
+  void write_array(const T* values, size_t num_values) {
+    const char* bytes = reinterpret_cast<const char*>(values);
+    buffer_.insert(buffer_.end(), bytes, bytes + sizeof(T) * num_values);
+  }
+
+  bool save(const std::string& filename) const {
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs) {
+      std::cerr << "error: failed to open " << filename << std::endl;
+      return false;
+    }
+
+    const std::uint64_t hash = TargetModelFormat::hash(buffer_.data(), buffer_.size());
+    ofs.write(buffer_.data(), buffer_.size());
+    ofs.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+    return static_cast<bool>(ofs);
+  }
+
+private:
+  std::vector<char> buffer_;
+  size_t section_begin_;
+};
+
+/**
+ * @brief Reads a target model from a memory mapped file
+ *        open() validates the magic, version and content hash, the read functions fail (return false) past the end of the file
+ */
+class TargetModelReader {
+public:
+  TargetModelReader() : data_(nullptr), size_(0), cursor_(0) {}
+  ~TargetModelReader() {
+    if (data_) {
+      munmap(const_cast<char*>(data_), size_ + sizeof(std::uint64_t));
+    }
+  }
+
+  TargetModelReader(const TargetModelReader&) = delete;
+  TargetModelReader& operator=(const TargetModelReader&) = delete;
+
+  bool open(const std::string& filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "error: failed to open " << filename << std::endl;
+      return false;
+    }
+
+    struct stat st;
+    const size_t header_size = 16;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < header_size + sizeof(std::uint64_t)) {
+      std::cerr << "error: " << filename << " is not a target model" << std::endl;
+      ::close(fd);
+      return false;
+    }
+
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+      std::cerr << "error: failed to map " << filename << std::endl;
+      return false;
+    }
+    madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+
+    data_ = static_cast<const char*>(mapped);
+    size_ = st.st_size - sizeof(std::uint64_t);
+    cursor_ = 0;
+
+    char magic[8];
+    std::uint32_t version, reserved;
+    if (!read_array(magic, 8) || std::memcmp(magic, TargetModelFormat::magic(), 8) != 0 || !read(version) || !read(reserved)) {
+      std::cerr << "error: " << filename << " is not a target model" << std::endl;
+      return false;
+    }
+    if (version != TargetModelFormat::version()) {
+      std::cerr << "error: unsupported target model version " << version << " (" << filename << ")" << std::endl;
+      return false;
+    }
+
+    std::uint64_t hash;
+    std::memcpy(&hash, data_ + size_, sizeof(hash));
+    if (hash != TargetModelFormat::hash(data_, size_)) {
+      std::cerr << "error: content hash mismatch (" << filename << " is corrupted)" << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief read the next section header
+   * @return false if there are no more sections
+   */
+  bool next_section(TargetModelFormat::Section& section, std::uint64_t& payload_size) {
+    std::uint32_t tag, reserved;
+    if (!read(tag) || !read(reserved) || !read(payload_size)) {
+      return false;
+    }
+    section = static_cast<TargetModelFormat::Section>(tag);
+    return true;
+  }
+
+  /**
+   * @brief skip the payload of a section that is not used by the reader
+   */
+  bool skip(std::uint64_t bytes) {
+    if (bytes > size_ - cursor_) {
+      return false;
+    }
+    cursor_ += bytes;
+    return true;
+  }
+
+  template<typename T>
+  bool read(T& value) {
+    return read_array(&value, 1);
+  }
+
+  template<typename T>
+  bool read_array(T* values, size_t num_values) {
+    if (num_values > (size_ - cursor_) / sizeof(T)) {
+      return false;
+    }
+
+    const size_t bytes = sizeof(T) * num_values;
+
+    std::memcpy(values, data_ + cursor_, bytes);
+    cursor_ += bytes;
+    return true;
+  }
+
+private:
+  const char* data_;
+  size_t size_;  // excluding the trailing hash
+  size_t cursor_;
+};
+
+}  // namespace fast_gicp
+
+#endif
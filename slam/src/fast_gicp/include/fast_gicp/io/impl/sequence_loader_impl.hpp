@@ -0,0 +1,280 @@
+#ifndef FAST_GICP_SEQUENCE_LOADER_IMPL_HPP
+#define FAST_GICP_SEQUENCE_LOADER_IMPL_HPP
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include <pcl/io/pcd_io.h>
+#include <fast_gicp/io/sequence_loader.hpp>
+
+namespace fast_gicp {
+
+template <typename PointT>
+inline void set_sequence_intensity(PointT& pt, float intensity) {}
+
+inline void set_sequence_intensity(pcl::PointXYZI& pt, float intensity) {
+  pt.intensity = intensity;
+}
+
+template <typename PointT>
+SequenceLoader<PointT>::BufferPool::~BufferPool() {
+  for (auto buffer : buffers) {
+    delete buffer;
+  }
+}
+
+template <typename PointT>
+SequenceLoader<PointT>::SequenceLoader(const std::string& path, SequenceFormat format, int queue_size)
+: format_(format),
+  queue_size_(std::max(queue_size, 1)),
+  pool_(new BufferPool),
+  next_index_(0),
+  prefetching_(false),
+  stop_requested_(false) {
+  list_files(path);
+
+  if (filenames_.empty()) {
+    std::cerr << "error: no files in " << path << std::endl;
+  }
+}
+
+template <typename PointT>
+SequenceLoader<PointT>::~SequenceLoader() {
+  stop();
+}
+
+template <typename PointT>
+void SequenceLoader<PointT>::list_files(const std::string& path) {
+  if (format_ == SequenceFormat::KITTI_BIN) {
+    char filename[4096];
+    for (int i = 0;; i++) {
+      snprintf(filename, sizeof(filename), "%s/%06d.bin", path.c_str(), i);
+
+      struct stat st;
+      if (stat(filename, &st) != 0) {
+        break;
+      }
+      filenames_.push_back(filename);
+    }
+    return;
+  }
+
+  const std::string extension = format_ == SequenceFormat::PCD ? ".pcd" : ".bin";
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    return;
+  }
+
+  for (struct dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+    const std::string name = entry->d_name;
+    if (name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0) {
+      filenames_.push_back(path + "/" + name);
+    }
+  }
+  closedir(dir);
+
+  std::sort(filenames_.begin(), filenames_.end());
+}
+
+template <typename PointT>
+typename SequenceLoader<PointT>::PointCloudPtr SequenceLoader<PointT>::allocate() {
+  PointCloud* buffer = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(pool_->mutex);
+    if (!pool_->buffers.empty()) {
+      buffer = pool_->buffers.back();
+      pool_->buffers.pop_back();
+    }
+  }
+
+  if (buffer == nullptr) {
+    buffer = new PointCloud;
+  }
+
+  // the buffer returns to the pool when the last reference is released (the pool outlives the loader if needed)
+  std::shared_ptr<BufferPool> pool = pool_;
+  const size_t max_buffers = queue_size_ + 2;
+  return PointCloudPtr(buffer, [pool, max_buffers](PointCloud* buffer) {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    if (pool->buffers.size() >= max_buffers) {
+      delete buffer;
+      return;
+    }
+    pool->buffers.push_back(buffer);
+  });
+}
+
+template <typename PointT>
+bool SequenceLoader<PointT>::load_bin(const std::string& filename, size_t header_bytes, PointCloud& cloud, uint64_t& stamp) const {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < header_bytes) {
+    close(fd);
+    return false;
+  }
+
+  const size_t file_size = st.st_size;
+  const size_t num_points = (file_size - header_bytes) / (sizeof(float) * 4);
+  cloud.resize(num_points);
+  if (file_size == 0) {
+    close(fd);
+    return true;
+  }
+
+  void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  madvise(mapped, file_size, MADV_SEQUENTIAL);
+  madvise(mapped, file_size, MADV_WILLNEED);
+
+  const char* bytes = static_cast<const char*>(mapped);
+  if (header_bytes >= 16) {
+    std::memcpy(&stamp, bytes + 8, sizeof(uint64_t));
+  }
+
+  const char* points = bytes + header_bytes;
+  for (size_t i = 0; i < num_points; i++) {
+    float xyzi[4];
+    std::memcpy(xyzi, points + i * sizeof(xyzi), sizeof(xyzi));
+
+    auto& pt = cloud.at(i);
+    pt.x = xyzi[0];
+    pt.y = xyzi[1];
+    pt.z = xyzi[2];
+    set_sequence_intensity(pt, xyzi[3]);
+  }
+
+  munmap(mapped, file_size);
+  return true;
+}
+
+template <typename PointT>
+bool SequenceLoader<PointT>::load(size_t i, Frame& frame) {
+  frame.index = i;
+  frame.stamp = 0.0;
+  frame.cloud = allocate();
+
+  const std::string& filename = filenames_[i];
+  uint64_t stamp = 0;
+  bool loaded = false;
+
+  switch (format_) {
+    case SequenceFormat::KITTI_BIN:
+      loaded = load_bin(filename, 0, *frame.cloud, stamp);
+      frame.stamp = i;
+      break;
+    case SequenceFormat::RECORDED_BIN:
+      loaded = load_bin(filename, 16, *frame.cloud, stamp);
+      frame.cloud->header.stamp = stamp;
+      frame.stamp = stamp * 1e-6;
+      break;
+    case SequenceFormat::PCD: {
+      loaded = pcl::io::loadPCDFile(filename, *frame.cloud) == 0;
+      const std::string name = filename.substr(filename.find_last_of('/') + 1);
+      frame.stamp = std::atof(name.substr(0, name.size() - 4).c_str());
+    } break;
+  }
+
+  if (!loaded) {
+    std::cerr << "error: failed to load " << filename << std::endl;
+    frame.cloud.reset();
+  }
+  return loaded;
+}
+
+template <typename PointT>
+void SequenceLoader<PointT>::seek(size_t first) {
+  stop();
+
+  next_index_ = first;
+  stop_requested_ = false;
+  prefetching_ = true;
+  prefetch_thread_ = std::thread([this, first] { prefetch_loop(first); });
+}
+
+template <typename PointT>
+bool SequenceLoader<PointT>::next(Frame& frame) {
+  if (!prefetching_) {
+    seek(next_index_);
+  }
+
+  if (next_index_ >= filenames_.size()) {
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  queue_cond_.wait(lock, [this] { return !queue_.empty(); });
+  frame = queue_.front();
+  queue_.pop_front();
+  next_index_++;
+  lock.unlock();
+  queue_cond_.notify_all();
+
+  if (frame.cloud == nullptr) {
+    // the prefetch thread stops at a failed frame, the next call restarts it after the failed frame
+    stop();
+    return false;
+  }
+  return true;
+}
+
+template <typename PointT>
+void SequenceLoader<PointT>::prefetch_loop(size_t first) {
+  for (size_t i = first; i < filenames_.size(); i++) {
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      queue_cond_.wait(lock, [this] { return stop_requested_ || queue_.size() < static_cast<size_t>(queue_size_); });
+      if (stop_requested_) {
+        return;
+      }
+    }
+
+    Frame frame;
+    const bool loaded = load(i, frame);
+
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      queue_.push_back(frame);
+    }
+    queue_cond_.notify_all();
+
+    if (!loaded) {
+      return;
+    }
+  }
+}
+
+template <typename PointT>
+void SequenceLoader<PointT>::stop() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stop_requested_ = true;
+  }
+  queue_cond_.notify_all();
+
+  if (prefetch_thread_.joinable()) {
+    prefetch_thread_.join();
+  }
+
+  prefetching_ = false;
+  queue_.clear();
+}
+
+}  // namespace fast_gicp
+
+#endif
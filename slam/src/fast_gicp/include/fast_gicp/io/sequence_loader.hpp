@@ -0,0 +1,100 @@
+#ifndef FAST_GICP_SEQUENCE_LOADER_HPP
+#define FAST_GICP_SEQUENCE_LOADER_HPP
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <condition_variable>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+namespace fast_gicp {
+
+enum class SequenceFormat {
+  KITTI_BIN,     // <dir>/%06d.bin, x y z intensity floats per point
+  PCD,           // <dir>/*.pcd sorted by name, the file name is the stamp in seconds (e.g., 1700000000.100000.pcd)
+  RECORDED_BIN   // <dir>/*.bin sorted by name, seq (4 bytes) + padding (4 bytes) + stamp in us (8 bytes), then x y z intensity floats per point
+};
+
+/**
+ * @brief Point cloud sequence loader with a bounded prefetch queue
+ *        Frames are loaded ahead on a background thread (binary frames are parsed directly from memory mapped files)
+ *        so that the consumer measures registration rather than disk I/O.
+ *        Point cloud buffers are recycled once the consumer releases them, so steady state loading does not allocate.
+ */
+template<typename PointT>
+class SequenceLoader {
+public:
+  using PointCloud = pcl::PointCloud<PointT>;
+  using PointCloudPtr = typename PointCloud::Ptr;
+
+  struct Frame {
+    size_t index;
+    double stamp;  // [sec], the frame index for KITTI
+    PointCloudPtr cloud;
+  };
+
+  /**
+   * @param path        sequence directory
+   * @param format      file format
+   * @param queue_size  maximum number of frames loaded ahead
+   */
+  SequenceLoader(const std::string& path, SequenceFormat format, int queue_size = 8);
+  ~SequenceLoader();
+
+  size_t size() const { return filenames_.size(); }
+  const std::string& filename(size_t i) const { return filenames_[i]; }
+
+  /**
+   * @brief load a frame synchronously (random access, does not use the prefetch queue)
+   */
+  bool load(size_t i, Frame& frame);
+
+  /**
+   * @brief (re)start prefetching from the given frame
+   */
+  void seek(size_t first);
+
+  /**
+   * @brief next frame in the order of the sequence, blocks until it is loaded
+   * @return false at the end of the sequence
+   */
+  bool next(Frame& frame);
+
+private:
+  void list_files(const std::string& path);
+  void prefetch_loop(size_t first);
+  void stop();
+
+  PointCloudPtr allocate();
+  bool load_bin(const std::string& filename, size_t header_bytes, PointCloud& cloud, uint64_t& stamp) const;
+
+private:
+  const SequenceFormat format_;
+  const int queue_size_;
+  std::vector<std::string> filenames_;
+
+  // recycled point cloud buffers, shared with the deleters of the handed out clouds
+  struct BufferPool {
+    std::mutex mutex;
+    std::vector<PointCloud*> buffers;
+    ~BufferPool();
+  };
+  std::shared_ptr<BufferPool> pool_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cond_;
+  std::deque<Frame> queue_;  // loaded frames in order (a frame with a null cloud marks a load failure)
+  size_t next_index_;        // index of the next frame returned by next()
+  bool prefetching_;
+  bool stop_requested_;
+  std::thread prefetch_thread_;
+};
+
+}  // namespace fast_gicp
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef FAST_GICP_FAST_NDT_HPP
+#define FAST_GICP_FAST_NDT_HPP
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/registration/registration.h>
+#include <fast_gicp/gicp/lsq_registration.hpp>
+#include <fast_gicp/gicp/gicp_settings.hpp>
+#include <fast_gicp/gicp/fast_vgicp_voxel.hpp>
+#include <fast_gicp/ndt/ndt_settings.hpp>
+
+namespace fast_gicp {
+
+/**
+ * @brief CPU NDT (P2D and D2D) optimized with Gauss-Newton / LM and OpenMP
+ *        same formulation as NDTCuda: Mahalanobis distances to the target voxel distributions weighted by a Cauchy kernel
+ */
+template<typename PointSource, typename PointTarget>
+class FastNDT : public LsqRegistration<PointSource, PointTarget> {
+public:
+  using Scalar = float;
+  using Matrix4 = typename pcl::Registration<PointSource, PointTarget, Scalar>::Matrix4;
+
+  using PointCloudSource = typename pcl::Registration<PointSource, PointTarget, Scalar>::PointCloudSource;
+  using PointCloudSourcePtr = typename PointCloudSource::Ptr;
+  using PointCloudSourceConstPtr = typename PointCloudSource::ConstPtr;
+
+  using PointCloudTarget = typename pcl::Registration<PointSource, PointTarget, Scalar>::PointCloudTarget;
+  using PointCloudTargetPtr = typename PointCloudTarget::Ptr;
+  using PointCloudTargetConstPtr = typename PointCloudTarget::ConstPtr;
+
+#if PCL_VERSION >= PCL_VERSION_CALC(1, 10, 0)
+  using Ptr = pcl::shared_ptr<FastNDT<PointSource, PointTarget>>;
+  using ConstPtr = pcl::shared_ptr<const FastNDT<PointSource, PointTarget>>;
+#else
+  using Ptr = boost::shared_ptr<FastNDT<PointSource, PointTarget>>;
+  using ConstPtr = boost::shared_ptr<const FastNDT<PointSource, PointTarget>>;
+#endif
+
+protected:
+  using pcl::Registration<PointSource, PointTarget, Scalar>::reg_name_;
+  using pcl::Registration<PointSource, PointTarget, Scalar>::input_;
+  using pcl::Registration<PointSource, PointTarget, Scalar>::target_;
+
+public:
+  FastNDT();
+  virtual ~FastNDT() override;
+
+  void setNumThreads(int n);
+  void setDistanceMode(NDTDistanceMode mode);
+  void setResolution(double resolution);
+  void setNeighborSearchMethod(NeighborSearchMethod method);
+
+  virtual void swapSourceAndTarget() override;
+  virtual void clearSource() override;
+  virtual void clearTarget() override;
+
+  virtual void setInputSource(const PointCloudSourceConstPtr& cloud) override;
+  virtual void setInputTarget(const PointCloudTargetConstPtr& cloud) override;
+
+protected:
+  virtual void computeTransformation(PointCloudSource& output, const Matrix4& guess) override;
+  virtual double linearize(const Eigen::Isometry3d& trans, Eigen::Matrix<double, 6, 6>* H, Eigen::Matrix<double, 6, 1>* b) override;
+  virtual double compute_error(const Eigen::Isometry3d& trans) override;
+
+  void create_voxelmaps();
+  virtual void update_correspondences(const Eigen::Isometry3d& trans);
+
+  // source point (P2D) or source voxel mean (D2D)
+  Eigen::Vector4d source_mean(int i) const;
+
+protected:
+  int num_threads_;
+  double resolution_;
+  NeighborSearchMethod search_method_;
+  NDTDistanceMode distance_mode_;
+
+  std::unique_ptr<GaussianVoxelMap<PointSource>> source_voxelmap_;  // D2D only
+  std::unique_ptr<GaussianVoxelMap<PointTarget>> target_voxelmap_;
+  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> target_inv_covs_;
+
+  std::vector<std::pair<int, int>> correspondences_;  // (source point or voxel index, target voxel index)
+  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> mahalanobis_;  // D2D only
+};
+}  // namespace fast_gicp
+
+#endif
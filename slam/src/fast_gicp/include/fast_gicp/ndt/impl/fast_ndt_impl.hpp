@@ -0,0 +1,269 @@
+#ifndef FAST_GICP_FAST_NDT_IMPL_HPP
+#define FAST_GICP_FAST_NDT_IMPL_HPP
+
+#include <fast_gicp/so3/so3.hpp>
+#include <fast_gicp/ndt/fast_ndt.hpp>
+
+namespace fast_gicp {
+
+// voxels with fewer points do not have a meaningful distribution (same threshold as NDTCuda)
+constexpr int ndt_min_voxel_points = 7;
+
+inline double ndt_cauchy(double k, double x) {
+  double k_sq = k * k;
+  return k_sq / (k_sq + x * x);
+}
+
+template <typename PointSource, typename PointTarget>
+FastNDT<PointSource, PointTarget>::FastNDT() : LsqRegistration<PointSource, PointTarget>() {
+#ifdef _OPENMP
+  num_threads_ = omp_get_max_threads();
+#else
+  num_threads_ = 1;
+#endif
+
+  reg_name_ = "FastNDT";
+  resolution_ = 1.0;
+  search_method_ = NeighborSearchMethod::DIRECT7;
+  distance_mode_ = NDTDistanceMode::D2D;
+}
+
+template <typename PointSource, typename PointTarget>
+FastNDT<PointSource, PointTarget>::~FastNDT() {}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::setNumThreads(int n) {
+  num_threads_ = n;
+
+#ifdef _OPENMP
+  if (n == 0) {
+    num_threads_ = omp_get_max_threads();
+  }
+#endif
+}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::setDistanceMode(NDTDistanceMode mode) {
+  distance_mode_ = mode;
+}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::setResolution(double resolution) {
+  if (resolution_ != resolution) {
+    source_voxelmap_.reset();
+    target_voxelmap_.reset();
+  }
+  resolution_ = resolution;
+}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::setNeighborSearchMethod(NeighborSearchMethod method) {
+  search_method_ = method;
+}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::swapSourceAndTarget() {
+  input_.swap(target_);
+  source_voxelmap_.reset();
+  target_voxelmap_.reset();
+  correspondences_.clear();
+  mahalanobis_.clear();
+}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::clearSource() {
+  input_.reset();
+  source_voxelmap_.reset();
+}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::clearTarget() {
+  target_.reset();
+  target_voxelmap_.reset();
+}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::setInputSource(const PointCloudSourceConstPtr& cloud) {
+  if (input_ == cloud) {
+    return;
+  }
+
+  pcl::Registration<PointSource, PointTarget, Scalar>::setInputSource(cloud);
+  source_voxelmap_.reset();
+}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::setInputTarget(const PointCloudTargetConstPtr& cloud) {
+  if (target_ == cloud) {
+    return;
+  }
+
+  pcl::Registration<PointSource, PointTarget, Scalar>::setInputTarget(cloud);
+  target_voxelmap_.reset();
+}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::computeTransformation(PointCloudSource& output, const Matrix4& guess) {
+  create_voxelmaps();
+  LsqRegistration<PointSource, PointTarget>::computeTransformation(output, guess);
+}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::create_voxelmaps() {
+  if (distance_mode_ == NDTDistanceMode::D2D && source_voxelmap_ == nullptr) {
+    source_voxelmap_.reset(new GaussianVoxelMap<PointSource>(resolution_, VoxelAccumulationMode::ADDITIVE));
+    source_voxelmap_->create_voxelmap(*input_, num_threads_);
+  }
+
+  if (target_voxelmap_ == nullptr) {
+    target_voxelmap_.reset(new GaussianVoxelMap<PointTarget>(resolution_, VoxelAccumulationMode::ADDITIVE));
+    target_voxelmap_->create_voxelmap(*target_, num_threads_);
+
+    // inverse covariances for P2D
+    target_inv_covs_.resize(target_voxelmap_->size());
+#pragma omp parallel for num_threads(num_threads_) schedule(guided, 8)
+    for (int i = 0; i < target_voxelmap_->size(); i++) {
+      Eigen::Matrix4d cov = target_voxelmap_->cov(i);
+      cov(3, 3) = 1.0;
+      target_inv_covs_[i] = cov.inverse();
+      target_inv_covs_[i](3, 3) = 0.0;
+    }
+  }
+}
+
+template <typename PointSource, typename PointTarget>
+Eigen::Vector4d FastNDT<PointSource, PointTarget>::source_mean(int i) const {
+  if (distance_mode_ == NDTDistanceMode::D2D) {
+    return source_voxelmap_->mean(i);
+  }
+  return input_->at(i).getVector4fMap().template cast<double>();
+}
+
+template <typename PointSource, typename PointTarget>
+void FastNDT<PointSource, PointTarget>::update_correspondences(const Eigen::Isometry3d& trans) {
+  correspondences_.clear();
+  auto offsets = neighbor_offsets(search_method_);
+
+  const int num_sources = distance_mode_ == NDTDistanceMode::D2D ? source_voxelmap_->size() : input_->size();
+
+  std::vector<std::vector<std::pair<int, int>>> corrs(num_threads_);
+  for (auto& c : corrs) {
+    c.reserve((num_sources * offsets.size()) / num_threads_);
+  }
+
+#pragma omp parallel for num_threads(num_threads_) schedule(guided, 8)
+  for (int i = 0; i < num_sources; i++) {
+    Eigen::Vector4d transed_mean_A = trans * source_mean(i);
+    Eigen::Vector3i coord = target_voxelmap_->voxel_coord(transed_mean_A);
+
+    for (const auto& offset : offsets) {
+      int voxel = target_voxelmap_->lookup_voxel(coord + offset);
+      if (voxel >= 0 && target_voxelmap_->num_points(voxel) >= ndt_min_voxel_points) {
+        corrs[omp_get_thread_num()].push_back(std::make_pair(i, voxel));
+      }
+    }
+  }
+
+  correspondences_.reserve(num_sources * offsets.size());
+  for (const auto& c : corrs) {
+    correspondences_.insert(correspondences_.end(), c.begin(), c.end());
+  }
+
+  if (distance_mode_ == NDTDistanceMode::P2D) {
+    return;
+  }
+
+  // D2D: combined covariances are evaluated at the linearization point
+  mahalanobis_.resize(correspondences_.size());
+
+#pragma omp parallel for num_threads(num_threads_) schedule(guided, 8)
+  for (int i = 0; i < correspondences_.size(); i++) {
+    const auto& corr = correspondences_[i];
+    const auto& cov_A = source_voxelmap_->cov(corr.first);
+    const auto& cov_B = target_voxelmap_->cov(corr.second);
+
+    Eigen::Matrix4d RCR = cov_B + trans.matrix() * cov_A * trans.matrix().transpose();
+    RCR(3, 3) = 1.0;
+
+    mahalanobis_[i] = RCR.inverse();
+    mahalanobis_[i](3, 3) = 0.0;
+  }
+}
+
+template <typename PointSource, typename PointTarget>
+double FastNDT<PointSource, PointTarget>::linearize(const Eigen::Isometry3d& trans, Eigen::Matrix<double, 6, 6>* H, Eigen::Matrix<double, 6, 1>* b) {
+  // no-op if the voxel maps are up to date (they are created in computeTransformation, but evaluateCost() can be called directly)
+  create_voxelmaps();
+  update_correspondences(trans);
+
+  double sum_errors = 0.0;
+  std::vector<Eigen::Matrix<double, 6, 6>, Eigen::aligned_allocator<Eigen::Matrix<double, 6, 6>>> Hs(num_threads_);
+  std::vector<Eigen::Matrix<double, 6, 1>, Eigen::aligned_allocator<Eigen::Matrix<double, 6, 1>>> bs(num_threads_);
+  for (int i = 0; i < num_threads_; i++) {
+    Hs[i].setZero();
+    bs[i].setZero();
+  }
+
+#pragma omp parallel for num_threads(num_threads_) reduction(+ : sum_errors) schedule(guided, 8)
+  for (int i = 0; i < correspondences_.size(); i++) {
+    const auto& corr = correspondences_[i];
+    const Eigen::Matrix4d& mahalanobis = distance_mode_ == NDTDistanceMode::D2D ? mahalanobis_[i] : target_inv_covs_[corr.second];
+
+    const Eigen::Vector4d transed_mean_A = trans * source_mean(corr.first);
+    const Eigen::Vector4d error = target_voxelmap_->mean(corr.second) - transed_mean_A;
+
+    // Gaussian + uniform likelihood is approximated with a Cauchy kernel as in NDTCuda
+    double w = ndt_cauchy(resolution_, error.norm());
+    sum_errors += w * error.transpose() * mahalanobis * error;
+
+    if (H == nullptr || b == nullptr) {
+      continue;
+    }
+
+    Eigen::Matrix<double, 4, 6> dtdx0 = Eigen::Matrix<double, 4, 6>::Zero();
+    dtdx0.block<3, 3>(0, 0) = skewd(transed_mean_A.head<3>());
+    dtdx0.block<3, 3>(0, 3) = -Eigen::Matrix3d::Identity();
+
+    Eigen::Matrix<double, 4, 6> jlossexp = dtdx0;
+
+    Eigen::Matrix<double, 6, 6> Hi = w * jlossexp.transpose() * mahalanobis * jlossexp;
+    Eigen::Matrix<double, 6, 1> bi = w * jlossexp.transpose() * mahalanobis * error;
+
+    int thread_num = omp_get_thread_num();
+    Hs[thread_num] += Hi;
+    bs[thread_num] += bi;
+  }
+
+  if (H && b) {
+    H->setZero();
+    b->setZero();
+    for (int i = 0; i < num_threads_; i++) {
+      (*H) += Hs[i];
+      (*b) += bs[i];
+    }
+  }
+
+  return sum_errors;
+}
+
+template <typename PointSource, typename PointTarget>
+double FastNDT<PointSource, PointTarget>::compute_error(const Eigen::Isometry3d& trans) {
+  double sum_errors = 0.0;
+#pragma omp parallel for num_threads(num_threads_) reduction(+ : sum_errors)
+  for (int i = 0; i < correspondences_.size(); i++) {
+    const auto& corr = correspondences_[i];
+    const Eigen::Matrix4d& mahalanobis = distance_mode_ == NDTDistanceMode::D2D ? mahalanobis_[i] : target_inv_covs_[corr.second];
+
+    const Eigen::Vector4d transed_mean_A = trans * source_mean(corr.first);
+    const Eigen::Vector4d error = target_voxelmap_->mean(corr.second) - transed_mean_A;
+
+    double w = ndt_cauchy(resolution_, error.norm());
+    sum_errors += w * error.transpose() * mahalanobis * error;
+  }
+
+  return sum_errors;
+}
+
+}  // namespace fast_gicp
+
+#endif
@@ -11,7 +11,9 @@
 #include <pcl/registration/gicp.h>
 #include <fast_gicp/gicp/fast_gicp.hpp>
 #include <fast_gicp/gicp/fast_gicp_st.hpp>
+#include <fast_gicp/gicp/fast_gicp_mp.hpp>
 #include <fast_gicp/gicp/fast_vgicp.hpp>
+#include <fast_gicp/ndt/fast_ndt.hpp>
 
 #ifdef USE_VGICP_CUDA
 #include <fast_gicp/ndt/ndt_cuda.hpp>
@@ -167,6 +169,24 @@ int main(int argc, char** argv) {
   // fgicp_mt.setNumThreads(8);
   test(fgicp_mt, target_cloud, source_cloud);
 
+  std::cout << "--- fgicp_mt (float) ---" << std::endl;
+  fgicp_mt.setComputePrecision(fast_gicp::ComputePrecision::FLOAT);
+  test(fgicp_mt, target_cloud, source_cloud);
+  fgicp_mt.setComputePrecision(fast_gicp::ComputePrecision::DOUBLE);
+
+  std::cout << "--- fgicp_mt (static kdtree) ---" << std::endl;
+  fgicp_mt.setNearestNeighborMethod(fast_gicp::NearestNeighborMethod::STATIC_KDTREE);
+  test(fgicp_mt, target_cloud, source_cloud);
+
+  std::cout << "--- fgicp_mt (approx knn) ---" << std::endl;
+  fgicp_mt.setNearestNeighborMethod(fast_gicp::NearestNeighborMethod::APPROX_VOXEL_HASH);
+  test(fgicp_mt, target_cloud, source_cloud);
+
+  std::cout << "--- fgicp_mp ---" << std::endl;
+  fast_gicp::FastGICPMultiPoints<pcl::PointXYZ, pcl::PointXYZ> fgicp_mp;
+  fgicp_mp.setMaxCorrespondenceDistance(1.0);
+  test(fgicp_mp, target_cloud, source_cloud);
+
   std::cout << "--- vgicp_st ---" << std::endl;
   fast_gicp::FastVGICP<pcl::PointXYZ, pcl::PointXYZ> vgicp;
   vgicp.setResolution(1.0);
@@ -177,6 +197,16 @@ int main(int argc, char** argv) {
   vgicp.setNumThreads(omp_get_max_threads());
   test(vgicp, target_cloud, source_cloud);
 
+  std::cout << "--- fndt_mt (P2D) ---" << std::endl;
+  fast_gicp::FastNDT<pcl::PointXYZ, pcl::PointXYZ> fndt;
+  fndt.setResolution(1.0);
+  fndt.setDistanceMode(fast_gicp::NDTDistanceMode::P2D);
+  test(fndt, target_cloud, source_cloud);
+
+  std::cout << "--- fndt_mt (D2D) ---" << std::endl;
+  fndt.setDistanceMode(fast_gicp::NDTDistanceMode::D2D);
+  test(fndt, target_cloud, source_cloud);
+
 #ifdef USE_VGICP_CUDA
   std::cout << "--- ndt_cuda (P2D) ---" << std::endl;
   fast_gicp::NDTCuda<pcl::PointXYZ, pcl::PointXYZ> ndt_cuda;
@@ -0,0 +1,330 @@
+// google benchmark suite for fast_gicp
+//
+// usage: gicp_bench [--benchmark_filter=regex] [--benchmark_out=result.json --benchmark_out_format=json] [data_directory]
+//
+// Benchmarks are named BM_Align/method:<n>/threads:<n>/points:<n>/resolution_cm:<n>/nn:<n>
+//   method         0: GICP, 1: GICP_ST, 2: VGICP, 3: NDT_P2D, 4: NDT_D2D, 5: GICP_MP (also shown as the label)
+//   points         0: the bundled clouds in data_directory (default: data), otherwise a synthetic scene with the given number of points
+//   resolution_cm  voxel resolution of VGICP and NDT
+//   nn             fast_gicp::NearestNeighborMethod of GICP, GICP_MP and VGICP
+// Each iteration is a cold alignment (covariances, kd-trees and voxel maps are rebuilt).
+// Per-phase times [ms per alignment] are reported as counters:
+//   covariance      covariance estimation and voxel map creation
+//   correspondence  update_correspondences()
+//   linearize       linearize() excluding the correspondence search
+//   error           compute_error()
+//   solve           the rest of the optimization (linear solver, LM bookkeeping, output transformation)
+
+#include <map>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <benchmark/benchmark.h>
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/common/transforms.h>
+#include <pcl/filters/approximate_voxel_grid.h>
+
+#include <fast_gicp/gicp/fast_gicp.hpp>
+#include <fast_gicp/gicp/fast_gicp_st.hpp>
+#include <fast_gicp/gicp/fast_gicp_mp.hpp>
+#include <fast_gicp/gicp/fast_vgicp.hpp>
+#include <fast_gicp/ndt/fast_ndt.hpp>
+
+using PointT = pcl::PointXYZ;
+using Cloud = pcl::PointCloud<PointT>;
+
+static std::string data_directory = "data";
+
+/**
+ * @brief registration with per-phase timers
+ */
+template <typename Registration>
+class PhaseTimedRegistration : public Registration {
+public:
+  using Clock = std::chrono::steady_clock;
+  using PointCloudSource = typename Registration::PointCloudSource;
+  using Matrix4 = typename Registration::Matrix4;
+
+  PhaseTimedRegistration() { reset(); }
+
+  void reset() { covariance = correspondence = linearization = error = total = 0.0; }
+
+  int lsqIterations() const { return this->nr_iterations_ + 1; }
+
+  double covariance;
+  double correspondence;
+  double linearization;
+  double error;
+  double total;
+
+protected:
+  static double elapsed_ms(const Clock::time_point& t1, const Clock::time_point& t2) { return std::chrono::duration<double, std::milli>(t2 - t1).count(); }
+
+  virtual void computeTransformation(PointCloudSource& output, const Matrix4& guess) override {
+    auto t1 = Clock::now();
+    estimate_distributions(static_cast<Registration*>(this));
+    auto t2 = Clock::now();
+    Registration::computeTransformation(output, guess);
+    auto t3 = Clock::now();
+
+    covariance += elapsed_ms(t1, t2);
+    total += elapsed_ms(t1, t3);
+  }
+
+  virtual void update_correspondences(const Eigen::Isometry3d& trans) override {
+    auto t1 = Clock::now();
+    Registration::update_correspondences(trans);
+    correspondence += elapsed_ms(t1, Clock::now());
+  }
+
+  virtual double linearize(const Eigen::Isometry3d& trans, Eigen::Matrix<double, 6, 6>* H, Eigen::Matrix<double, 6, 1>* b) override {
+    const double correspondence_before = correspondence;
+    auto t1 = Clock::now();
+    double e = Registration::linearize(trans, H, b);
+    linearization += elapsed_ms(t1, Clock::now()) - (correspondence - correspondence_before);
+    return e;
+  }
+
+  virtual double compute_error(const Eigen::Isometry3d& trans) override {
+    auto t1 = Clock::now();
+    double e = Registration::compute_error(trans);
+    error += elapsed_ms(t1, Clock::now());
+    return e;
+  }
+
+  // the lazily created structures are built here so that they are not counted in the other phases
+  void estimate_distributions(fast_gicp::FastGICP<PointT, PointT>*) {
+    this->update_source_covariances();
+    this->update_target_covariances();
+  }
+
+  void estimate_distributions(fast_gicp::FastVGICP<PointT, PointT>* vgicp) {
+    estimate_distributions(static_cast<fast_gicp::FastGICP<PointT, PointT>*>(vgicp));
+    this->create_voxelmap();
+  }
+
+  void estimate_distributions(fast_gicp::FastNDT<PointT, PointT>*) { this->create_voxelmaps(); }
+};
+
+enum Method { GICP, GICP_ST, VGICP, NDT_P2D, NDT_D2D, GICP_MP };
+static const char* method_names[] = {"GICP", "GICP_ST", "VGICP", "NDT_P2D", "NDT_D2D", "GICP_MP"};
+
+struct CloudPair {
+  Cloud::ConstPtr target;
+  Cloud::ConstPtr source;
+};
+
+// ground, walls and boxes sampled uniformly over the surface area
+static Cloud::Ptr synthetic_scene(int num_points, std::mt19937& mt) {
+  struct Face {
+    Eigen::Vector3f origin;
+    Eigen::Vector3f u;
+    Eigen::Vector3f v;
+  };
+
+  std::vector<Face> faces;
+  faces.push_back({Eigen::Vector3f(-20.0f, -20.0f, 0.0f), Eigen::Vector3f(40.0f, 0.0f, 0.0f), Eigen::Vector3f(0.0f, 40.0f, 0.0f)});
+  faces.push_back({Eigen::Vector3f(-20.0f, -20.0f, 0.0f), Eigen::Vector3f(40.0f, 0.0f, 0.0f), Eigen::Vector3f(0.0f, 0.0f, 5.0f)});
+  faces.push_back({Eigen::Vector3f(-20.0f, 20.0f, 0.0f), Eigen::Vector3f(40.0f, 0.0f, 0.0f), Eigen::Vector3f(0.0f, 0.0f, 5.0f)});
+  faces.push_back({Eigen::Vector3f(-20.0f, -20.0f, 0.0f), Eigen::Vector3f(0.0f, 40.0f, 0.0f), Eigen::Vector3f(0.0f, 0.0f, 5.0f)});
+  faces.push_back({Eigen::Vector3f(20.0f, -20.0f, 0.0f), Eigen::Vector3f(0.0f, 40.0f, 0.0f), Eigen::Vector3f(0.0f, 0.0f, 5.0f)});
+
+  std::mt19937 box_mt(0);
+  std::uniform_real_distribution<float> box_udist(-15.0f, 15.0f);
+  for (int i = 0; i < 12; i++) {
+    const Eigen::Vector3f corner(box_udist(box_mt), box_udist(box_mt), 0.0f);
+    const Eigen::Vector3f size(2.0f, 1.0f + 0.1f * i, 0.5f + 0.2f * i);
+    const Eigen::Vector3f x(size.x(), 0.0f, 0.0f), y(0.0f, size.y(), 0.0f), z(0.0f, 0.0f, size.z());
+    faces.push_back({corner, x, z});
+    faces.push_back({corner + y, x, z});
+    faces.push_back({corner, y, z});
+    faces.push_back({corner + x, y, z});
+    faces.push_back({corner + z, x, y});
+  }
+
+  std::vector<float> areas;
+  for (const auto& face : faces) {
+    areas.push_back(face.u.cross(face.v).norm());
+  }
+
+  std::discrete_distribution<int> face_dist(areas.begin(), areas.end());
+  std::uniform_real_distribution<float> udist(0.0f, 1.0f);
+  std::normal_distribution<float> noise(0.0f, 0.01f);
+
+  Cloud::Ptr cloud(new Cloud);
+  cloud->resize(num_points);
+  for (int i = 0; i < num_points; i++) {
+    const auto& face = faces[face_dist(mt)];
+    cloud->at(i).getVector3fMap() = face.origin + udist(mt) * face.u + udist(mt) * face.v + Eigen::Vector3f(noise(mt), noise(mt), noise(mt));
+  }
+  return cloud;
+}
+
+static Cloud::Ptr load_bundled(const std::string& filename) {
+  Cloud::Ptr cloud(new Cloud);
+  if (pcl::io::loadPCDFile(data_directory + "/" + filename, *cloud)) {
+    return nullptr;
+  }
+
+  pcl::ApproximateVoxelGrid<PointT> voxelgrid;
+  voxelgrid.setLeafSize(0.1f, 0.1f, 0.1f);
+
+  Cloud::Ptr filtered(new Cloud);
+  voxelgrid.setInputCloud(cloud);
+  voxelgrid.filter(*filtered);
+  return filtered;
+}
+
+// clouds are generated once per point count and shared by the benchmarks
+static const CloudPair* get_clouds(int num_points) {
+  static std::map<int, CloudPair> cache;
+  auto found = cache.find(num_points);
+  if (found != cache.end()) {
+    return &found->second;
+  }
+
+  CloudPair pair;
+  if (num_points == 0) {
+    pair.target = load_bundled("251370668.pcd");
+    pair.source = load_bundled("251371071.pcd");
+    if (pair.target == nullptr || pair.source == nullptr) {
+      return nullptr;
+    }
+  } else {
+    // the source is sampled independently and moved by 0.3m / 3deg
+    std::mt19937 mt(num_points);
+    Eigen::Isometry3f motion = Eigen::Isometry3f::Identity();
+    motion.translation() = Eigen::Vector3f(0.3f, -0.1f, 0.05f);
+    motion.linear() = Eigen::AngleAxisf(3.0f * M_PI / 180.0f, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+
+    Cloud::Ptr source(new Cloud);
+    pcl::transformPointCloud(*synthetic_scene(num_points, mt), *source, motion.matrix());
+    pair.target = synthetic_scene(num_points, mt);
+    pair.source = source;
+  }
+
+  return &(cache[num_points] = pair);
+}
+
+template <typename Registration>
+void run(benchmark::State& state, PhaseTimedRegistration<Registration>& reg) {
+  const CloudPair* clouds = get_clouds(state.range(2));
+  if (clouds == nullptr) {
+    state.SkipWithError(("failed to load the bundled clouds from " + data_directory).c_str());
+    return;
+  }
+
+  Cloud aligned;
+  int lsq_iterations = 0;
+  for (auto _ : state) {
+    reg.clearTarget();
+    reg.clearSource();
+    reg.setInputTarget(clouds->target);
+    reg.setInputSource(clouds->source);
+    reg.align(aligned);
+    lsq_iterations += reg.lsqIterations();
+  }
+
+  const auto avg = benchmark::Counter::kAvgIterations;
+  state.counters["covariance"] = benchmark::Counter(reg.covariance, avg);
+  state.counters["correspondence"] = benchmark::Counter(reg.correspondence, avg);
+  state.counters["linearize"] = benchmark::Counter(reg.linearization, avg);
+  state.counters["error"] = benchmark::Counter(reg.error, avg);
+  state.counters["solve"] = benchmark::Counter(reg.total - reg.covariance - reg.correspondence - reg.linearization - reg.error, avg);
+  state.counters["lsq_iterations"] = benchmark::Counter(lsq_iterations, avg);
+  state.counters["source_points"] = clouds->source->size();
+  state.counters["target_points"] = clouds->target->size();
+}
+
+static void BM_Align(benchmark::State& state) {
+  const Method method = static_cast<Method>(state.range(0));
+  const int num_threads = state.range(1);
+  const double resolution = state.range(3) / 100.0;
+  const auto nn_method = static_cast<fast_gicp::NearestNeighborMethod>(state.range(4));
+
+  switch (method) {
+    case GICP: {
+      PhaseTimedRegistration<fast_gicp::FastGICP<PointT, PointT>> gicp;
+      gicp.setNumThreads(num_threads);
+      gicp.setNearestNeighborMethod(nn_method);
+      run(state, gicp);
+    } break;
+    case GICP_ST: {
+      PhaseTimedRegistration<fast_gicp::FastGICPSingleThread<PointT, PointT>> gicp;
+      gicp.setNearestNeighborMethod(nn_method);
+      run(state, gicp);
+    } break;
+    case GICP_MP: {
+      PhaseTimedRegistration<fast_gicp::FastGICPMultiPoints<PointT, PointT>> gicp;
+      gicp.setNumThreads(num_threads);
+      gicp.setNearestNeighborMethod(nn_method);
+      run(state, gicp);
+    } break;
+    case VGICP: {
+      PhaseTimedRegistration<fast_gicp::FastVGICP<PointT, PointT>> vgicp;
+      vgicp.setNumThreads(num_threads);
+      vgicp.setResolution(resolution);
+      vgicp.setNearestNeighborMethod(nn_method);
+      run(state, vgicp);
+    } break;
+    case NDT_P2D:
+    case NDT_D2D: {
+      PhaseTimedRegistration<fast_gicp::FastNDT<PointT, PointT>> ndt;
+      ndt.setNumThreads(num_threads);
+      ndt.setResolution(resolution);
+      ndt.setDistanceMode(method == NDT_P2D ? fast_gicp::NDTDistanceMode::P2D : fast_gicp::NDTDistanceMode::D2D);
+      run(state, ndt);
+    } break;
+  }
+
+  state.SetLabel(method_names[method]);
+}
+
+// only the meaningful parameter combinations of each method are registered
+static void parameters(benchmark::internal::Benchmark* bench) {
+  const std::vector<int> threads = {1, 2, 4, 8};
+  const std::vector<int> points = {0, 10000, 30000, 100000};
+  const std::vector<int> resolutions = {50, 100, 200};
+  const std::vector<int> nn_methods = {
+    static_cast<int>(fast_gicp::NearestNeighborMethod::PCL_KDTREE),
+    static_cast<int>(fast_gicp::NearestNeighborMethod::STATIC_KDTREE),
+    static_cast<int>(fast_gicp::NearestNeighborMethod::APPROX_VOXEL_HASH)};
+
+  for (int p : points) {
+    for (int nn : nn_methods) {
+      bench->Args({GICP_ST, 1, p, 0, nn});
+      for (int t : threads) {
+        bench->Args({GICP, t, p, 0, nn});
+        bench->Args({GICP_MP, t, p, 0, nn});
+      }
+    }
+
+    for (int r : resolutions) {
+      for (int t : threads) {
+        for (int nn : nn_methods) {
+          bench->Args({VGICP, t, p, r, nn});
+        }
+        bench->Args({NDT_P2D, t, p, r, 0});
+        bench->Args({NDT_D2D, t, p, r, 0});
+      }
+    }
+  }
+}
+
+BENCHMARK(BM_Align)->ArgNames({"method", "threads", "points", "resolution_cm", "nn"})->Apply(parameters)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (argc > 1) {
+    data_directory = argv[1];
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
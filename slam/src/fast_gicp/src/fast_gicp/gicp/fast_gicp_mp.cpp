@@ -0,0 +1,6 @@
+#include <fast_gicp/gicp/fast_gicp_mp.hpp>
+#include <fast_gicp/gicp/impl/fast_gicp_mp_impl.hpp>
+
+template class fast_gicp::FastGICPMultiPoints<pcl::PointXYZ, pcl::PointXYZ>;
+template class fast_gicp::FastGICPMultiPoints<pcl::PointXYZI, pcl::PointXYZI>;
+template class fast_gicp::FastGICPMultiPoints<pcl::PointNormal, pcl::PointNormal>;
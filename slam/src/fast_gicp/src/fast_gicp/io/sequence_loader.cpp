@@ -0,0 +1,5 @@
+#include <fast_gicp/io/sequence_loader.hpp>
+#include <fast_gicp/io/impl/sequence_loader_impl.hpp>
+
+template class fast_gicp::SequenceLoader<pcl::PointXYZ>;
+template class fast_gicp::SequenceLoader<pcl::PointXYZI>;
@@ -0,0 +1,6 @@
+#include <fast_gicp/ndt/fast_ndt.hpp>
+#include <fast_gicp/ndt/impl/fast_ndt_impl.hpp>
+
+template class fast_gicp::FastNDT<pcl::PointXYZ, pcl::PointXYZ>;
+template class fast_gicp::FastNDT<pcl::PointXYZI, pcl::PointXYZI>;
+template class fast_gicp::FastNDT<pcl::PointNormal, pcl::PointNormal>;
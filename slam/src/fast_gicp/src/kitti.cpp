@@ -1,7 +1,6 @@
 #include <chrono>
+#include <fstream>
 #include <iostream>
-#include <boost/format.hpp>
-#include <boost/filesystem.hpp>
 #include <boost/circular_buffer.hpp>
 
 #include <pcl/point_types.h>
@@ -13,68 +12,25 @@
 
 #include <fast_gicp/gicp/fast_gicp.hpp>
 #include <fast_gicp/gicp/fast_vgicp.hpp>
+#include <fast_gicp/io/sequence_loader.hpp>
 
 #ifdef USE_VGICP_CUDA
 #include <fast_gicp/ndt/ndt_cuda.hpp>
 #include <fast_gicp/gicp/fast_vgicp_cuda.hpp>
 #endif
 
-class KittiLoader {
-public:
-  KittiLoader(const std::string& dataset_path) : dataset_path(dataset_path) {
-    for (num_frames = 0;; num_frames++) {
-      std::string filename = (boost::format("%s/%06d.bin") % dataset_path % num_frames).str();
-      if (!boost::filesystem::exists(filename)) {
-        break;
-      }
-    }
-
-    if (num_frames == 0) {
-      std::cerr << "error: no files in " << dataset_path << std::endl;
-    }
-  }
-  ~KittiLoader() {}
-
-  size_t size() const { return num_frames; }
-
-  pcl::PointCloud<pcl::PointXYZ>::ConstPtr cloud(size_t i) const {
-    std::string filename = (boost::format("%s/%06d.bin") % dataset_path % i).str();
-    FILE* file = fopen(filename.c_str(), "rb");
-    if (!file) {
-      std::cerr << "error: failed to load " << filename << std::endl;
-      return nullptr;
-    }
-
-    std::vector<float> buffer(1000000);
-    size_t num_points = fread(reinterpret_cast<char*>(buffer.data()), sizeof(float), buffer.size(), file) / 4;
-    fclose(file);
-
-    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>());
-    cloud->resize(num_points);
-
-    for (int i = 0; i < num_points; i++) {
-      auto& pt = cloud->at(i);
-      pt.x = buffer[i * 4];
-      pt.y = buffer[i * 4 + 1];
-      pt.z = buffer[i * 4 + 2];
-      // pt.intensity = buffer[i * 4 + 3];
-    }
-
-    return cloud;
-  }
-
-private:
-  int num_frames;
-  std::string dataset_path;
-};
-
 int main(int argc, char** argv) {
   if (argc < 2) {
     std::cout << "usage: gicp_kitti /your/kitti/path/sequences/00/velodyne" << std::endl;
     return 0;
   }
 
-  KittiLoader kitti(argv[1]);
+  // frames are loaded ahead on a background thread
+  fast_gicp::SequenceLoader<pcl::PointXYZ> kitti(argv[1], fast_gicp::SequenceFormat::KITTI_BIN);
+  fast_gicp::SequenceLoader<pcl::PointXYZ>::Frame frame;
+  if (!kitti.next(frame)) {
+    return 1;
+  }
 
   // use downsample_resolution=1.0 for fast registration
   double downsample_resolution = 0.25;
@@ -92,7 +48,7 @@ int main(int argc, char** argv) {
   gicp.setMaxCorrespondenceDistance(1.0);
 
   // set initial frame as target
-  voxelgrid.setInputCloud(kitti.cloud(0));
+  voxelgrid.setInputCloud(frame.cloud);
   pcl::PointCloud<pcl::PointXYZ>::Ptr target(new pcl::PointCloud<pcl::PointXYZ>);
   voxelgrid.filter(*target);
   gicp.setInputTarget(target);
@@ -112,9 +68,11 @@ int main(int argc, char** argv) {
   boost::circular_buffer<std::chrono::high_resolution_clock::time_point> stamps(30);
   stamps.push_back(std::chrono::high_resolution_clock::now());
 
-  for (int i = 1; i < kitti.size(); i++) {
+  while (kitti.next(frame)) {
+    const size_t i = frame.index;
+
     // set the current frame as source
-    voxelgrid.setInputCloud(kitti.cloud(i));
+    voxelgrid.setInputCloud(frame.cloud);
     pcl::PointCloud<pcl::PointXYZ>::Ptr source(new pcl::PointCloud<pcl::PointXYZ>);
     voxelgrid.filter(*source);
     gicp.setInputSource(source);
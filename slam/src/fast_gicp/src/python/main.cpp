@@ -3,9 +3,9 @@
 #include <pybind11/eigen.h>
 #include <pybind11/functional.h>
 
-#include <boost/filesystem.hpp>
 #include <fast_gicp/gicp/fast_gicp.hpp>
 #include <fast_gicp/gicp/fast_vgicp.hpp>
+#include <fast_gicp/gicp/batch_registration.hpp>
 
 #ifdef USE_VGICP_CUDA
 #include <fast_gicp/ndt/ndt_cuda.hpp>
@@ -33,37 +33,90 @@ fast_gicp::NeighborSearchMethod search_method(const std::string& neighbor_search
   return fast_gicp::NeighborSearchMethod::DIRECT1;
 }
 
-pcl::PointCloud<pcl::PointXYZ>::Ptr eigen2pcl(const Eigen::Matrix<double, -1, 3>& points) {
-  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
-  cloud->resize(points.rows());
+// copies the first three columns of an Nx3 or NxK (K >= 3) array directly into a point cloud (any strides, no intermediate conversion)
+template<typename Scalar>
+void array2pcl(const py::array_t<Scalar>& points, pcl::PointCloud<pcl::PointXYZ>& cloud) {
+  if(points.ndim() != 2 || points.shape(1) < 3) {
+    throw std::invalid_argument("points must be an Nx3 (or NxK with K >= 3) array");
+  }
+
+  const auto p = points.template unchecked<2>();
+  cloud.resize(p.shape(0));
+  for(py::ssize_t i=0; i<p.shape(0); i++) {
+    auto& pt = cloud.at(i);
+    pt.x = p(i, 0);
+    pt.y = p(i, 1);
+    pt.z = p(i, 2);
+  }
+}
 
-  for(int i=0; i<points.rows(); i++) {
-    cloud->at(i).getVector3fMap() = points.row(i).cast<float>();
+// float32 and float64 arrays are read in place, other dtypes (and python lists) are converted to float64 first
+pcl::PointCloud<pcl::PointXYZ>::Ptr array2pcl(const py::array& points) {
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
+  if(py::isinstance<py::array_t<float>>(points)) {
+    array2pcl<float>(points, *cloud);
+  } else {
+    array2pcl<double>(py::array_t<double, py::array::forcecast>::ensure(points), *cloud);
   }
   return cloud;
 }
 
-Eigen::Matrix<double, -1, 3> downsample(const Eigen::Matrix<double, -1, 3>& points, double downsample_resolution) {
-  auto cloud = eigen2pcl(points);
+py::array_t<double> pcl2array(const pcl::PointCloud<pcl::PointXYZ>& cloud) {
+  py::array_t<double> points({static_cast<py::ssize_t>(cloud.size()), static_cast<py::ssize_t>(3)});
+  auto p = points.mutable_unchecked<2>();
+  for(py::ssize_t i=0; i<p.shape(0); i++) {
+    p(i, 0) = cloud.at(i).x;
+    p(i, 1) = cloud.at(i).y;
+    p(i, 2) = cloud.at(i).z;
+  }
+  return points;
+}
 
-  pcl::ApproximateVoxelGrid<pcl::PointXYZ> voxelgrid;
-  voxelgrid.setLeafSize(downsample_resolution, downsample_resolution, downsample_resolution);
-  voxelgrid.setInputCloud(cloud);
+using Covariances = std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>>;
 
-  pcl::PointCloud<pcl::PointXYZ>::Ptr filtered(new pcl::PointCloud<pcl::PointXYZ>);
-  voxelgrid.filter(*filtered);
+// Nx4x4 float64 array, one bulk copy of the covariance buffer
+py::array_t<double> covs2array(const Covariances& covs) {
+  static_assert(sizeof(Eigen::Matrix4d) == sizeof(double) * 16, "unexpected Matrix4d layout");
+  // Eigen matrices are column major, the covariances are symmetric so the row major view is the same matrix
+  return py::array_t<double>({static_cast<py::ssize_t>(covs.size()), static_cast<py::ssize_t>(4), static_cast<py::ssize_t>(4)}, covs.empty() ? nullptr : covs.front().data());
+}
 
-  Eigen::Matrix<float, -1, 3> filtered_points(filtered->size(), 3);
-  for(int i=0; i<filtered->size(); i++) {
-    filtered_points.row(i) = filtered->at(i).getVector3fMap();
+// Nx4x4 or Nx3x3 array
+Covariances array2covs(const py::array_t<double, py::array::c_style | py::array::forcecast>& array) {
+  if(array.ndim() != 3 || array.shape(1) != array.shape(2) || (array.shape(1) != 3 && array.shape(1) != 4)) {
+    throw std::invalid_argument("covariances must be an Nx4x4 or Nx3x3 array");
   }
 
-  return filtered_points.cast<double>();
+  Covariances covs(array.shape(0), Eigen::Matrix4d::Zero());
+  const auto c = array.unchecked<3>();
+  for(py::ssize_t i=0; i<c.shape(0); i++) {
+    if(c.shape(1) == 4) {
+      covs[i] = Eigen::Map<const Eigen::Matrix<double, 4, 4, Eigen::RowMajor>>(c.data(i, 0, 0));
+    } else {
+      covs[i].block<3, 3>(0, 0) = Eigen::Map<const Eigen::Matrix<double, 3, 3, Eigen::RowMajor>>(c.data(i, 0, 0));
+    }
+  }
+  return covs;
+}
+
+py::array_t<double> downsample(const py::array& points, double downsample_resolution) {
+  auto cloud = array2pcl(points);
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr filtered(new pcl::PointCloud<pcl::PointXYZ>);
+  {
+    py::gil_scoped_release release;
+    pcl::ApproximateVoxelGrid<pcl::PointXYZ> voxelgrid;
+    voxelgrid.setLeafSize(downsample_resolution, downsample_resolution, downsample_resolution);
+    voxelgrid.setInputCloud(cloud);
+    voxelgrid.filter(*filtered);
+  }
+
+  return pcl2array(*filtered);
 }
 
 Eigen::Matrix4d align_points(
-  const Eigen::Matrix<double, -1, 3>& target,
-  const Eigen::Matrix<double, -1, 3>& source,
+  const py::array& target,
+  const py::array& source,
   const std::string& method,
   double downsample_resolution,
   int k_correspondences,
@@ -74,8 +127,11 @@ Eigen::Matrix4d align_points(
   double neighbor_search_radius,
   const Eigen::Matrix4f& initial_guess
 ) {
-  pcl::PointCloud<pcl::PointXYZ>::Ptr target_cloud = eigen2pcl(target);
-  pcl::PointCloud<pcl::PointXYZ>::Ptr source_cloud = eigen2pcl(source);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr target_cloud = array2pcl(target);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr source_cloud = array2pcl(source);
+
+  // everything below works on the converted clouds only
+  py::gil_scoped_release release;
 
   if(downsample_resolution > 0.0) {
     pcl::ApproximateVoxelGrid<pcl::PointXYZ> voxelgrid;
@@ -144,11 +200,70 @@ Eigen::Matrix4d align_points(
 using LsqRegistration = fast_gicp::LsqRegistration<pcl::PointXYZ, pcl::PointXYZ>;
 using FastGICP = fast_gicp::FastGICP<pcl::PointXYZ, pcl::PointXYZ>;
 using FastVGICP = fast_gicp::FastVGICP<pcl::PointXYZ, pcl::PointXYZ>;
+using BatchFastGICP = fast_gicp::BatchRegistration<FastGICP>;
+using BatchFastVGICP = fast_gicp::BatchRegistration<FastVGICP>;
 #ifdef USE_VGICP_CUDA
 using FastVGICPCuda = fast_gicp::FastVGICPCuda<pcl::PointXYZ, pcl::PointXYZ>;
 using NDTCuda = fast_gicp::NDTCuda<pcl::PointXYZ, pcl::PointXYZ>;
 #endif
 
+// config(reg) is called for each registration held by the batch (e.g., lambda reg: reg.set_resolution(1.0))
+template<typename Batch, typename Registration>
+std::shared_ptr<Batch> create_batch(int num_threads, const py::object& config) {
+  return std::make_shared<Batch>(num_threads, [&](Registration& reg) {
+    if(!config.is_none()) {
+      config(py::cast(&reg, py::return_value_policy::reference));
+    }
+  });
+}
+
+// sources : list of point arrays, guesses : Mx4x4 array (or None)
+// returns (transformations Mx4x4, converged M, fitness_scores M, hessians Mx6x6)
+template<typename Batch>
+py::tuple batch_align(Batch& batch, const py::list& sources, const py::object& guesses) {
+  std::vector<typename Batch::PointCloudSourceConstPtr> source_clouds;
+  source_clouds.reserve(sources.size());
+  for(const auto& source : sources) {
+    source_clouds.push_back(array2pcl(source.cast<py::array>()));
+  }
+
+  std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> initial_guesses(source_clouds.size(), Eigen::Matrix4f::Identity());
+  if(!guesses.is_none()) {
+    const auto g = py::array_t<float, py::array::c_style | py::array::forcecast>::ensure(guesses);
+    if(!g || g.ndim() != 3 || g.shape(0) != static_cast<py::ssize_t>(source_clouds.size()) || g.shape(1) != 4 || g.shape(2) != 4) {
+      throw std::invalid_argument("guesses must be an Mx4x4 array with one guess per source");
+    }
+    for(size_t i=0; i<initial_guesses.size(); i++) {
+      initial_guesses[i] = Eigen::Map<const Eigen::Matrix<float, 4, 4, Eigen::RowMajor>>(g.data(i, 0, 0));
+    }
+  }
+
+  typename Batch::Results results;
+  {
+    py::gil_scoped_release release;
+    results = batch.align(source_clouds, initial_guesses);
+  }
+
+  const py::ssize_t n = results.size();
+  py::array_t<float> transformations({n, static_cast<py::ssize_t>(4), static_cast<py::ssize_t>(4)});
+  py::array_t<bool> converged(n);
+  py::array_t<double> fitness_scores(n);
+  py::array_t<double> hessians({n, static_cast<py::ssize_t>(6), static_cast<py::ssize_t>(6)});
+
+  auto t = transformations.mutable_unchecked<3>();
+  auto c = converged.mutable_unchecked<1>();
+  auto f = fitness_scores.mutable_unchecked<1>();
+  auto h = hessians.mutable_unchecked<3>();
+  for(py::ssize_t i=0; i<n; i++) {
+    Eigen::Map<Eigen::Matrix<float, 4, 4, Eigen::RowMajor>>(t.mutable_data(i, 0, 0)) = results[i].transformation;
+    Eigen::Map<Eigen::Matrix<double, 6, 6, Eigen::RowMajor>>(h.mutable_data(i, 0, 0)) = results[i].hessian;
+    c(i) = results[i].converged;
+    f(i) = results[i].fitness_score;
+  }
+
+  return py::make_tuple(transformations, converged, fitness_scores, hessians);
+}
+
 PYBIND11_MODULE(pygicp, m) {
   m.def("downsample", &downsample, "downsample points");
 
@@ -167,8 +282,8 @@ PYBIND11_MODULE(pygicp, m) {
   );
 
   py::class_<LsqRegistration, std::shared_ptr<LsqRegistration>>(m, "LsqRegistration")
-    .def("set_input_target", [] (LsqRegistration& reg, const Eigen::Matrix<double, -1, 3>& points) { reg.setInputTarget(eigen2pcl(points)); })
-    .def("set_input_source", [] (LsqRegistration& reg, const Eigen::Matrix<double, -1, 3>& points) { reg.setInputSource(eigen2pcl(points)); })
+    .def("set_input_target", [] (LsqRegistration& reg, const py::array& points) { reg.setInputTarget(array2pcl(points)); })
+    .def("set_input_source", [] (LsqRegistration& reg, const py::array& points) { reg.setInputSource(array2pcl(points)); })
     .def("swap_source_and_target", &LsqRegistration::swapSourceAndTarget)
     .def("get_final_hessian", &LsqRegistration::getFinalHessian)
     .def("get_final_transformation", &LsqRegistration::getFinalTransformation)
@@ -178,7 +293,7 @@ PYBIND11_MODULE(pygicp, m) {
         pcl::PointCloud<pcl::PointXYZ> aligned;
         reg.align(aligned, initial_guess);
         return reg.getFinalTransformation();
-      }, py::arg("initial_guess") = Eigen::Matrix4f::Identity()
+      }, py::arg("initial_guess") = Eigen::Matrix4f::Identity(), py::call_guard<py::gil_scoped_release>()
     )
   ;
 
@@ -187,6 +302,11 @@ PYBIND11_MODULE(pygicp, m) {
     .def("set_num_threads", &FastGICP::setNumThreads)
     .def("set_correspondence_randomness", &FastGICP::setCorrespondenceRandomness)
     .def("set_max_correspondence_distance", &FastGICP::setMaxCorrespondenceDistance)
+    .def("set_source_covariances", [] (FastGICP& gicp, const py::array& covs) { gicp.setSourceCovariances(array2covs(covs)); })
+    .def("set_target_covariances", [] (FastGICP& gicp, const py::array& covs) { gicp.setTargetCovariances(array2covs(covs)); })
+    .def("get_source_covariances", [] (const FastGICP& gicp) { return covs2array(gicp.getSourceCovariances()); })
+    .def("get_target_covariances", [] (const FastGICP& gicp) { return covs2array(gicp.getTargetCovariances()); })
+    .def("prepare_target", &FastGICP::prepareTarget, py::call_guard<py::gil_scoped_release>())
   ;
 
   py::class_<FastVGICP, FastGICP, std::shared_ptr<FastVGICP>>(m, "FastVGICP")
@@ -195,6 +315,28 @@ PYBIND11_MODULE(pygicp, m) {
     .def("set_neighbor_search_method", [](FastVGICP& vgicp, const std::string& method) { vgicp.setNeighborSearchMethod(search_method(method)); })
   ;
 
+  py::class_<BatchFastGICP, std::shared_ptr<BatchFastGICP>>(m, "BatchFastGICP")
+    .def(py::init(&create_batch<BatchFastGICP, FastGICP>), py::arg("num_threads") = 0, py::arg("config") = py::none())
+    .def("set_input_target", [] (BatchFastGICP& batch, const py::array& points) {
+        auto cloud = array2pcl(points);
+        py::gil_scoped_release release;
+        batch.setInputTarget(cloud);
+      })
+    .def("align", &batch_align<BatchFastGICP>, py::arg("sources"), py::arg("guesses") = py::none())
+    .def("num_threads", &BatchFastGICP::numThreads)
+  ;
+
+  py::class_<BatchFastVGICP, std::shared_ptr<BatchFastVGICP>>(m, "BatchFastVGICP")
+    .def(py::init(&create_batch<BatchFastVGICP, FastVGICP>), py::arg("num_threads") = 0, py::arg("config") = py::none())
+    .def("set_input_target", [] (BatchFastVGICP& batch, const py::array& points) {
+        auto cloud = array2pcl(points);
+        py::gil_scoped_release release;
+        batch.setInputTarget(cloud);
+      })
+    .def("align", &batch_align<BatchFastVGICP>, py::arg("sources"), py::arg("guesses") = py::none())
+    .def("num_threads", &BatchFastVGICP::numThreads)
+  ;
+
 #ifdef USE_VGICP_CUDA
   py::class_<FastVGICPCuda, LsqRegistration, std::shared_ptr<FastVGICPCuda>>(m, "FastVGICPCuda")
     .def(py::init())
@@ -1,4 +1,9 @@
+#include <limits>
 #include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 #include <iostream>
 #include <gtest/gtest.h>
@@ -6,12 +11,17 @@
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/common/transforms.h>
 #include <pcl/registration/gicp.h>
 #include <pcl/filters/voxel_grid.h>
 
 #include <fast_gicp/gicp/fast_gicp.hpp>
 #include <fast_gicp/gicp/fast_gicp_st.hpp>
+#include <fast_gicp/gicp/fast_gicp_mp.hpp>
 #include <fast_gicp/gicp/fast_vgicp.hpp>
+#include <fast_gicp/ndt/fast_ndt.hpp>
+#include <fast_gicp/gicp/batch_registration.hpp>
 #ifdef USE_VGICP_CUDA
 #include <fast_gicp/ndt/ndt_cuda.hpp>
 #include <fast_gicp/gicp/fast_vgicp_cuda.hpp>
@@ -93,6 +103,382 @@ TEST_F(GICPTestBase, LoadCheck) {
   EXPECT_FALSE(source->empty());
 }
 
+TEST_F(GICPTestBase, VoxelMapCheck) {
+  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> covs(target->size());
+  for (int i = 0; i < target->size(); i++) {
+    covs[i] = Eigen::Matrix4d::Identity() * (1.0 + i % 7) * 1e-3;
+    covs[i](3, 3) = 0.0;
+  }
+
+  fast_gicp::GaussianVoxelMap<pcl::PointXYZ> voxelmap(1.0, fast_gicp::VoxelAccumulationMode::ADDITIVE);
+  voxelmap.create_voxelmap(*target, covs, 1);
+  fast_gicp::GaussianVoxelMap<pcl::PointXYZ> voxelmap_mt(1.0, fast_gicp::VoxelAccumulationMode::ADDITIVE);
+  voxelmap_mt.create_voxelmap(*target, covs, 4);
+  ASSERT_EQ(voxelmap.size(), voxelmap_mt.size());
+
+  // reference voxel means
+  std::vector<Eigen::Vector4d, Eigen::aligned_allocator<Eigen::Vector4d>> sums(voxelmap.size(), Eigen::Vector4d::Zero());
+  std::vector<int> counts(voxelmap.size(), 0);
+  for (const auto& pt : target->points) {
+    int voxel = voxelmap.lookup_voxel(voxelmap.voxel_coord(pt.getVector4fMap().cast<double>()));
+    ASSERT_GE(voxel, 0);
+    sums[voxel] += pt.getVector4fMap().cast<double>();
+    counts[voxel]++;
+  }
+
+  for (int i = 0; i < voxelmap.size(); i++) {
+    EXPECT_EQ(voxelmap.lookup_voxel(voxelmap.coord(i)), i);
+    EXPECT_EQ(voxelmap.num_points(i), counts[i]);
+    EXPECT_LT((voxelmap.mean(i) - sums[i] / counts[i]).norm(), 1e-6);
+    EXPECT_EQ(voxelmap.mean(i), voxelmap_mt.mean(i)) << "result depends on the number of threads";
+    EXPECT_EQ(voxelmap.cov(i), voxelmap_mt.cov(i)) << "result depends on the number of threads";
+  }
+  EXPECT_EQ(voxelmap.lookup_voxel(Eigen::Vector3i(100000, 100000, 100000)), -1);
+}
+
+TEST_F(GICPTestBase, NearestNeighborSearchCheck) {
+  const int k = 20;
+  fast_gicp::PclKdTreeSearch<pcl::PointXYZ> pcl_kdtree;
+  fast_gicp::StaticKdTree<pcl::PointXYZ> static_kdtree;
+  fast_gicp::ApproxVoxelNearestNeighborSearch<pcl::PointXYZ> approx;
+  pcl_kdtree.setInputCloud(target);
+  static_kdtree.setInputCloud(target);
+  approx.setInputCloud(target);
+
+  fast_gicp::ThreadPoolExecutor executor(4);
+  std::vector<int> static_all, approx_all;
+  static_kdtree.nearestKSearchAll(k, static_all, executor);
+  approx.nearestKSearchAll(k, approx_all, executor);
+  ASSERT_EQ(static_all.size(), target->size() * k);
+  ASSERT_EQ(approx_all.size(), target->size() * k);
+
+  int num_hits = 0;
+  int num_queries = 0;
+  for (int i = 0; i < target->size(); i += 7) {
+    std::vector<int> expected_indices, indices;
+    std::vector<float> expected_sq_dists, sq_dists;
+    pcl_kdtree.nearestKSearch(target->at(i), k, expected_indices, expected_sq_dists);
+    static_kdtree.nearestKSearch(target->at(i), k, indices, sq_dists);
+
+    // exact search, compared by distance as equidistant neighbors may be ordered differently
+    ASSERT_EQ(sq_dists.size(), k);
+    for (int j = 0; j < k; j++) {
+      EXPECT_NEAR(sq_dists[j], expected_sq_dists[j], 1e-6);
+    }
+
+    std::vector<float> batch_sq_dists;
+    for (int j = 0; j < k; j++) {
+      batch_sq_dists.push_back((target->at(static_all[i * k + j]).getVector3fMap() - target->at(i).getVector3fMap()).squaredNorm());
+    }
+    std::sort(batch_sq_dists.begin(), batch_sq_dists.end());
+    for (int j = 0; j < k; j++) {
+      EXPECT_NEAR(batch_sq_dists[j], expected_sq_dists[j], 1e-6);
+    }
+
+    // approximate search
+    for (int j = 0; j < k; j++) {
+      const float sq_dist = (target->at(approx_all[i * k + j]).getVector3fMap() - target->at(i).getVector3fMap()).squaredNorm();
+      num_hits += sq_dist <= expected_sq_dists.back() + 1e-6;
+    }
+    num_queries++;
+  }
+
+  EXPECT_GT(num_hits, 0.9 * num_queries * k);
+}
+
+TEST_F(GICPTestBase, BatchAlignmentCheck) {
+  const double t_tol = 0.05;
+  const double r_tol = 1.0 * M_PI / 180.0;
+
+  // perturbed initial guesses around the identity
+  std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> guesses;
+  for (int i = 0; i < 8; i++) {
+    Eigen::Isometry3f guess = Eigen::Isometry3f::Identity();
+    guess.translation() = Eigen::Vector3f(0.1f * (i % 3) - 0.1f, 0.05f * (i % 2), 0.0f);
+    guess.linear() = Eigen::AngleAxisf(0.01f * (i - 4), Eigen::Vector3f::UnitZ()).toRotationMatrix();
+    guesses.push_back(guess.matrix());
+  }
+
+  fast_gicp::BatchRegistration<fast_gicp::FastVGICP<pcl::PointXYZ, pcl::PointXYZ>> batch(4, [](fast_gicp::FastVGICP<pcl::PointXYZ, pcl::PointXYZ>& vgicp) { vgicp.setResolution(1.0); });
+  batch.setInputTarget(target);
+  auto results = batch.align(source, guesses);
+
+  ASSERT_EQ(results.size(), guesses.size());
+  for (const auto& result : results) {
+    Eigen::Vector2f errors = pose_error(result.transformation);
+    EXPECT_TRUE(result.converged);
+    EXPECT_LT(errors[0], t_tol);
+    EXPECT_LT(errors[1], r_tol);
+    EXPECT_GT(result.hessian.determinant(), 0.0);
+  }
+}
+
+TEST_F(GICPTestBase, ShareTargetCheck) {
+  const double t_tol = 0.05;
+  const double r_tol = 1.0 * M_PI / 180.0;
+
+  fast_gicp::FastGICP<pcl::PointXYZ, pcl::PointXYZ> gicp, worker;
+  gicp.setInputTarget(target);
+  gicp.prepareTarget();
+
+  // the covariances are shared, not copied
+  worker.shareTarget(gicp);
+  const Eigen::Matrix4d* shared_covs = gicp.getTargetCovariances().data();
+  EXPECT_EQ(worker.getTargetCovariances().data(), shared_covs);
+
+  // a new target of one registration leaves the shared covariances intact
+  gicp.setInputTarget(source);
+  gicp.prepareTarget();
+  EXPECT_EQ(worker.getTargetCovariances().data(), shared_covs);
+  EXPECT_EQ(worker.getTargetCovariances().size(), target->size());
+
+  pcl::PointCloud<pcl::PointXYZ> aligned;
+  worker.setInputSource(source);
+  worker.align(aligned);
+  Eigen::Vector2f errors = pose_error(worker.getFinalTransformation());
+  EXPECT_TRUE(worker.hasConverged());
+  EXPECT_LT(errors[0], t_tol);
+  EXPECT_LT(errors[1], r_tol);
+}
+
+TEST_F(GICPTestBase, IncrementalTargetCheck) {
+  const double t_tol = 0.05;
+  const double r_tol = 1.0 * M_PI / 180.0;
+
+  fast_gicp::FastGICP<pcl::PointXYZ, pcl::PointXYZ> gicp;
+  gicp.setInputTarget(target);
+  gicp.prepareTarget();
+  const auto& covs = gicp.getTargetCovariances();
+
+  // insert the target in two chunks, the second one is given in a shifted frame
+  const Eigen::Isometry3d shift(Eigen::Translation3d(1.0, 2.0, 0.0));
+  pcl::PointCloud<pcl::PointXYZ> chunk0, chunk1;
+  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> covs0, covs1;
+  for (int i = 0; i < target->size(); i++) {
+    if (i % 2) {
+      chunk0.push_back(target->at(i));
+      covs0.push_back(covs[i]);
+    } else {
+      pcl::PointXYZ pt;
+      pt.getVector3fMap() = (shift.inverse() * target->at(i).getVector3fMap().cast<double>()).cast<float>();
+      chunk1.push_back(pt);
+      covs1.push_back(covs[i]);
+    }
+  }
+
+  fast_gicp::FastVGICP<pcl::PointXYZ, pcl::PointXYZ> vgicp;
+  vgicp.setResolution(1.0);
+  vgicp.insertTarget(chunk0, covs0);
+  vgicp.insertTarget(chunk1, covs1, shift);
+  vgicp.setInputSource(source);
+
+  pcl::PointCloud<pcl::PointXYZ> aligned;
+  vgicp.align(aligned);
+
+  Eigen::Vector2f errors = pose_error(vgicp.getFinalTransformation());
+  EXPECT_TRUE(vgicp.hasConverged());
+  EXPECT_LT(errors[0], t_tol);
+  EXPECT_LT(errors[1], r_tol);
+
+  // the fitness score is computed with the voxel lookup, it must match a kd-tree over the voxel means
+  // (exact as long as the nearest mean is within one voxel, i.e., max_range <= resolution^2)
+  auto fitness_score = [&](double max_range) {
+    pcl::search::KdTree<pcl::PointXYZ> kdtree;
+    kdtree.setInputCloud(vgicp.getInputTarget());
+
+    pcl::PointCloud<pcl::PointXYZ> transformed;
+    pcl::transformPointCloud(*source, transformed, vgicp.getFinalTransformation());
+
+    int num_inliers = 0;
+    double sum_sq_dists = 0.0;
+    std::vector<int> k_indices;
+    std::vector<float> k_sq_dists;
+    for (const auto& pt : transformed) {
+      kdtree.nearestKSearch(pt, 1, k_indices, k_sq_dists);
+      if (k_sq_dists[0] <= max_range) {
+        sum_sq_dists += k_sq_dists[0];
+        num_inliers++;
+      }
+    }
+    return sum_sq_dists / num_inliers;
+  };
+
+  EXPECT_NEAR(vgicp.getFitnessScore(1.0), fitness_score(1.0), 1e-4);
+  EXPECT_LT(vgicp.getFitnessScore(), 1.0);
+
+  // nothing is older than two insertions or farther than 1km
+  EXPECT_EQ(vgicp.evictTarget(2, Eigen::Vector3d::Zero(), 1000.0), 0);
+  EXPECT_GT(vgicp.evictTarget(0), 0);
+
+  // evicting part of the map keeps the target cloud and the fitness score consistent
+  EXPECT_GT(vgicp.evictTarget(-1, Eigen::Vector3d::Zero(), 10.0), 0);
+  EXPECT_NEAR(vgicp.getFitnessScore(1.0), fitness_score(1.0), 1e-4);
+
+  // back to the batch mode, the kd-tree of pcl::Registration must be built for the new target again
+  vgicp.setInputTarget(target);
+  vgicp.align(aligned);
+  EXPECT_TRUE(vgicp.hasConverged());
+  EXPECT_NEAR(vgicp.getFitnessScore(), fitness_score(std::numeric_limits<double>::max()), 1e-4);
+}
+
+TEST_F(GICPTestBase, TargetModelCheck) {
+  const std::string filename = "/tmp/gicp_test_target_model.bin";
+
+  fast_gicp::FastVGICP<pcl::PointXYZ, pcl::PointXYZ> vgicp;
+  vgicp.setResolution(1.0);
+  vgicp.setInputTarget(target);
+  vgicp.setInputSource(source);
+  ASSERT_TRUE(vgicp.saveTargetModel(filename));
+
+  pcl::PointCloud<pcl::PointXYZ> aligned;
+  vgicp.align(aligned);
+
+  // the loaded target takes the voxel parameters from the file
+  fast_gicp::FastVGICP<pcl::PointXYZ, pcl::PointXYZ> loaded;
+  loaded.setResolution(2.0);
+  ASSERT_TRUE(loaded.loadTargetModel(filename));
+  loaded.setInputSource(source);
+  loaded.align(aligned);
+
+  ASSERT_EQ(loaded.getTargetCovariances().size(), vgicp.getTargetCovariances().size());
+  for (int i = 0; i < vgicp.getTargetCovariances().size(); i++) {
+    EXPECT_LT((loaded.getTargetCovariances()[i] - vgicp.getTargetCovariances()[i]).norm(), 1e-9);
+  }
+  EXPECT_TRUE(loaded.hasConverged());
+  EXPECT_LT((loaded.getFinalTransformation() - vgicp.getFinalTransformation()).norm(), 1e-4);
+
+  // GICP skips the voxel map section
+  fast_gicp::FastGICP<pcl::PointXYZ, pcl::PointXYZ> gicp;
+  EXPECT_TRUE(gicp.loadTargetModel(filename));
+
+  // a corrupted file is rejected by the content hash
+  {
+    std::fstream fs(filename, std::ios::in | std::ios::out | std::ios::binary);
+    fs.seekg(64);
+    const char byte = fs.get();
+    fs.seekp(64);
+    fs.put(byte ^ 0x01);
+  }
+  EXPECT_FALSE(loaded.loadTargetModel(filename));
+  std::remove(filename.c_str());
+}
+
+TEST_F(GICPTestBase, OptimizerCheck) {
+  const double t_tol = 0.05;
+  const double r_tol = 1.0 * M_PI / 180.0;
+
+  const fast_gicp::LSQ_OPTIMIZER_TYPE types[] = {fast_gicp::LSQ_OPTIMIZER_TYPE::GaussNewton, fast_gicp::LSQ_OPTIMIZER_TYPE::LevenbergMarquardt, fast_gicp::LSQ_OPTIMIZER_TYPE::Dogleg, fast_gicp::LSQ_OPTIMIZER_TYPE::GaussNewtonLineSearch};
+  for (const auto type : types) {
+    fast_gicp::FastGICP<pcl::PointXYZ, pcl::PointXYZ> gicp;
+    gicp.setOptimizerType(type);
+    gicp.setInputTarget(target);
+    gicp.setInputSource(source);
+
+    pcl::PointCloud<pcl::PointXYZ> aligned;
+    gicp.align(aligned);
+
+    Eigen::Vector2f errors = pose_error(gicp.getFinalTransformation());
+    EXPECT_TRUE(gicp.hasConverged()) << "optimizer=" << static_cast<int>(type);
+    EXPECT_LT(errors[0], t_tol) << "optimizer=" << static_cast<int>(type);
+    EXPECT_LT(errors[1], r_tol) << "optimizer=" << static_cast<int>(type);
+
+    // accepted steps never increase the error (GN records the error at the linearization point)
+    const auto& stats = gicp.getIterationStats();
+    ASSERT_FALSE(stats.empty());
+    for (const auto& iteration : stats) {
+      if (iteration.accepted) {
+        EXPECT_LE(iteration.accepted_error, iteration.error) << "optimizer=" << static_cast<int>(type);
+      }
+    }
+  }
+}
+
+TEST_F(GICPTestBase, LazyCorrespondenceCheck) {
+  const double t_tol = 0.05;
+  const double r_tol = 1.0 * M_PI / 180.0;
+
+  for (const auto precision : {fast_gicp::ComputePrecision::DOUBLE, fast_gicp::ComputePrecision::FLOAT}) {
+    fast_gicp::FastGICP<pcl::PointXYZ, pcl::PointXYZ> gicp;
+    gicp.setComputePrecision(precision);
+    gicp.setCorrespondenceUpdateThresholds(0.1, 1.0 * M_PI / 180.0);
+    gicp.setInputTarget(target);
+    gicp.setInputSource(source);
+
+    pcl::PointCloud<pcl::PointXYZ> aligned;
+    gicp.align(aligned);
+
+    Eigen::Vector2f errors = pose_error(gicp.getFinalTransformation());
+    EXPECT_TRUE(gicp.hasConverged());
+    EXPECT_LT(errors[0], t_tol);
+    EXPECT_LT(errors[1], r_tol);
+
+    // the first linearization always searches, the last ones are close enough to skip it
+    const auto& updates = gicp.getCorrespondenceUpdates();
+    ASSERT_EQ(updates.size(), gicp.getIterationStats().size());
+    EXPECT_EQ(updates.front(), fast_gicp::CorrespondenceUpdate::FULL);
+    EXPECT_GT(std::count(updates.begin(), updates.end(), fast_gicp::CorrespondenceUpdate::MAHALANOBIS_ONLY), 0);
+  }
+}
+
+TEST_F(GICPTestBase, ExecutorCheck) {
+  // chunked reductions give bitwise identical results on any backend
+  std::vector<std::shared_ptr<fast_gicp::Executor>> executors = {
+    std::make_shared<fast_gicp::SequentialExecutor>(),
+    std::make_shared<fast_gicp::OpenMPExecutor>(4),
+    std::make_shared<fast_gicp::ThreadPoolExecutor>(4)};
+
+  std::vector<double> errors;
+  std::vector<Eigen::Matrix<double, 6, 6>, Eigen::aligned_allocator<Eigen::Matrix<double, 6, 6>>> Hs;
+  std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> results;
+  for (const auto& executor : executors) {
+    fast_gicp::FastVGICP<pcl::PointXYZ, pcl::PointXYZ> vgicp;
+    vgicp.setExecutor(executor);
+    vgicp.setResolution(1.0);
+    vgicp.setInputTarget(target);
+    vgicp.setInputSource(source);
+
+    pcl::PointCloud<pcl::PointXYZ> aligned;
+    vgicp.align(aligned);
+    EXPECT_TRUE(vgicp.hasConverged());
+
+    Eigen::Matrix<double, 6, 6> H;
+    Eigen::Matrix<double, 6, 1> b;
+    errors.push_back(vgicp.evaluateCost(relative_pose, &H, &b));
+    Hs.push_back(H);
+    results.push_back(vgicp.getFinalTransformation());
+  }
+
+  for (int i = 1; i < executors.size(); i++) {
+    EXPECT_EQ(errors[i], errors[0]);
+    EXPECT_EQ(Hs[i], Hs[0]);
+    EXPECT_EQ(results[i], results[0]);
+  }
+
+  // registrations sharing one pool concurrently
+  auto pool = std::make_shared<fast_gicp::ThreadPoolExecutor>(4);
+  std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> concurrent(4);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < concurrent.size(); i++) {
+    threads.emplace_back([&, i] {
+      fast_gicp::FastGICP<pcl::PointXYZ, pcl::PointXYZ> gicp;
+      gicp.setExecutor(pool);
+      gicp.setInputTarget(target);
+      gicp.setInputSource(source);
+
+      pcl::PointCloud<pcl::PointXYZ> aligned;
+      gicp.align(aligned);
+      concurrent[i] = gicp.getFinalTransformation();
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (int i = 1; i < concurrent.size(); i++) {
+    EXPECT_EQ(concurrent[i], concurrent[0]);
+  }
+}
+
 using Parameters = std::tuple<const char*, bool>;
 class AlignmentTest : public GICPTestBase, public testing::WithParamInterface<Parameters> {
 public:
@@ -105,10 +491,30 @@ public:
       gicp->setNumThreads(num_threads);
       gicp->swapSourceAndTarget();
       return gicp;
+    } else if (method == "GICP_FLOAT") {
+      auto gicp = pcl::make_shared<fast_gicp::FastGICP<pcl::PointXYZ, pcl::PointXYZ>>();
+      gicp->setNumThreads(num_threads);
+      gicp->setComputePrecision(fast_gicp::ComputePrecision::FLOAT);
+      return gicp;
+    } else if (method == "GICP_APPROX_KNN") {
+      auto gicp = pcl::make_shared<fast_gicp::FastGICP<pcl::PointXYZ, pcl::PointXYZ>>();
+      gicp->setNumThreads(num_threads);
+      gicp->setNearestNeighborMethod(fast_gicp::NearestNeighborMethod::APPROX_VOXEL_HASH);
+      return gicp;
+    } else if (method == "GICP_MP") {
+      auto gicp = pcl::make_shared<fast_gicp::FastGICPMultiPoints<pcl::PointXYZ, pcl::PointXYZ>>();
+      gicp->setNumThreads(num_threads);
+      gicp->setMaxCorrespondenceDistance(1.0);
+      return gicp;
     } else if (method == "VGICP") {
       auto vgicp = pcl::make_shared<fast_gicp::FastVGICP<pcl::PointXYZ, pcl::PointXYZ>>();
       vgicp->setNumThreads(num_threads);
       return vgicp;
+    } else if (method == "NDT_P2D" || method == "NDT_D2D") {
+      auto ndt = pcl::make_shared<fast_gicp::FastNDT<pcl::PointXYZ, pcl::PointXYZ>>();
+      ndt->setNumThreads(num_threads);
+      ndt->setDistanceMode(method == "NDT_P2D" ? fast_gicp::NDTDistanceMode::P2D : fast_gicp::NDTDistanceMode::D2D);
+      return ndt;
     } else if (method == "VGICP_CUDA") {
 #ifdef USE_VGICP_CUDA
       auto vgicp = pcl::make_shared<fast_gicp::FastVGICPCuda<pcl::PointXYZ, pcl::PointXYZ>>();
@@ -138,7 +544,7 @@ public:
   }
 };
 
-INSTANTIATE_TEST_SUITE_P(AlignmentTest2, AlignmentTest, testing::Combine(testing::Values("GICP", "VGICP", "VGICP_CUDA", "NDT_CUDA"), testing::Bool()), [](const auto& info) {
+INSTANTIATE_TEST_SUITE_P(AlignmentTest2, AlignmentTest, testing::Combine(testing::Values("GICP", "GICP_FLOAT", "GICP_APPROX_KNN", "GICP_MP", "VGICP", "NDT_P2D", "NDT_D2D", "VGICP_CUDA", "NDT_CUDA"), testing::Bool()), [](const auto& info) {
   std::stringstream sst;
   sst << std::get<0>(info.param) << (std::get<1>(info.param) ? "_MT" : "_ST");
   return sst.str();
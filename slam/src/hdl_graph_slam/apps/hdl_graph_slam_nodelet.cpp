@@ -46,6 +46,7 @@
 
 #include <hdl_graph_slam/graph_slam.hpp>
 #include <hdl_graph_slam/keyframe.hpp>
+#include <hdl_graph_slam/keyframe_archive.hpp>
 #include <hdl_graph_slam/keyframe_updater.hpp>
 #include <hdl_graph_slam/loop_detector.hpp>
 #include <hdl_graph_slam/information_matrix_calculator.hpp>
@@ -92,6 +93,7 @@ public:
     keyframe_updater.reset(new KeyframeUpdater(private_nh));
     loop_detector.reset(new LoopDetector(private_nh));
     map_cloud_generator.reset(new MapCloudGenerator());
+    map_cloud_generator->set_update_thresholds(private_nh.param<double>("map_cloud_update_trans", 0.05), private_nh.param<double>("map_cloud_update_angle", 0.01));
     inf_calclator.reset(new InformationMatrixCalculator(private_nh));
     nmea_parser.reset(new NmeaSentenceParser());
 
@@ -134,6 +136,7 @@ public:
     save_map_service_server = mt_nh.advertiseService("/hdl_graph_slam/save_map", &HdlGraphSlamNodelet::save_map_service, this);
 
     graph_updated = false;
+    num_local_optimizations = 0;
     double graph_update_interval = private_nh.param<double>("graph_update_interval", 3.0);
     double map_cloud_update_interval = private_nh.param<double>("map_cloud_update_interval", 10.0);
     optimization_timer = mt_nh.createWallTimer(ros::WallDuration(graph_update_interval), &HdlGraphSlamNodelet::optimization_timer_callback, this);
@@ -232,7 +235,8 @@ private:
       const auto& prev_keyframe = i == 0 ? keyframes.back() : keyframe_queue[i - 1];
 
       Eigen::Isometry3d relative_pose = keyframe->odom.inverse() * prev_keyframe->odom;
-      Eigen::MatrixXd information = inf_calclator->calc_information_matrix(keyframe->cloud, prev_keyframe->cloud, relative_pose);
+      // the kd-tree of the new keyframe is kept and reused by the loop matching (its fitness score)
+      Eigen::MatrixXd information = inf_calclator->calc_information_matrix(*keyframe->kdtree(), prev_keyframe->cloud, relative_pose);
       auto edge = graph_slam->add_se3_edge(keyframe->node, prev_keyframe->node, relative_pose, information);
       graph_slam->add_robust_kernel(edge, private_nh.param<std::string>("odometry_edge_robust_kernel", "NONE"), private_nh.param<double>("odometry_edge_robust_kernel_size", 1.0));
     }
@@ -525,7 +529,8 @@ private:
     snapshot = keyframes_snapshot;
     keyframes_snapshot_mutex.unlock();
 
-    auto cloud = map_cloud_generator->generate(snapshot, map_cloud_resolution);
+    // only the keyframes added, removed or moved since the last publish are integrated into the map
+    auto cloud = map_cloud_generator->update(snapshot, map_cloud_resolution);
     if(!cloud) {
       return;
     }
@@ -566,7 +571,8 @@ private:
     std::vector<Loop::Ptr> loops = loop_detector->detect(keyframes, new_keyframes, *graph_slam);
     for(const auto& loop : loops) {
       Eigen::Isometry3d relpose(loop->relative_pose.cast<double>());
-      Eigen::MatrixXd information_matrix = inf_calclator->calc_information_matrix(loop->key1->cloud, loop->key2->cloud, relpose);
+      // the loop matching has already evaluated the fitness score (and the Hessian), no need to match the clouds again
+      Eigen::MatrixXd information_matrix = inf_calclator->calc_information_matrix(loop->fitness_score, relpose, loop->hessian);
       auto edge = graph_slam->add_se3_edge(loop->key1->node, loop->key2->node, relpose, information_matrix);
       graph_slam->add_robust_kernel(edge, private_nh.param<std::string>("loop_closure_edge_robust_kernel", "NONE"), private_nh.param<double>("loop_closure_edge_robust_kernel_size", 1.0));
     }
@@ -582,8 +588,20 @@ private:
     }
 
     // optimize the pose graph
+    // with a local window, only the latest nodes are optimized until a loop is closed or the full optimization interval is reached
     int num_iterations = private_nh.param<int>("g2o_solver_num_iterations", 1024);
-    graph_slam->optimize(num_iterations);
+    int local_window_size = private_nh.param<int>("g2o_local_window_size", 0);
+    int full_optimization_interval = private_nh.param<int>("g2o_full_optimization_interval", 10);
+    if(local_window_size > 0 && loops.empty() && (full_optimization_interval <= 0 || num_local_optimizations < full_optimization_interval)) {
+      graph_slam->optimize_window(num_iterations, local_window_size);
+      num_local_optimizations++;
+      // the window consists of the latest vertices, so at most the latest #local_window_size keyframes have moved
+      loop_detector->update_index(keyframes, local_window_size);
+    } else {
+      graph_slam->optimize(num_iterations);
+      num_local_optimizations = 0;
+      loop_detector->update_index(keyframes);
+    }
 
     // publish tf
     const auto& keyframe = keyframes.back();
@@ -825,27 +843,41 @@ private:
     // Load graph.
     graph_slam->load(directory + "/graph.g2o");
     
-    // Iterate over the items in this directory and count how many sub directories there are. 
-    // This will give an upper limit on how many keyframe indexes we can expect to find.
-    boost::filesystem::directory_iterator begin(directory), end;
-    int max_directory_count = std::count_if(begin, end,
-        [](const boost::filesystem::directory_entry & d) {
-            return boost::filesystem::is_directory(d.path()); // only return true if a direcotry
-    });
-
-    // Load keyframes by looping through key frame indexes that we expect to see.
-    for(int i = 0; i < max_directory_count; i++) {
-      std::stringstream sst;
-      sst << boost::format("%s/%06d") % directory % i;
-      std::string key_frame_directory = sst.str();
-
-      // If key_frame_directory doesnt exist, then we have run out so lets stop looking.
-      if(!boost::filesystem::is_directory(key_frame_directory)) {
-        break;
+    // Load keyframes from the packed archive, or from the per-keyframe directories of older dumps.
+    if(boost::filesystem::exists(directory + "/keyframes.bin")) {
+      KeyFrameArchive archive;
+      if(!archive.open(directory + "/keyframes.bin")) {
+        return false;
+      }
+
+      auto loaded = archive.load(graph_slam->graph.get());
+      if(loaded.size() != static_cast<size_t>(archive.size())) {
+        return false;
       }
+      keyframes.insert(keyframes.end(), loaded.begin(), loaded.end());
+    } else {
+      // Iterate over the items in this directory and count how many sub directories there are. 
+      // This will give an upper limit on how many keyframe indexes we can expect to find.
+      boost::filesystem::directory_iterator begin(directory), end;
+      int max_directory_count = std::count_if(begin, end,
+          [](const boost::filesystem::directory_entry & d) {
+              return boost::filesystem::is_directory(d.path()); // only return true if a direcotry
+      });
+
+      // Load keyframes by looping through key frame indexes that we expect to see.
+      for(int i = 0; i < max_directory_count; i++) {
+        std::stringstream sst;
+        sst << boost::format("%s/%06d") % directory % i;
+        std::string key_frame_directory = sst.str();
+
+        // If key_frame_directory doesnt exist, then we have run out so lets stop looking.
+        if(!boost::filesystem::is_directory(key_frame_directory)) {
+          break;
+        }
 
-      KeyFrame::Ptr keyframe(new KeyFrame(key_frame_directory, graph_slam->graph.get()));
-      keyframes.push_back(keyframe);
+        KeyFrame::Ptr keyframe(new KeyFrame(key_frame_directory, graph_slam->graph.get()));
+        keyframes.push_back(keyframe);
+      }
     }
     std::cout << "loaded " << keyframes.size() << " keyframes" <<std::endl;
     
@@ -952,11 +984,18 @@ private:
     graph_slam->save(directory + "/graph.g2o");
 
     // save keyframes
-    for(int i = 0; i < keyframes.size(); i++) {
-      std::stringstream sst;
-      sst << boost::format("%s/%06d") % directory % i;
+    if(private_nh.param<bool>("dump_keyframe_archive", true)) {
+      if(!KeyFrameArchive::save(directory + "/keyframes.bin", keyframes)) {
+        res.success = false;
+        return true;
+      }
+    } else {
+      for(int i = 0; i < keyframes.size(); i++) {
+        std::stringstream sst;
+        sst << boost::format("%s/%06d") % directory % i;
 
-      keyframes[i]->save(sst.str());
+        keyframes[i]->save(sst.str());
+      }
     }
 
     if(zero_utm) {
@@ -1080,6 +1119,7 @@ private:
 
   // for map cloud generation
   std::atomic_bool graph_updated;
+  int num_local_optimizations;  // windowed optimizations since the last full optimization
   double map_cloud_resolution;
   std::mutex keyframes_snapshot_mutex;
   std::vector<KeyFrameSnapshot::Ptr> keyframes_snapshot;
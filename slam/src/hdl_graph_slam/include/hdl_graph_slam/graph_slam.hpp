@@ -126,6 +126,13 @@ public:
    */
   int optimize(int num_iterations);
 
+  /**
+   * @brief perform graph optimization over the latest vertices only (the vertices connected to them are held fixed)
+   * @param num_iterations  maximum number of iterations
+   * @param window_size     number of the latest vertices to be optimized
+   */
+  int optimize_window(int num_iterations, int window_size);
+
   /**
    * @brief save the pose graph to a file
    * @param filename  output filename
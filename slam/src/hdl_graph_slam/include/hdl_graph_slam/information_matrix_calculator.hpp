@@ -6,6 +6,7 @@
 #include <ros/ros.h>
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
+#include <pcl/search/kdtree.h>
 
 namespace hdl_graph_slam {
 
@@ -29,18 +30,39 @@ public:
     min_stddev_q = params.template param<double>("min_stddev_q", 0.05);
     max_stddev_q = params.template param<double>("max_stddev_q", 0.2);
     fitness_score_thresh = params.template param<double>("fitness_score_thresh", 2.5);
+
+    use_hessian_inf_matrix = params.template param<bool>("use_hessian_inf_matrix", false);
+    hessian_inf_scale = params.template param<double>("hessian_inf_scale", 1e-3);
   }
 
   static double calc_fitness_score(const pcl::PointCloud<PointT>::ConstPtr& cloud1, const pcl::PointCloud<PointT>::ConstPtr& cloud2, const Eigen::Isometry3d& relpose, double max_range = std::numeric_limits<double>::max());
+  static double calc_fitness_score(const pcl::search::KdTree<PointT>& tree1, const pcl::PointCloud<PointT>::ConstPtr& cloud2, const Eigen::Isometry3d& relpose, double max_range = std::numeric_limits<double>::max());
 
   Eigen::MatrixXd calc_information_matrix(const pcl::PointCloud<PointT>::ConstPtr& cloud1, const pcl::PointCloud<PointT>::ConstPtr& cloud2, const Eigen::Isometry3d& relpose) const;
 
+  /**
+   * @brief same as above with a prebuilt kd-tree of cloud1 (e.g., KeyFrame::kdtree())
+   */
+  Eigen::MatrixXd calc_information_matrix(const pcl::search::KdTree<PointT>& tree1, const pcl::PointCloud<PointT>::ConstPtr& cloud2, const Eigen::Isometry3d& relpose) const;
+
+  /**
+   * @brief information matrix of an edge whose scan matching has already been evaluated (e.g., loop edges)
+   *        no kd-tree is built here
+   * @param fitness_score  fitness score of the scan matching (mean squared distance to the nearest neighbors)
+   * @param relpose        estimated relative pose (the edge measurement)
+   * @param hessian        final Hessian of the scan matching in the fast_gicp [rotation, translation] order (may be empty)
+   * @return information matrix (the Hessian based one if use_hessian_inf_matrix is set and the Hessian is given)
+   */
+  Eigen::MatrixXd calc_information_matrix(double fitness_score, const Eigen::Isometry3d& relpose, const Eigen::MatrixXd& hessian = Eigen::MatrixXd()) const;
+
 private:
   double weight(double a, double max_x, double min_y, double max_y, double x) const {
     double y = (1.0 - std::exp(-a * x)) / (1.0 - std::exp(-a * max_x));
     return min_y + (max_y - min_y) * y;
   }
 
+  Eigen::MatrixXd hessian_information_matrix(const Eigen::MatrixXd& hessian, const Eigen::Isometry3d& relpose) const;
+
 private:
   bool use_const_inf_matrix;
   double const_stddev_x;
@@ -52,6 +74,9 @@ private:
   double min_stddev_q;
   double max_stddev_q;
   double fitness_score_thresh;
+
+  bool use_hessian_inf_matrix;
+  double hessian_inf_scale;  // the registration Hessian is multiplied by this before the variances are clamped
 };
 
 }  // namespace hdl_graph_slam
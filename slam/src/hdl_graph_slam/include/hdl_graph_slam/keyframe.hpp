@@ -6,6 +6,7 @@
 #include <ros/ros.h>
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
+#include <pcl/search/kdtree.h>
 #include <boost/optional.hpp>
 
 namespace g2o {
@@ -35,6 +36,11 @@ public:
   long id() const;
   Eigen::Isometry3d estimate() const;
 
+  /**
+   * @brief kd-tree of the point cloud, built on the first call and shared by the odometry edge and loop matching
+   */
+  const pcl::search::KdTree<PointT>::Ptr& kdtree() const;
+
 public:
   ros::Time stamp;                                // timestamp
   Eigen::Isometry3d odom;                         // odometry (estimated by scan_matching_odometry)
@@ -47,6 +53,9 @@ public:
   boost::optional<Eigen::Quaterniond> orientation;  //
 
   g2o::VertexSE3* node;  // node instance
+
+private:
+  mutable pcl::search::KdTree<PointT>::Ptr cloud_kdtree;  // built lazily by kdtree()
 };
 
 /**
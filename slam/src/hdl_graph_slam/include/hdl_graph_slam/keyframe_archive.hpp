@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef KEYFRAME_ARCHIVE_HPP
+#define KEYFRAME_ARCHIVE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <hdl_graph_slam/keyframe.hpp>
+
+namespace hdl_graph_slam {
+
+/**
+ * @brief single file store of keyframes (replaces the per-keyframe "data" + "cloud.pcd" directories)
+ *
+ *        header       : magic "HGSKFA\0\0", version (u32), number of keyframes (u32), offset of the index (u64)
+ *        point blocks : x[], y[], z[], intensity[] of each keyframe cloud, LZF compressed unless it does not shrink
+ *        index        : one fixed layout KeyFrameArchive::Record per keyframe
+ */
+class KeyFrameArchive {
+public:
+  struct Record {
+    std::int64_t node_id;
+    std::uint32_t stamp_sec;
+    std::uint32_t stamp_nsec;
+    double estimate[12];  // upper 3x4 of the pose matrix (row major)
+    double odom[12];
+    double accum_distance;
+    double floor_coeffs[4];
+    double utm_coord[3];
+    double acceleration[3];
+    double orientation[4];  // w, x, y, z
+    std::uint64_t cloud_stamp;
+    std::uint64_t cloud_offset;
+    std::uint64_t cloud_bytes;  // size of the point block in the file
+    std::uint32_t num_points;
+    std::uint32_t flags;
+  };
+
+  enum Flags : std::uint32_t { FLOOR_COEFFS = 1 << 0, UTM_COORD = 1 << 1, ACCELERATION = 1 << 2, ORIENTATION = 1 << 3, COMPRESSED = 1 << 4 };
+
+  KeyFrameArchive();
+  ~KeyFrameArchive();
+
+  KeyFrameArchive(const KeyFrameArchive&) = delete;
+  KeyFrameArchive& operator=(const KeyFrameArchive&) = delete;
+
+  /**
+   * @brief write keyframes to an archive file
+   * @param filename   output filename
+   * @param keyframes  keyframes
+   * @return if true, the archive was written successfully
+   */
+  static bool save(const std::string& filename, const std::vector<KeyFrame::Ptr>& keyframes);
+
+  /**
+   * @brief map an archive file and validate its header and index
+   * @param filename  archive filename
+   * @return if true, the archive is ready to be read
+   */
+  bool open(const std::string& filename);
+
+  int size() const;
+
+  /**
+   * @brief restore the keyframes and attach them to their nodes in the graph
+   *        the point blocks are decoded in parallel directly from the mapped file
+   * @param graph  pose graph loaded from the same dump
+   * @return restored keyframes (empty if any of them could not be restored)
+   */
+  std::vector<KeyFrame::Ptr> load(g2o::HyperGraph* graph) const;
+
+private:
+  Record record(int i) const;
+  pcl::PointCloud<KeyFrame::PointT>::Ptr decode_cloud(const Record& record) const;
+
+private:
+  const char* data;  // mapped file
+  size_t data_size;
+  size_t index_offset;
+  std::uint32_t num_records;
+};
+
+}  // namespace hdl_graph_slam
+
+#endif  // KEYFRAME_ARCHIVE_HPP
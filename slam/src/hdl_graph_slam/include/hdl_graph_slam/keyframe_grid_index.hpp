@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef KEYFRAME_GRID_INDEX_HPP
+#define KEYFRAME_GRID_INDEX_HPP
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <hdl_graph_slam/keyframe.hpp>
+
+#include <g2o/types/slam3d/vertex_se3.h>
+
+namespace hdl_graph_slam {
+
+/**
+ * @brief 2D grid hash over the estimated keyframe positions for loop candidate search
+ *        keyframes are identified by their index in the keyframe list, which only grows by appending
+ */
+class KeyFrameGridIndex {
+public:
+  /**
+   * @brief constructor
+   * @param cell_size  grid cell size (the search radius is a good choice)
+   */
+  KeyFrameGridIndex(double cell_size) : cell_size(cell_size) {}
+
+  /**
+   * @brief index the keyframes appended since the last call
+   * @param keyframes  keyframe list (a shorter list than the indexed one rebuilds the index)
+   */
+  void add(const std::vector<KeyFrame::Ptr>& keyframes) {
+    if(keyframes.size() < entries.size() || (!entries.empty() && keyframes.front() != entries.front().keyframe)) {
+      entries.clear();
+      cells.clear();
+    }
+
+    for(int i = entries.size(); i < keyframes.size(); i++) {
+      const std::uint64_t cell = cell_key(keyframes[i]->node->estimate().translation());
+      entries.push_back(Entry{keyframes[i], cell});
+      cells[cell].push_back(i);  // appended indices keep each cell sorted
+    }
+  }
+
+  /**
+   * @brief move the keyframes whose estimated positions left their cells (call after graph optimization)
+   * @param num_latest  number of the latest keyframes to be checked (e.g., a local optimization window), -1 checks all
+   */
+  void refresh(int num_latest = -1) {
+    const int num_entries = entries.size();
+    const int begin = num_latest < 0 ? 0 : std::max(0, num_entries - num_latest);
+    for(int i = begin; i < num_entries; i++) {
+      const std::uint64_t cell = cell_key(entries[i].keyframe->node->estimate().translation());
+      if(cell == entries[i].cell) {
+        continue;
+      }
+
+      auto& old_cell = cells[entries[i].cell];
+      old_cell.erase(std::lower_bound(old_cell.begin(), old_cell.end(), i));
+      if(old_cell.empty()) {
+        cells.erase(entries[i].cell);
+      }
+
+      auto& new_cell = cells[cell];
+      new_cell.insert(std::lower_bound(new_cell.begin(), new_cell.end(), i), i);
+      entries[i].cell = cell;
+    }
+  }
+
+  /**
+   * @brief keyframes within #radius on the XY plane from #center whose accumulated distance is at most #max_accum_distance
+   * @return keyframes in the keyframe list order
+   */
+  std::vector<KeyFrame::Ptr> radius_search(const Eigen::Vector3d& center, double radius, double max_accum_distance) const {
+    const int range = std::ceil(radius / cell_size);
+    const int cx = std::floor(center.x() / cell_size);
+    const int cy = std::floor(center.y() / cell_size);
+
+    std::vector<int> found;
+    for(int dx = -range; dx <= range; dx++) {
+      for(int dy = -range; dy <= range; dy++) {
+        auto cell = cells.find(cell_key(cx + dx, cy + dy));
+        if(cell == cells.end()) {
+          continue;
+        }
+
+        for(int i : cell->second) {
+          const auto& keyframe = entries[i].keyframe;
+          if(keyframe->accum_distance > max_accum_distance) {
+            continue;
+          }
+
+          const auto& pos = keyframe->node->estimate().translation();
+          if((pos.head<2>() - center.head<2>()).norm() <= radius) {
+            found.push_back(i);
+          }
+        }
+      }
+    }
+
+    std::sort(found.begin(), found.end());
+
+    std::vector<KeyFrame::Ptr> keyframes(found.size());
+    std::transform(found.begin(), found.end(), keyframes.begin(), [this](int i) { return entries[i].keyframe; });
+    return keyframes;
+  }
+
+private:
+  std::uint64_t cell_key(const Eigen::Vector3d& pos) const {
+    return cell_key(static_cast<int>(std::floor(pos.x() / cell_size)), static_cast<int>(std::floor(pos.y() / cell_size)));
+  }
+
+  static std::uint64_t cell_key(int x, int y) {
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32) | static_cast<std::uint32_t>(y);
+  }
+
+private:
+  struct Entry {
+    KeyFrame::Ptr keyframe;
+    std::uint64_t cell;
+  };
+
+  double cell_size;
+  std::vector<Entry> entries;                                  // indexed keyframes in the keyframe list order
+  std::unordered_map<std::uint64_t, std::vector<int>> cells;  // sorted entry indices in each cell
+};
+
+}  // namespace hdl_graph_slam
+
+#endif  // KEYFRAME_GRID_INDEX_HPP
@@ -3,8 +3,14 @@
 #ifndef LOOP_DETECTOR_HPP
 #define LOOP_DETECTOR_HPP
 
+#include <mutex>
+#include <atomic>
+#include <numeric>
 #include <boost/format.hpp>
+#include <fast_gicp/gicp/executor.hpp>
+#include <fast_gicp/gicp/fast_gicp.hpp>
 #include <hdl_graph_slam/keyframe.hpp>
+#include <hdl_graph_slam/keyframe_grid_index.hpp>
 #include <hdl_graph_slam/registrations.hpp>
 #include <hdl_graph_slam/graph_slam.hpp>
 
@@ -17,12 +23,19 @@ public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   using Ptr = std::shared_ptr<Loop>;
 
-  Loop(const KeyFrame::Ptr& key1, const KeyFrame::Ptr& key2, const Eigen::Matrix4f& relpose) : key1(key1), key2(key2), relative_pose(relpose) {}
+  Loop(const KeyFrame::Ptr& key1, const KeyFrame::Ptr& key2, const Eigen::Matrix4f& relpose, double fitness_score = std::numeric_limits<double>::max(), const Eigen::MatrixXd& hessian = Eigen::MatrixXd())
+  : key1(key1),
+    key2(key2),
+    relative_pose(relpose),
+    fitness_score(fitness_score),
+    hessian(hessian) {}
 
 public:
   KeyFrame::Ptr key1;
   KeyFrame::Ptr key2;
   Eigen::Matrix4f relative_pose;
+  double fitness_score;     // fitness score of the scan matching
+  Eigen::MatrixXd hessian;  // final Hessian of the scan matching (empty unless fast_gicp)
 };
 
 /**
@@ -36,15 +49,26 @@ public:
    * @brief constructor
    * @param pnh
    */
-  LoopDetector(ros::NodeHandle& pnh) {
+  LoopDetector(ros::NodeHandle& pnh) : keyframe_index(pnh.param<double>("distance_thresh", 5.0)) {
     distance_thresh = pnh.param<double>("distance_thresh", 5.0);
     accum_distance_thresh = pnh.param<double>("accum_distance_thresh", 8.0);
     distance_from_last_edge_thresh = pnh.param<double>("min_edge_interval", 5.0);
 
     fitness_score_max_range = pnh.param<double>("fitness_score_max_range", std::numeric_limits<double>::max());
     fitness_score_thresh = pnh.param<double>("fitness_score_thresh", 0.5);
-
-    registration = select_registration_method(pnh);
+    fitness_score_accept_thresh = pnh.param<double>("fitness_score_accept_thresh", 0.0);
+
+    // candidates are matched concurrently, each by its own registration instance
+    // fast_gicp registrations also run their inner loops on the same thread pool so that the cores are not oversubscribed
+    executor = std::make_shared<fast_gicp::ThreadPoolExecutor>(pnh.param<int>("loop_num_threads", 0));
+    for(int i = 0; i < executor->num_threads(); i++) {
+      auto registration = select_registration_method(pnh);
+      auto gicp = dynamic_cast<fast_gicp::FastGICP<PointT, PointT>*>(registration.get());
+      if(gicp) {
+        gicp->setExecutor(executor);
+      }
+      registrations.push_back(registration);
+    }
     last_edge_accum_distance = 0.0;
   }
 
@@ -55,6 +79,8 @@ public:
    * @param graph_slam      pose graph
    */
   std::vector<Loop::Ptr> detect(const std::vector<KeyFrame::Ptr>& keyframes, const std::deque<KeyFrame::Ptr>& new_keyframes, hdl_graph_slam::GraphSLAM& graph_slam) {
+    keyframe_index.add(keyframes);
+
     std::vector<Loop::Ptr> detected_loops;
     for(const auto& new_keyframe : new_keyframes) {
       auto candidates = find_candidates(keyframes, new_keyframe);
@@ -67,6 +93,16 @@ public:
     return detected_loops;
   }
 
+  /**
+   * @brief update the keyframe positions in the candidate search index (call after graph optimization)
+   * @param keyframes    keyframes
+   * @param num_latest   number of the latest keyframes that may have moved (the local optimization window), -1 for all
+   */
+  void update_index(const std::vector<KeyFrame::Ptr>& keyframes, int num_latest = -1) {
+    keyframe_index.add(keyframes);
+    keyframe_index.refresh(num_latest);
+  }
+
   double get_distance_thresh() const {
     return distance_thresh;
   }
@@ -84,28 +120,9 @@ private:
       return std::vector<KeyFrame::Ptr>();
     }
 
-    std::vector<KeyFrame::Ptr> candidates;
-    candidates.reserve(32);
-
-    for(const auto& k : keyframes) {
-      // traveled distance between keyframes is too small
-      if(new_keyframe->accum_distance - k->accum_distance < accum_distance_thresh) {
-        continue;
-      }
-
-      const auto& pos1 = k->node->estimate().translation();
-      const auto& pos2 = new_keyframe->node->estimate().translation();
-
-      // estimated distance between keyframes is too small
-      double dist = (pos1.head<2>() - pos2.head<2>()).norm();
-      if(dist > distance_thresh) {
-        continue;
-      }
-
-      candidates.push_back(k);
-    }
-
-    return candidates;
+    // keyframes within distance_thresh that are traveled far enough from the new keyframe
+    const auto& pos = new_keyframe->node->estimate().translation();
+    return keyframe_index.radius_search(pos, distance_thresh, new_keyframe->accum_distance - accum_distance_thresh);
   }
 
   /**
@@ -119,11 +136,8 @@ private:
       return nullptr;
     }
 
-    registration->setInputTarget(new_keyframe->cloud);
-
-    double best_score = std::numeric_limits<double>::max();
-    KeyFrame::Ptr best_matched;
-    Eigen::Matrix4f relative_pose;
+    const int num_workers = std::min<int>(registrations.size(), candidate_keyframes.size());
+    set_input_target(new_keyframe, num_workers);
 
     std::cout << std::endl;
     std::cout << "--- loop detection ---" << std::endl;
@@ -131,27 +145,67 @@ private:
     std::cout << "matching" << std::flush;
     auto t1 = ros::Time::now();
 
-    pcl::PointCloud<PointT>::Ptr aligned(new pcl::PointCloud<PointT>());
-    for(const auto& candidate : candidate_keyframes) {
+    Eigen::Isometry3d new_keyframe_estimate = new_keyframe->node->estimate();
+    new_keyframe_estimate.linear() = Eigen::Quaterniond(new_keyframe_estimate.linear()).normalized().toRotationMatrix();
+
+    std::vector<double> scores(candidate_keyframes.size(), std::numeric_limits<double>::max());
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> relative_poses(candidate_keyframes.size());
+    std::vector<Eigen::MatrixXd> hessians(candidate_keyframes.size());
+
+    std::mutex idle_mutex;
+    std::vector<int> idle_workers(num_workers);
+    std::iota(idle_workers.begin(), idle_workers.end(), 0);
+    std::atomic_bool accepted(false);
+
+    executor->run(candidate_keyframes.size(), [&](int i) {
+      // a good enough match has already been found, the remaining candidates are not evaluated
+      if(accepted) {
+        return;
+      }
+
+      // at most num_workers candidates are in flight, so an idle worker is always available
+      int worker;
+      {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        worker = idle_workers.back();
+        idle_workers.pop_back();
+      }
+
+      const auto& registration = registrations[worker];
+      const auto& candidate = candidate_keyframes[i];
+
       registration->setInputSource(candidate->cloud);
-      Eigen::Isometry3d new_keyframe_estimate = new_keyframe->node->estimate();
-      new_keyframe_estimate.linear() = Eigen::Quaterniond(new_keyframe_estimate.linear()).normalized().toRotationMatrix();
       Eigen::Isometry3d candidate_estimate = candidate->node->estimate();
       candidate_estimate.linear() = Eigen::Quaterniond(candidate_estimate.linear()).normalized().toRotationMatrix();
       Eigen::Matrix4f guess = (new_keyframe_estimate.inverse() * candidate_estimate).matrix().cast<float>();
       guess(2, 3) = 0.0;
-      registration->align(*aligned, guess);
+
+      pcl::PointCloud<PointT> aligned;
+      registration->align(aligned, guess);
       std::cout << "." << std::flush;
 
-      double score = registration->getFitnessScore(fitness_score_max_range);
-      if(!registration->hasConverged() || score > best_score) {
-        continue;
+      if(registration->hasConverged()) {
+        scores[i] = registration->getFitnessScore(fitness_score_max_range);
+        relative_poses[i] = registration->getFinalTransformation();
+
+        auto lsq = dynamic_cast<fast_gicp::LsqRegistration<PointT, PointT>*>(registration.get());
+        if(lsq) {
+          hessians[i] = lsq->getFinalHessian();
+        }
+        if(scores[i] < fitness_score_accept_thresh) {
+          accepted = true;
+        }
       }
 
-      best_score = score;
-      best_matched = candidate;
-      relative_pose = registration->getFinalTransformation();
-    }
+      std::lock_guard<std::mutex> lock(idle_mutex);
+      idle_workers.push_back(worker);
+    });
+
+    // the first candidate with the best score wins so that the result does not depend on the completion order
+    const int best_index = std::min_element(scores.begin(), scores.end()) - scores.begin();
+    const double best_score = scores[best_index];
+    const KeyFrame::Ptr& best_matched = candidate_keyframes[best_index];
+    const Eigen::Matrix4f relative_pose = relative_poses[best_index];
 
     auto t2 = ros::Time::now();
     std::cout << " done" << std::endl;
@@ -167,7 +221,34 @@ private:
 
     last_edge_accum_distance = new_keyframe->accum_distance;
 
-    return std::make_shared<Loop>(new_keyframe, best_matched, relative_pose);
+    return std::make_shared<Loop>(new_keyframe, best_matched, relative_pose, best_score, hessians[best_index]);
+  }
+
+  /**
+   * @brief set the loop end keyframe as the target of the first #num_workers registrations
+   *        fast_gicp registrations build the target structures once and share them,
+   *        and all of them use the kd-tree of the keyframe (already built for its odometry edge) for the fitness score
+   */
+  void set_input_target(const KeyFrame::Ptr& keyframe, int num_workers) {
+    const auto& cloud = keyframe->cloud;
+    registrations[0]->setInputTarget(cloud);
+    registrations[0]->setSearchMethodTarget(keyframe->kdtree(), true);
+
+    auto gicp = dynamic_cast<fast_gicp::FastGICP<PointT, PointT>*>(registrations[0].get());
+    if(gicp) {
+      gicp->prepareTarget();
+    }
+
+    for(int i = 1; i < num_workers; i++) {
+      auto worker_gicp = dynamic_cast<fast_gicp::FastGICP<PointT, PointT>*>(registrations[i].get());
+      if(gicp && worker_gicp) {
+        worker_gicp->shareTarget(*gicp);
+      } else {
+        registrations[i]->setInputTarget(cloud);
+      }
+      // never rebuilt by initCompute(), so the workers do not touch the shared tree concurrently
+      registrations[i]->setSearchMethodTarget(keyframe->kdtree(), true);
+    }
   }
 
 private:
@@ -175,12 +256,15 @@ private:
   double accum_distance_thresh;           // traveled distance between ...
   double distance_from_last_edge_thresh;  // a new loop edge must far from the last one at least this distance
 
-  double fitness_score_max_range;  // maximum allowable distance between corresponding points
-  double fitness_score_thresh;     // threshold for scan matching
+  double fitness_score_max_range;      // maximum allowable distance between corresponding points
+  double fitness_score_thresh;         // threshold for scan matching
+  double fitness_score_accept_thresh;  // a candidate matched better than this is accepted without evaluating the rest (0 = disabled)
 
   double last_edge_accum_distance;
+  KeyFrameGridIndex keyframe_index;  // estimated keyframe positions for find_candidates()
 
-  pcl::Registration<PointT, PointT>::Ptr registration;
+  std::shared_ptr<fast_gicp::Executor> executor;
+  std::vector<pcl::Registration<PointT, PointT>::Ptr> registrations;  // one per worker thread
 };
 
 }  // namespace hdl_graph_slam
@@ -4,6 +4,9 @@
 #define MAP_CLOUD_GENERATOR_HPP
 
 #include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <Eigen/StdVector>
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include <hdl_graph_slam/keyframe.hpp>
@@ -27,6 +30,68 @@ public:
    * @return generated map point cloud
    */
   pcl::PointCloud<PointT>::Ptr generate(const std::vector<KeyFrameSnapshot::Ptr>& keyframes, double resolution) const;
+
+  /**
+   * @brief set the pose change that triggers re-integration of a keyframe in update()
+   * @param translation  translation threshold [m]
+   * @param rotation     rotation threshold [rad]
+   */
+  void set_update_thresholds(double translation, double rotation);
+
+  /**
+   * @brief generates a map point cloud incrementally
+   *        the voxelized contribution of each keyframe is cached, and only new keyframes, removed keyframes
+   *        and keyframes whose poses moved beyond the update thresholds are (re-)integrated into the voxel map
+   * @param keyframes   snapshots of keyframes
+   * @param resolution  resolution of generated map (changing it rebuilds the voxel map, <= 0 falls back to generate())
+   * @return generated map point cloud (voxel centers with the mean intensity)
+   */
+  pcl::PointCloud<PointT>::Ptr update(const std::vector<KeyFrameSnapshot::Ptr>& keyframes, double resolution);
+
+  /**
+   * @brief discard the cached keyframe contributions and the voxel map
+   */
+  void clear();
+
+private:
+  struct VoxelPoints {
+    std::uint64_t key;
+    int num_points;
+    float intensity_sum;
+  };
+
+  // voxelized contribution of a keyframe
+  struct Contribution {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Eigen::Isometry3d pose;                   // pose used for the integration
+    pcl::PointCloud<PointT>::ConstPtr cloud;  // keeps the key (cloud address) valid while cached
+    std::vector<VoxelPoints> voxels;
+    std::uint64_t last_seen;
+  };
+
+  using ContributionMap = std::unordered_map<const pcl::PointCloud<PointT>*, Contribution, std::hash<const pcl::PointCloud<PointT>*>, std::equal_to<const pcl::PointCloud<PointT>*>, Eigen::aligned_allocator<std::pair<const pcl::PointCloud<PointT>* const, Contribution>>>;
+
+  struct Voxel {
+    int num_keyframes;  // number of keyframes with points in this voxel
+    int num_points;
+    double intensity_sum;
+  };
+
+  std::uint64_t voxel_key(const Eigen::Vector3f& pt) const;
+  Eigen::Vector3f voxel_center(std::uint64_t key) const;
+
+  void integrate(const KeyFrameSnapshot& keyframe, Contribution& contribution);
+  void remove(const Contribution& contribution);
+
+private:
+  double update_trans_threshold;
+  double update_angle_threshold;
+
+  double voxel_resolution;
+  std::uint64_t update_count;
+  ContributionMap contributions;  // keyed by the keyframe cloud
+  std::unordered_map<std::uint64_t, Voxel> voxels;
 };
 
 }  // namespace hdl_graph_slam
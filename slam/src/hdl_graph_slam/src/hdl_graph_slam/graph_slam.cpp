@@ -2,6 +2,7 @@
 
 #include <hdl_graph_slam/graph_slam.hpp>
 
+#include <unordered_set>
 #include <boost/format.hpp>
 #include <g2o/stuff/macros.h>
 #include <g2o/core/factory.h>
@@ -320,6 +321,64 @@ int GraphSLAM::optimize(int num_iterations) {
   return iterations;
 }
 
+int GraphSLAM::optimize_window(int num_iterations, int window_size) {
+  g2o::SparseOptimizer* graph = dynamic_cast<g2o::SparseOptimizer*>(this->graph.get());
+  if(graph->edges().size() < 10) {
+    return -1;
+  }
+
+  // the latest vertices (ids are assigned in the insertion order) and the edges connected to them
+  std::unordered_set<g2o::HyperGraph::Vertex*> window;
+  g2o::HyperGraph::EdgeSet edges;
+  const int num_vertices = graph->vertices().size();
+  for(int id = num_vertices - 1; id >= 0 && static_cast<int>(window.size()) < window_size; id--) {
+    g2o::HyperGraph::Vertex* vertex = graph->vertex(id);
+    if(vertex == nullptr) {
+      continue;
+    }
+
+    window.insert(vertex);
+    edges.insert(vertex->edges().begin(), vertex->edges().end());
+  }
+
+  // the vertices outside of the window are held fixed during the optimization
+  std::vector<g2o::OptimizableGraph::Vertex*> boundary;
+  for(const auto& edge : edges) {
+    for(const auto& v : edge->vertices()) {
+      auto vertex = static_cast<g2o::OptimizableGraph::Vertex*>(v);
+      if(window.count(vertex) || vertex->fixed()) {
+        continue;
+      }
+
+      vertex->setFixed(true);
+      boundary.push_back(vertex);
+    }
+  }
+
+  std::cout << std::endl;
+  std::cout << "--- local pose graph optimization ---" << std::endl;
+  std::cout << "nodes: " << window.size() << " (+" << boundary.size() << " fixed) / " << num_vertices << "   edges: " << edges.size() << " / " << graph->edges().size() << std::endl;
+
+  graph->initializeOptimization(edges);
+  graph->setVerbose(false);
+
+  double chi2 = graph->chi2();
+
+  auto t1 = ros::WallTime::now();
+  int iterations = graph->optimize(num_iterations);
+  auto t2 = ros::WallTime::now();
+
+  for(const auto& vertex : boundary) {
+    vertex->setFixed(false);
+  }
+
+  std::cout << "iterations: " << iterations << " / " << num_iterations << std::endl;
+  std::cout << "chi2: (before)" << chi2 << " -> (after)" << graph->chi2() << std::endl;
+  std::cout << "time: " << boost::format("%.3f") % (t2 - t1).toSec() << "[sec]" << std::endl;
+
+  return iterations;
+}
+
 void GraphSLAM::save(const std::string& filename) {
   g2o::SparseOptimizer* graph = dynamic_cast<g2o::SparseOptimizer*>(this->graph.get());
 
@@ -2,6 +2,7 @@
 
 #include <hdl_graph_slam/information_matrix_calculator.hpp>
 
+#include <Eigen/Eigenvalues>
 #include <pcl/search/kdtree.h>
 #include <pcl/common/transforms.h>
 
@@ -18,11 +19,32 @@ InformationMatrixCalculator::InformationMatrixCalculator(ros::NodeHandle& nh) {
   min_stddev_q = nh.param<double>("min_stddev_q", 0.05);
   max_stddev_q = nh.param<double>("max_stddev_q", 0.2);
   fitness_score_thresh = nh.param<double>("fitness_score_thresh", 0.5);
+
+  use_hessian_inf_matrix = nh.param<bool>("use_hessian_inf_matrix", false);
+  hessian_inf_scale = nh.param<double>("hessian_inf_scale", 1e-3);
 }
 
 InformationMatrixCalculator::~InformationMatrixCalculator() {}
 
 Eigen::MatrixXd InformationMatrixCalculator::calc_information_matrix(const pcl::PointCloud<PointT>::ConstPtr& cloud1, const pcl::PointCloud<PointT>::ConstPtr& cloud2, const Eigen::Isometry3d& relpose) const {
+  if(use_const_inf_matrix) {
+    return calc_information_matrix(0.0, relpose);
+  }
+
+  double fitness_score = calc_fitness_score(cloud1, cloud2, relpose);
+  return calc_information_matrix(fitness_score, relpose);
+}
+
+Eigen::MatrixXd InformationMatrixCalculator::calc_information_matrix(const pcl::search::KdTree<PointT>& tree1, const pcl::PointCloud<PointT>::ConstPtr& cloud2, const Eigen::Isometry3d& relpose) const {
+  if(use_const_inf_matrix) {
+    return calc_information_matrix(0.0, relpose);
+  }
+
+  double fitness_score = calc_fitness_score(tree1, cloud2, relpose);
+  return calc_information_matrix(fitness_score, relpose);
+}
+
+Eigen::MatrixXd InformationMatrixCalculator::calc_information_matrix(double fitness_score, const Eigen::Isometry3d& relpose, const Eigen::MatrixXd& hessian) const {
   if(use_const_inf_matrix) {
     Eigen::MatrixXd inf = Eigen::MatrixXd::Identity(6, 6);
     inf.topLeftCorner(3, 3).array() /= const_stddev_x;
@@ -30,7 +52,9 @@ Eigen::MatrixXd InformationMatrixCalculator::calc_information_matrix(const pcl::
     return inf;
   }
 
-  double fitness_score = calc_fitness_score(cloud1, cloud2, relpose);
+  if(use_hessian_inf_matrix && hessian.rows() == 6 && hessian.cols() == 6) {
+    return hessian_information_matrix(hessian, relpose);
+  }
 
   double min_var_x = std::pow(min_stddev_x, 2);
   double max_var_x = std::pow(max_stddev_x, 2);
@@ -46,10 +70,52 @@ Eigen::MatrixXd InformationMatrixCalculator::calc_information_matrix(const pcl::
   return inf;
 }
 
+Eigen::MatrixXd InformationMatrixCalculator::hessian_information_matrix(const Eigen::MatrixXd& hessian, const Eigen::Isometry3d& relpose) const {
+  using Matrix6d = Eigen::Matrix<double, 6, 6>;
+  using Vector6d = Eigen::Matrix<double, 6, 1>;
+
+  // fast_gicp perturbs the relative pose T (key2 -> key1) from the left, exp([w, v]) * T, in the frame of key1,
+  // while EdgeSE3 perturbs it from the right, T * exp([r, p]), and its error is [r, quaternion xyz (= p / 2)].
+  // the adjoint of T relates them: w = R * p, v = R * r + t^ * R * p
+  const Eigen::Matrix3d R = relpose.linear();
+  Eigen::Matrix3d t_hat;
+  t_hat << 0.0, -relpose.translation().z(), relpose.translation().y(), relpose.translation().z(), 0.0, -relpose.translation().x(), -relpose.translation().y(), relpose.translation().x(), 0.0;
+
+  Matrix6d J = Matrix6d::Zero();  // d[w, v] / d[r, quaternion xyz]
+  J.block<3, 3>(0, 3) = 2.0 * R;
+  J.block<3, 3>(3, 0) = R;
+  J.block<3, 3>(3, 3) = 2.0 * t_hat * R;
+
+  Matrix6d inf = hessian_inf_scale * J.transpose() * hessian * J;
+  inf = 0.5 * (inf + inf.transpose()).eval();
+
+  // keep the variances within the same bounds as the fitness score based weights.
+  // the eigenvalues of the whole matrix (cross terms included) are clamped after whitening it with each stddev bound.
+  // the two whitenings differ (the x and q bound ratios differ), so only the last one, the upper bound of the information
+  // (no direction more certain than min_stddev), is guaranteed. the max_stddev floor applied first may be slightly undercut
+  auto clamp = [](const Matrix6d& inf, const Vector6d& stddev, double min_eigenvalue, double max_eigenvalue) {
+    Eigen::SelfAdjointEigenSolver<Matrix6d> eig(stddev.asDiagonal() * inf * stddev.asDiagonal());
+    const Vector6d values = eig.eigenvalues().cwiseMax(min_eigenvalue).cwiseMin(max_eigenvalue);
+    const Vector6d inv_stddev = stddev.cwiseInverse();
+    return Matrix6d(inv_stddev.asDiagonal() * eig.eigenvectors() * values.asDiagonal() * eig.eigenvectors().transpose() * inv_stddev.asDiagonal());
+  };
+
+  Vector6d max_stddev, min_stddev;
+  max_stddev << Eigen::Vector3d::Constant(max_stddev_x), Eigen::Vector3d::Constant(max_stddev_q);
+  min_stddev << Eigen::Vector3d::Constant(min_stddev_x), Eigen::Vector3d::Constant(min_stddev_q);
+
+  inf = clamp(inf, max_stddev, 1.0, std::numeric_limits<double>::max());
+  inf = clamp(inf, min_stddev, 0.0, 1.0);
+  return inf;
+}
+
 double InformationMatrixCalculator::calc_fitness_score(const pcl::PointCloud<PointT>::ConstPtr& cloud1, const pcl::PointCloud<PointT>::ConstPtr& cloud2, const Eigen::Isometry3d& relpose, double max_range) {
-  pcl::search::KdTree<PointT>::Ptr tree_(new pcl::search::KdTree<PointT>());
-  tree_->setInputCloud(cloud1);
+  pcl::search::KdTree<PointT> tree;
+  tree.setInputCloud(cloud1);
+  return calc_fitness_score(tree, cloud2, relpose, max_range);
+}
 
+double InformationMatrixCalculator::calc_fitness_score(const pcl::search::KdTree<PointT>& tree1, const pcl::PointCloud<PointT>::ConstPtr& cloud2, const Eigen::Isometry3d& relpose, double max_range) {
   double fitness_score = 0.0;
 
   // Transform the input dataset using the final transformation
@@ -63,7 +129,7 @@ double InformationMatrixCalculator::calc_fitness_score(const pcl::PointCloud<Poi
   int nr = 0;
   for(size_t i = 0; i < input_transformed.points.size(); ++i) {
     // Find its nearest neighbor in the target
-    tree_->nearestKSearch(input_transformed.points[i], 1, nn_indices, nn_dists);
+    tree1.nearestKSearch(input_transformed.points[i], 1, nn_indices, nn_dists);
 
     // Deal with occlusions (incomplete targets)
     if(nn_dists[0] <= max_range) {
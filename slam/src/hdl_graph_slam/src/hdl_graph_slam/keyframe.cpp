@@ -152,6 +152,14 @@ Eigen::Isometry3d KeyFrame::estimate() const {
   return node->estimate();
 }
 
+const pcl::search::KdTree<KeyFrame::PointT>::Ptr& KeyFrame::kdtree() const {
+  if(!cloud_kdtree) {
+    cloud_kdtree.reset(new pcl::search::KdTree<PointT>());
+    cloud_kdtree->setInputCloud(cloud);
+  }
+  return cloud_kdtree;
+}
+
 KeyFrameSnapshot::KeyFrameSnapshot(const Eigen::Isometry3d& pose, const pcl::PointCloud<PointT>::ConstPtr& cloud) : pose(pose), cloud(cloud) {}
 
 KeyFrameSnapshot::KeyFrameSnapshot(const KeyFrame::Ptr& key) : pose(key->node->estimate()), cloud(key->cloud) {}
@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <hdl_graph_slam/keyframe_archive.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include <pcl/io/lzf.h>
+#include <g2o/core/hyper_graph.h>
+#include <g2o/types/slam3d/vertex_se3.h>
+
+namespace hdl_graph_slam {
+
+namespace {
+
+const char magic[8] = "HGSKFA";
+const std::uint32_t version = 1;
+const size_t header_size = 24;
+const size_t point_bytes = 4 * sizeof(float);  // x, y, z, intensity
+
+static_assert(sizeof(KeyFrameArchive::Record) == 360, "the record layout must not contain padding");
+
+void store_pose(const Eigen::Isometry3d& pose, double* values) {
+  Eigen::Map<Eigen::Matrix<double, 3, 4, Eigen::RowMajor>> matrix(values);
+  matrix = pose.matrix().topRows<3>();
+}
+
+Eigen::Isometry3d restore_pose(const double* values) {
+  Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+  pose.matrix().topRows<3>() = Eigen::Map<const Eigen::Matrix<double, 3, 4, Eigen::RowMajor>>(values);
+  return pose;
+}
+
+}  // namespace
+
+KeyFrameArchive::KeyFrameArchive() : data(nullptr), data_size(0), index_offset(0), num_records(0) {}
+
+KeyFrameArchive::~KeyFrameArchive() {
+  if(data) {
+    munmap(const_cast<char*>(data), data_size);
+  }
+}
+
+bool KeyFrameArchive::save(const std::string& filename, const std::vector<KeyFrame::Ptr>& keyframes) {
+  std::vector<Record> records(keyframes.size());
+  std::vector<std::vector<char>> blocks(keyframes.size());
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for(int i = 0; i < static_cast<int>(keyframes.size()); i++) {
+    const auto& keyframe = keyframes[i];
+    Record& record = records[i];
+    std::memset(&record, 0, sizeof(Record));
+
+    record.node_id = keyframe->node->id();
+    record.stamp_sec = keyframe->stamp.sec;
+    record.stamp_nsec = keyframe->stamp.nsec;
+    store_pose(keyframe->node->estimate(), record.estimate);
+    store_pose(keyframe->odom, record.odom);
+    record.accum_distance = keyframe->accum_distance;
+
+    if(keyframe->floor_coeffs) {
+      Eigen::Map<Eigen::Vector4d>(record.floor_coeffs) = *keyframe->floor_coeffs;
+      record.flags |= FLOOR_COEFFS;
+    }
+    if(keyframe->utm_coord) {
+      Eigen::Map<Eigen::Vector3d>(record.utm_coord) = *keyframe->utm_coord;
+      record.flags |= UTM_COORD;
+    }
+    if(keyframe->acceleration) {
+      Eigen::Map<Eigen::Vector3d>(record.acceleration) = *keyframe->acceleration;
+      record.flags |= ACCELERATION;
+    }
+    if(keyframe->orientation) {
+      const auto& quat = *keyframe->orientation;
+      record.orientation[0] = quat.w();
+      record.orientation[1] = quat.x();
+      record.orientation[2] = quat.y();
+      record.orientation[3] = quat.z();
+      record.flags |= ORIENTATION;
+    }
+
+    // fields are stored separately (as in binary_compressed PCD files) so that similar values are contiguous
+    const auto& cloud = *keyframe->cloud;
+    const size_t num_points = cloud.size();
+    std::vector<float> fields(num_points * 4);
+    for(size_t j = 0; j < num_points; j++) {
+      fields[j] = cloud.points[j].x;
+      fields[num_points + j] = cloud.points[j].y;
+      fields[num_points * 2 + j] = cloud.points[j].z;
+      fields[num_points * 3 + j] = cloud.points[j].intensity;
+    }
+
+    const size_t raw_bytes = num_points * point_bytes;
+    auto& block = blocks[i];
+    block.resize(raw_bytes);
+    // lzf takes the sizes as unsigned int, larger clouds are stored as they are
+    const bool compressible = raw_bytes > 0 && raw_bytes <= std::numeric_limits<unsigned int>::max();
+    const unsigned int compressed_bytes = compressible ? pcl::lzfCompress(fields.data(), raw_bytes, block.data(), raw_bytes) : 0;
+    if(compressed_bytes > 0) {
+      block.resize(compressed_bytes);
+      record.flags |= COMPRESSED;
+    } else {
+      std::memcpy(block.data(), fields.data(), raw_bytes);
+    }
+
+    record.cloud_stamp = cloud.header.stamp;
+    record.num_points = num_points;
+    record.cloud_bytes = block.size();
+  }
+
+  std::ofstream ofs(filename, std::ios::binary);
+  if(!ofs) {
+    ROS_ERROR_STREAM("failed to open " << filename);
+    return false;
+  }
+
+  std::uint64_t offset = header_size;
+  for(size_t i = 0; i < keyframes.size(); i++) {
+    records[i].cloud_offset = offset;
+    offset += blocks[i].size();
+  }
+
+  // the index is aligned so that it can be read in place
+  const std::uint64_t records_offset = (offset + 7) / 8 * 8;
+  const std::uint32_t num_records = keyframes.size();
+
+  ofs.write(magic, sizeof(magic));
+  ofs.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  ofs.write(reinterpret_cast<const char*>(&num_records), sizeof(num_records));
+  ofs.write(reinterpret_cast<const char*>(&records_offset), sizeof(records_offset));
+  for(const auto& block : blocks) {
+    ofs.write(block.data(), block.size());
+  }
+
+  const char padding[8] = {0};
+  ofs.write(padding, records_offset - offset);
+  ofs.write(reinterpret_cast<const char*>(records.data()), sizeof(Record) * records.size());
+
+  return static_cast<bool>(ofs);
+}
+
+bool KeyFrameArchive::open(const std::string& filename) {
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0) {
+    ROS_ERROR_STREAM("failed to open " << filename);
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < header_size) {
+    ROS_ERROR_STREAM(filename << " is not a keyframe archive");
+    ::close(fd);
+    return false;
+  }
+
+  void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if(mapped == MAP_FAILED) {
+    ROS_ERROR_STREAM("failed to map " << filename);
+    return false;
+  }
+
+  data = static_cast<const char*>(mapped);
+  data_size = st.st_size;
+
+  std::uint32_t file_version;
+  std::uint64_t offset;
+  std::memcpy(&file_version, data + 8, sizeof(file_version));
+  std::memcpy(&num_records, data + 12, sizeof(num_records));
+  std::memcpy(&offset, data + 16, sizeof(offset));
+  index_offset = offset;
+
+  if(std::memcmp(data, magic, sizeof(magic)) != 0 || file_version != version) {
+    ROS_ERROR_STREAM(filename << " is not a keyframe archive (version " << version << ")");
+    return false;
+  }
+
+  if(num_records > static_cast<std::uint32_t>(std::numeric_limits<int>::max())) {
+    ROS_ERROR_STREAM(filename << " has too many keyframes (" << num_records << ")");
+    return false;
+  }
+
+  if(index_offset < header_size || index_offset > data_size || (data_size - index_offset) / sizeof(Record) < num_records) {
+    ROS_ERROR_STREAM(filename << " is truncated");
+    return false;
+  }
+
+  for(int i = 0; i < size(); i++) {
+    const Record r = record(i);
+    if(r.cloud_offset < header_size || r.cloud_offset > index_offset || r.cloud_bytes > index_offset - r.cloud_offset) {
+      ROS_ERROR_STREAM("keyframe " << i << " in " << filename << " points outside of the point blocks");
+      return false;
+    }
+
+    // num_points * point_bytes cannot overflow 64 bits, but must fit in memory (and in unsigned int for lzf)
+    const std::uint64_t raw_bytes = static_cast<std::uint64_t>(r.num_points) * point_bytes;
+    const std::uint64_t max_raw_bytes = (r.flags & COMPRESSED) ? std::numeric_limits<unsigned int>::max() : std::numeric_limits<size_t>::max();
+    const bool valid_size = (r.flags & COMPRESSED) ? r.cloud_bytes <= raw_bytes : r.cloud_bytes == raw_bytes;
+    if(raw_bytes > max_raw_bytes || !valid_size) {
+      ROS_ERROR_STREAM("keyframe " << i << " in " << filename << " has an invalid point block size (" << r.num_points << " points, " << r.cloud_bytes << " bytes)");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int KeyFrameArchive::size() const {
+  return num_records;
+}
+
+KeyFrameArchive::Record KeyFrameArchive::record(int i) const {
+  Record r;
+  std::memcpy(&r, data + index_offset + sizeof(Record) * i, sizeof(Record));
+  return r;
+}
+
+std::vector<KeyFrame::Ptr> KeyFrameArchive::load(g2o::HyperGraph* graph) const {
+  std::vector<KeyFrame::Ptr> keyframes(num_records);
+  for(int i = 0; i < size(); i++) {
+    const Record r = record(i);
+
+    auto found = graph->vertices().find(r.node_id);
+    g2o::VertexSE3* node = found == graph->vertices().end() ? nullptr : dynamic_cast<g2o::VertexSE3*>(found->second);
+    if(node == nullptr) {
+      ROS_ERROR_STREAM("vertex ID=" << r.node_id << " does not exist!!");
+      return std::vector<KeyFrame::Ptr>();
+    }
+    node->setEstimate(restore_pose(r.estimate));
+
+    keyframes[i].reset(new KeyFrame(ros::Time(r.stamp_sec, r.stamp_nsec), restore_pose(r.odom), r.accum_distance, nullptr));
+    keyframes[i]->node = node;
+
+    if(r.flags & FLOOR_COEFFS) {
+      keyframes[i]->floor_coeffs = Eigen::Vector4d(Eigen::Map<const Eigen::Vector4d>(r.floor_coeffs));
+    }
+    if(r.flags & UTM_COORD) {
+      keyframes[i]->utm_coord = Eigen::Vector3d(Eigen::Map<const Eigen::Vector3d>(r.utm_coord));
+    }
+    if(r.flags & ACCELERATION) {
+      keyframes[i]->acceleration = Eigen::Vector3d(Eigen::Map<const Eigen::Vector3d>(r.acceleration));
+    }
+    if(r.flags & ORIENTATION) {
+      keyframes[i]->orientation = Eigen::Quaterniond(r.orientation[0], r.orientation[1], r.orientation[2], r.orientation[3]);
+    }
+  }
+
+  const int num_keyframes = size();
+#pragma omp parallel for schedule(dynamic, 1)
+  for(int i = 0; i < num_keyframes; i++) {
+    keyframes[i]->cloud = decode_cloud(record(i));
+  }
+
+  for(const auto& keyframe : keyframes) {
+    if(keyframe->cloud == nullptr) {
+      return std::vector<KeyFrame::Ptr>();
+    }
+  }
+  return keyframes;
+}
+
+pcl::PointCloud<KeyFrame::PointT>::Ptr KeyFrameArchive::decode_cloud(const Record& record) const {
+  // the block sizes have been validated by open()
+  const size_t num_points = record.num_points;
+  const size_t raw_bytes = num_points * point_bytes;
+
+  std::vector<float> fields(num_points * 4);
+  if(record.flags & COMPRESSED) {
+    if(pcl::lzfDecompress(data + record.cloud_offset, record.cloud_bytes, fields.data(), raw_bytes) != raw_bytes) {
+      ROS_ERROR_STREAM("failed to decompress the cloud of vertex ID=" << record.node_id);
+      return nullptr;
+    }
+  } else {
+    std::memcpy(fields.data(), data + record.cloud_offset, raw_bytes);
+  }
+
+  pcl::PointCloud<KeyFrame::PointT>::Ptr cloud(new pcl::PointCloud<KeyFrame::PointT>());
+  cloud->resize(num_points);
+  for(size_t j = 0; j < num_points; j++) {
+    auto& pt = cloud->points[j];
+    pt.x = fields[j];
+    pt.y = fields[num_points + j];
+    pt.z = fields[num_points * 2 + j];
+    pt.intensity = fields[num_points * 3 + j];
+  }
+
+  cloud->header.stamp = record.cloud_stamp;
+  cloud->width = num_points;
+  cloud->height = 1;
+  cloud->is_dense = false;
+  return cloud;
+}
+
+}  // namespace hdl_graph_slam
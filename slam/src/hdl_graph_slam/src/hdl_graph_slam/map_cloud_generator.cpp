@@ -6,7 +6,7 @@
 
 namespace hdl_graph_slam {
 
-MapCloudGenerator::MapCloudGenerator() {}
+MapCloudGenerator::MapCloudGenerator() : update_trans_threshold(0.05), update_angle_threshold(0.01), voxel_resolution(0.0), update_count(0) {}
 
 MapCloudGenerator::~MapCloudGenerator() {}
 
@@ -50,4 +50,140 @@ pcl::PointCloud<MapCloudGenerator::PointT>::Ptr MapCloudGenerator::generate(cons
   return filtered;
 }
 
+void MapCloudGenerator::set_update_thresholds(double translation, double rotation) {
+  update_trans_threshold = translation;
+  update_angle_threshold = rotation;
+}
+
+pcl::PointCloud<MapCloudGenerator::PointT>::Ptr MapCloudGenerator::update(const std::vector<KeyFrameSnapshot::Ptr>& keyframes, double resolution) {
+  if(keyframes.empty()) {
+    std::cerr << "warning: keyframes empty!!" << std::endl;
+    return nullptr;
+  }
+
+  if(resolution <= 0.0) {
+    return generate(keyframes, resolution);
+  }
+
+  if(resolution != voxel_resolution) {
+    clear();
+    voxel_resolution = resolution;
+  }
+
+  update_count++;
+  for(const auto& keyframe : keyframes) {
+    auto found = contributions.find(keyframe->cloud.get());
+    if(found == contributions.end()) {
+      integrate(*keyframe, contributions[keyframe->cloud.get()]);
+      continue;
+    }
+
+    Contribution& contribution = found->second;
+    contribution.last_seen = update_count;
+
+    // small pose corrections are not worth re-integrating the keyframe
+    Eigen::Isometry3d delta = contribution.pose.inverse() * keyframe->pose;
+    double dx = delta.translation().norm();
+    double da = Eigen::AngleAxisd(delta.linear()).angle();
+    if(dx < update_trans_threshold && da < update_angle_threshold) {
+      continue;
+    }
+
+    remove(contribution);
+    integrate(*keyframe, contribution);
+  }
+
+  // keyframes that are no longer in the snapshot (e.g., replaced by load_map)
+  for(auto itr = contributions.begin(); itr != contributions.end();) {
+    if(itr->second.last_seen == update_count) {
+      itr++;
+      continue;
+    }
+    remove(itr->second);
+    itr = contributions.erase(itr);
+  }
+
+  pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>());
+  cloud->reserve(voxels.size());
+  for(const auto& voxel : voxels) {
+    PointT pt;
+    pt.getVector3fMap() = voxel_center(voxel.first);
+    pt.intensity = voxel.second.intensity_sum / voxel.second.num_points;
+    cloud->push_back(pt);
+  }
+
+  cloud->width = cloud->size();
+  cloud->height = 1;
+  cloud->is_dense = false;
+
+  return cloud;
+}
+
+void MapCloudGenerator::clear() {
+  contributions.clear();
+  voxels.clear();
+  voxel_resolution = 0.0;
+}
+
+// 21 bits per axis covers +-52km with 5cm voxels
+std::uint64_t MapCloudGenerator::voxel_key(const Eigen::Vector3f& pt) const {
+  const Eigen::Array3i coord = (pt.array() / voxel_resolution).floor().cast<int>() + (1 << 20);
+  const Eigen::Array3i clamped = coord.max(0).min((1 << 21) - 1);
+  return (static_cast<std::uint64_t>(clamped[0]) << 42) | (static_cast<std::uint64_t>(clamped[1]) << 21) | static_cast<std::uint64_t>(clamped[2]);
+}
+
+Eigen::Vector3f MapCloudGenerator::voxel_center(std::uint64_t key) const {
+  const std::uint64_t mask = (1 << 21) - 1;
+  const Eigen::Array3i coord(static_cast<int>(key >> 42) - (1 << 20), static_cast<int>((key >> 21) & mask) - (1 << 20), static_cast<int>(key & mask) - (1 << 20));
+  return ((coord.cast<float>() + 0.5f) * voxel_resolution).matrix();
+}
+
+void MapCloudGenerator::integrate(const KeyFrameSnapshot& keyframe, Contribution& contribution) {
+  contribution.pose = keyframe.pose;
+  contribution.cloud = keyframe.cloud;
+  contribution.last_seen = update_count;
+  contribution.voxels.clear();
+
+  // voxelize the keyframe on its own first so that the map is touched once per voxel
+  std::unordered_map<std::uint64_t, int> indices;
+  Eigen::Matrix4f pose = keyframe.pose.matrix().cast<float>();
+  for(const auto& src_pt : keyframe.cloud->points) {
+    const Eigen::Vector3f pt = (pose * src_pt.getVector4fMap()).head<3>();
+    const std::uint64_t key = voxel_key(pt);
+
+    auto inserted = indices.emplace(key, contribution.voxels.size());
+    if(inserted.second) {
+      contribution.voxels.push_back(VoxelPoints{key, 0, 0.0f});
+    }
+
+    VoxelPoints& voxel = contribution.voxels[inserted.first->second];
+    voxel.num_points++;
+    voxel.intensity_sum += src_pt.intensity;
+  }
+
+  for(const auto& points : contribution.voxels) {
+    Voxel& voxel = voxels.emplace(points.key, Voxel{0, 0, 0.0}).first->second;
+    voxel.num_keyframes++;
+    voxel.num_points += points.num_points;
+    voxel.intensity_sum += points.intensity_sum;
+  }
+}
+
+void MapCloudGenerator::remove(const Contribution& contribution) {
+  for(const auto& points : contribution.voxels) {
+    auto found = voxels.find(points.key);
+    if(found == voxels.end()) {
+      continue;
+    }
+
+    Voxel& voxel = found->second;
+    if(--voxel.num_keyframes == 0) {
+      voxels.erase(found);
+      continue;
+    }
+    voxel.num_points -= points.num_points;
+    voxel.intensity_sum -= points.intensity_sum;
+  }
+}
+
 }  // namespace hdl_graph_slam
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <map>
+#include <random>
+#include <string>
+#include <gtest/gtest.h>
+
+#include <Eigen/Eigenvalues>
+#include <g2o/types/slam3d/isometry3d_mappings.h>
+#include <hdl_graph_slam/information_matrix_calculator.hpp>
+
+namespace {
+
+using Matrix6d = Eigen::Matrix<double, 6, 6>;
+using Vector6d = Eigen::Matrix<double, 6, 1>;
+
+struct Params {
+  template<typename T>
+  T param(const std::string& name, const T& default_value) const {
+    auto found = values.find(name);
+    return found == values.end() ? default_value : static_cast<T>(found->second);
+  }
+
+  std::map<std::string, double> values;
+};
+
+Eigen::Matrix3d skew(const Eigen::Vector3d& x) {
+  Eigen::Matrix3d m;
+  m << 0.0, -x.z(), x.y(), x.z(), 0.0, -x.x(), -x.y(), x.x(), 0.0;
+  return m;
+}
+
+struct InformationMatrixTest : public testing::Test {
+  virtual void SetUp() {
+    // loop closure with a few meters of offset so that the change of frame matters
+    relpose.setIdentity();
+    relpose.linear() = Eigen::AngleAxisd(0.7, Eigen::Vector3d(0.2, 0.3, 1.0).normalized()).toRotationMatrix();
+    relpose.translation() = Eigen::Vector3d(4.0, -2.5, 0.3);
+
+    std::mt19937 mt(42);
+    std::normal_distribution<> ndist;
+    for(int i = 0; i < 200; i++) {
+      points.push_back(Eigen::Vector3d(5.0 * ndist(mt), 5.0 * ndist(mt), ndist(mt)));
+
+      Eigen::Matrix3d a;
+      for(int j = 0; j < 9; j++) {
+        a.data()[j] = ndist(mt);
+      }
+      weights.push_back(a * a.transpose() + 0.1 * Eigen::Matrix3d::Identity());
+    }
+  }
+
+  // Hessian of sum_i r_i^T W_i r_i, r_i = T * p_i, as fast_gicp computes it (left perturbation [rotation, translation])
+  Matrix6d fast_gicp_hessian() const {
+    Matrix6d H = Matrix6d::Zero();
+    for(size_t i = 0; i < points.size(); i++) {
+      Eigen::Matrix<double, 3, 6> J;
+      J.block<3, 3>(0, 0) = skew(relpose * points[i]);
+      J.block<3, 3>(0, 3) = -Eigen::Matrix3d::Identity();
+      H += J.transpose() * weights[i] * J;
+    }
+    return H;
+  }
+
+  // the same Hessian with respect to the EdgeSE3 error e = toVectorMQT(Z^-1 * T), by numerical differentiation
+  Matrix6d edge_se3_hessian() const {
+    const double h = 1e-6;
+
+    Matrix6d H = Matrix6d::Zero();
+    for(size_t i = 0; i < points.size(); i++) {
+      Eigen::Matrix<double, 3, 6> J;
+      for(int k = 0; k < 6; k++) {
+        Vector6d e = Vector6d::Zero();
+        e[k] = h;
+        const Eigen::Vector3d r1 = (relpose * g2o::internal::fromVectorMQT(e)) * points[i];
+        e[k] = -h;
+        const Eigen::Vector3d r0 = (relpose * g2o::internal::fromVectorMQT(e)) * points[i];
+        J.col(k) = (r1 - r0) / (2.0 * h);
+      }
+      H += J.transpose() * weights[i] * J;
+    }
+    return H;
+  }
+
+  Eigen::Isometry3d relpose;
+  std::vector<Eigen::Vector3d> points;
+  std::vector<Eigen::Matrix3d> weights;
+};
+
+TEST_F(InformationMatrixTest, HessianFrameCheck) {
+  // no scaling and no effective clamping
+  Params params;
+  params.values = {{"use_hessian_inf_matrix", 1.0}, {"hessian_inf_scale", 1.0}, {"min_stddev_x", 1e-9}, {"max_stddev_x", 1e9}, {"min_stddev_q", 1e-9}, {"max_stddev_q", 1e9}};
+
+  hdl_graph_slam::InformationMatrixCalculator calculator;
+  calculator.load(params);
+
+  const Eigen::MatrixXd inf = calculator.calc_information_matrix(0.1, relpose, fast_gicp_hessian());
+  const Matrix6d expected = edge_se3_hessian();
+
+  ASSERT_EQ(inf.rows(), 6);
+  ASSERT_EQ(inf.cols(), 6);
+  EXPECT_LT((inf - expected).norm() / expected.norm(), 1e-6);
+}
+
+TEST_F(InformationMatrixTest, HessianBoundsCheck) {
+  Params params;
+  params.values = {{"use_hessian_inf_matrix", 1.0}, {"hessian_inf_scale", 1.0}};
+
+  hdl_graph_slam::InformationMatrixCalculator calculator;
+  calculator.load(params);
+
+  // default bounds: min/max_stddev_x = 0.1/5.0, min/max_stddev_q = 0.05/0.2
+  Vector6d max_inf;
+  max_inf << Eigen::Vector3d::Constant(1.0 / (0.1 * 0.1)), Eigen::Vector3d::Constant(1.0 / (0.05 * 0.05));
+
+  for(double scale : {1e-6, 1.0, 1e2}) {
+    const Eigen::MatrixXd inf = calculator.calc_information_matrix(0.1, relpose, scale * fast_gicp_hessian());
+
+    // symmetric and not more certain than min_stddev in any direction
+    EXPECT_LT((inf - inf.transpose()).norm(), 1e-9);
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(Eigen::MatrixXd(max_inf.asDiagonal()) - inf);
+    EXPECT_GT(eig.eigenvalues().minCoeff(), -1e-6 * max_inf.maxCoeff()) << "scale=" << scale;
+
+    // positive definite
+    EXPECT_GT(Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd>(inf).eigenvalues().minCoeff(), 0.0) << "scale=" << scale;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}